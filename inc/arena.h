@@ -0,0 +1,31 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdlib.h>
+
+#define ARENA_CHUNK (1 << 16)
+#define ARENA_ALIGN 16
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t used;
+    size_t capacity;
+    char *data;
+} ArenaChunk;
+
+// Bump allocator over a chain of chunks. Nothing is freed on its own; arena_reset releases everything at once.
+typedef struct {
+    ArenaChunk *head;
+    size_t chunk_size;
+} Arena;
+
+Arena *arena_create(size_t);
+void *arena_alloc(Arena*, size_t);
+void *arena_resize(Arena*, void*, size_t, size_t);
+void arena_reset(Arena*);
+void arena_destroy(Arena*);
+
+Arena *compile_arena();
+void compile_arena_cleanup();
+
+#endif // ARENA_H
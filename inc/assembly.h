@@ -0,0 +1,27 @@
+#ifndef ASSEMBLY_H
+#define ASSEMBLY_H
+
+#include <stdint.h>
+
+#include "astnode.h"
+#include "vector.h"
+#include "vecs.h"
+#include "dict.h"
+
+int generate_asm(TokenVec*, NodeVec*, Vector*, CVec**);
+
+void asm_cmd(uint32_t);
+void asm_fn_cmd(uint32_t);
+void asm_statement(uint32_t);
+void asm_lvalue(uint32_t);
+
+void asm_expr(uint32_t);
+void asm_arrayindex_expr(uint32_t);
+void asm_call_expr(uint32_t);
+void asm_binop_expr(uint32_t);
+void asm_loop_expr(uint32_t);
+
+int is_packable(uint32_t, uint32_t);
+void asm_packed_expr(uint32_t, StringRef);
+
+#endif // ASSEMBLY_H
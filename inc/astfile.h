@@ -0,0 +1,66 @@
+#ifndef ASTFILE_H
+#define ASTFILE_H
+
+#include <stdint.h>
+
+#include "vecs.h"
+#include "vector.h"
+#include "dict.h"
+
+#define AST_MAGIC "JPLAST\0\0"
+#define AST_VERSION 5
+#define AST_ALIGN 8
+
+// A saved program is this header followed by its sections, each starting on an AST_ALIGN boundary:
+//   strings   the source, then any symbol text that does not lie in it
+//   tokens    kinds (uint8), then offsets and lengths (uint32), as in TokenVec
+//   nodes     SavedNode
+//   commands  uint32 node indices
+//   pool      the child pool, so lists keep their offsets
+//   symbols   SavedSymbol, the text of each symbol id the nodes use, from 1
+//   names     SavedName, the global declarations of the type checker
+// Nothing holds a pointer. Strings are offsets into the string section; symbols are interned again on loading.
+// The checksum covers every section, so that a damaged file is turned away before its indices are checked.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t node_size;
+    uint64_t source_size;
+    uint64_t string_size;
+    uint64_t token_count;
+    uint64_t node_count;
+    uint64_t cmd_count;
+    uint64_t pool_size;
+    uint64_t symbol_count;
+    uint64_t name_count;
+    uint64_t checksum[2];
+} AstHeader;
+
+typedef struct {
+    uint32_t token_index;
+    uint32_t type;
+    uint64_t field1;
+    uint32_t field2;
+    uint32_t field3;
+    uint32_t field4;
+    uint32_t symbol;
+} SavedNode;
+
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+} SavedSymbol;
+
+typedef struct {
+    uint32_t symbol;
+    uint32_t node;
+} SavedName;
+
+uint64_t *symbol_offsets(TokenVec*, size_t, CVec*);
+int ast_save(char*, size_t, TokenVec*, NodeVec*, Vector*, Dict*);
+int ast_valid(char*, size_t);
+uint64_t ast_source_size(char*, size_t);
+char *ast_source(char*, size_t*);
+int ast_load(char*, size_t, TokenVec**, NodeVec**, Vector**, Dict**);
+
+#endif // ASTFILE_H
@@ -5,6 +5,7 @@
 #include "stringops.h"
 #include "vector.h"
 #include "dict.h"
+#include "intern.h"
 
 typedef enum { READ_CMD, WRITE_CMD, LET_CMD, ASSERT_CMD, PRINT_CMD, SHOW_CMD, TIME_CMD, FN_CMD, STRUCT_CMD } CommandType;
 typedef enum { INT_EXPR, FLOAT_EXPR, TRUE_EXPR, FALSE_EXPR, VAR_EXPR, VOID_EXPR, ARRAYLITERAL_EXPR, STRUCTLITERAL_EXPR,
@@ -14,7 +15,16 @@ typedef enum { LET_STMT, ASSERT_STMT, RETURN_STMT } StatementType;
 typedef enum { INT_TYPE, BOOL_TYPE, FLOAT_TYPE, ARRAY_TYPE, STRUCT_TYPE, VOID_TYPE, VAR_TYPE } TypeType;
 typedef enum { BINDING } BindingType;
 
+// What a node is, found by walking the tree from the commands. Nodes no command reaches have none.
+typedef enum { NO_CATEGORY, COMMAND_NODE, EXPRESSION_NODE, LVALUE_NODE, STATEMENT_NODE, TYPE_NODE, BINDING_NODE,
+               MEMBER_NODE } NodeCategory;
 
+// Offset of a child list in the shared child pool. 0 means no list.
+typedef uint32_t ChildList;
+
+
+// A node is 32 bytes, as small as it gets without splitting it up: field1 must hold a 64-bit literal, and a loop
+// needs four links besides its token and symbol.
 typedef struct AstNode {
     uint32_t token_index;
 
@@ -30,26 +40,36 @@ typedef struct AstNode {
     union {
         uint64_t int_value;
         double float_value;
-        uint64_t node;
-        Vector *list;
+        uint32_t node;
+        ChildList list;
     } field1;
     union {
-        uint64_t node;
-        Vector *list;
+        uint32_t node;
+        ChildList list;
     } field2;
     union {
-        uint64_t node;
-        Vector *list;
+        uint32_t node;
+        ChildList list;
     } field3;
     union {
-        uint64_t node;
-        Vector *list;
+        uint32_t node;
+        ChildList list;
     } field4;
 
-    StringRef string;
+    // The interned id of the node's text (a name, operator, literal or string), or NO_SYMBOL.
+    // symbol_name gives the text back, so a node keeps no pointer into the source. A number literal is
+    // NUMBER_SYMBOL instead and keeps its token in field2, since a program can hold millions of distinct numbers.
+    uint32_t symbol;
 } AstNode;
 
-AstNode create_node(uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, StringRef);
+AstNode create_node(uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t);
 AstNode get_empty_node();
 
+ChildList childlist_create(uint32_t*, size_t);
+uint32_t childlist_size(ChildList);
+uint32_t childlist_get(ChildList, size_t);
+uint32_t *childlist_pool(size_t*);
+void childlist_load(uint32_t*, size_t);
+void childlist_reset();
+
 #endif // ASTNODE_H
@@ -0,0 +1,38 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define CACHE_DIR ".jplc-cache"
+#define CACHE_MAGIC "JPLCACHE"
+// Keys include a hash of the compiler binary, so a rebuild already misses every old entry. Bump this whenever
+// the entry layout or what any mode prints changes anyway, for builds whose binary cannot be read.
+#define CACHE_VERSION 4
+#define CACHE_PATH 256
+
+// Identifies a compilation by its source and everything else that shapes its output
+typedef struct {
+    uint64_t hash[2];
+    uint64_t source_size;
+} CacheKey;
+
+// Stored ahead of the output in every cache entry
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    int32_t status;
+    CacheKey key;
+    uint64_t output_size;
+} CacheHeader;
+
+void cache_setup(char*);
+int cache_enabled();
+CacheKey cache_key(char*, size_t, char*, size_t);
+int cache_path(CacheKey*, char*, char*);
+void cache_count(int);
+int cache_load(CacheKey*, char**, size_t*, int*);
+void cache_store(CacheKey*, char*, size_t, int);
+void cache_print_stats();
+
+#endif // CACHE_H
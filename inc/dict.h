@@ -6,26 +6,37 @@
 
 #include "stringops.h"
 
-#define BIG_SIZE 0xFFFF
-#define SMALL_SIZE 0xFF
+#define BIG_SIZE 0x1000
+#define SMALL_SIZE 0x100
+
+// A slot's control byte is DICT_EMPTY, DICT_DELETED, or DICT_FULL with the top 7 bits of its hash below it, so
+// probes pass over most other keys without touching the slots
+#define DICT_EMPTY 0
+#define DICT_DELETED 1
+#define DICT_FULL 0x80
 
 typedef struct {
-    uint16_t _node;
-    uint16_t _tombstone;
+    uint32_t hash;
     StringRef key;
     void *value;
 } Node;
 
+// An open-addressed table with a power-of-two capacity and linear probing. The control bytes sit apart from
+// the slots so a probe scans a run of bytes.
 typedef struct {
     uint64_t size;
     uint64_t capacity;
+    uint64_t deleted;
+    uint8_t *control;
     Node *array;
 } Dict;
 
 Dict *dict_create_big();
 Dict *dict_create_small();
+Dict *dict_create_cap(size_t);
 void dict_free(Dict*);
 void dict_expand(Dict*);
+int dict_next(Dict*, size_t*, StringRef*, void**);
 
 int dict_try_string(Dict *, String, void **);
 int dict_try_ref(Dict*, StringRef, void **);
@@ -44,5 +55,6 @@ void *dict_remove_ref(Dict*, StringRef);
 void *dict_remove_array(Dict*, char*, size_t);
 
 uint32_t hash_string(char *, size_t, uint32_t);
+void hash_string_128(char *, size_t, uint64_t, uint64_t[2]);
 
 #endif // DICT_H
@@ -0,0 +1,50 @@
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "error.h"
+#include "vecs.h"
+#include "vector.h"
+
+#define NO_COMMAND UINT32_MAX
+
+// Nodes left behind by replaced segments are freed by compiling the document again once there are at least this
+// many and they outnumber the nodes still in use
+#define REBUILD_NODES 4096
+
+// One top-level step of the parse: the tokens from 'first_token' up to the next segment's, the nodes made
+// while parsing them, the parse errors reported for them and the command kept from them, if any. The last
+// segment of a document is empty and starts at END_OF_FILE.
+typedef struct {
+    uint32_t first_token;
+    uint32_t first_node;
+    uint32_t end_node;
+    uint32_t first_error;
+    uint32_t error_count;
+    uint32_t cmd;
+    uint32_t failed;
+} Segment;
+
+// A program kept between edits, such as a file open in an editor. Only one document is open per thread, since
+// it holds on to the thread's child pool and type-checker state. 'orphaned' counts the nodes of replaced
+// segments, which stay in the node vector along with their child lists.
+typedef struct {
+    char *name;
+    char *source;
+    size_t size;
+    TokenVec *tokens;
+    NodeVec *nodes;
+    Vector *cmds;
+    Segment *segments;
+    size_t segment_count;
+    ParseErrorList parse_errors;
+    size_t orphaned;
+} Document;
+
+int document_open(Document*, char*, char*, size_t);
+int document_edit(Document*, size_t, size_t, char*, size_t);
+void document_close(Document*);
+
+#endif // DOCUMENT_H
@@ -4,6 +4,9 @@
 #include "token.h"
 #include "vecs.h"
 
+// Errors past this many at once are counted but not printed, unless --max-errors says otherwise
+#define DEFAULT_MAX_ERRORS 100
+
 typedef enum { LEX_ERROR, PARSE_ERROR, TYPE_ERROR } ErrorType;
 typedef enum { INVALID_LEX, ILLEGAL_LEX, UNCLOSED_STRING } LexErrorType;
 typedef enum { UNEXPECTED_TOKEN, BAD_CMD, BAD_EXPR, BAD_LVALUE, BAD_STMT, BAD_BIND, BAD_TYPE, BAD_UNARY, BAD_BINARY,
@@ -12,6 +15,16 @@ typedef enum { UNEXPECTED_TYPE, UNRESOLVED_TYPE, MISMATCHED_BINOP, MISMATCHED_IF
                 UNDECLARED_VARIABLE, SHADOWED_VARIABLE, NO_RETURN, BAD_RETURN, STRUCT_ASSIGN, VOID_ASSIGN, MISMATCHED_MEMBERS,
                 EMPTY_ARRAY, MISMATCHED_ARRAY, NO_INDEX, BAD_RANK, BAD_FN, BAD_DIMENSION, BAD_SUM } TypeErrorType;
 
+// A parse error as it was reported, for a document to report again for a command it does not parse again
+typedef struct {
+    ParseErrorType type;
+    uint32_t has_ref;
+    Token error_token;
+    Token ref_token;
+} SavedParseError;
+
+typedef struct { SavedParseError *items; size_t size; size_t capacity; } ParseErrorList;
+
 typedef struct {
     ErrorType error_type;
     
@@ -25,12 +38,17 @@ typedef struct {
     void *second_token;
 } ErrorToken;
 
-void error_setup(char *, char*);
+void error_setup(char*, char*, size_t);
+void set_output(FILE*);
+FILE *get_output();
 void token_list_setup(TokenVec*);
+void set_max_errors(size_t);
+size_t get_max_errors();
 void clear_errors();
 
 void add_lex_error(LexErrorType, Token*);
 void add_parse_error(ParseErrorType, Token*, Token*);
+void save_parse_errors(ParseErrorList*);
 void add_type_error(TypeErrorType, AstNode*, AstNode*);
 
 void print_errors();
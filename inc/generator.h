@@ -0,0 +1,28 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <stdint.h>
+
+#include "astnode.h"
+#include "vector.h"
+#include "vecs.h"
+#include "dict.h"
+
+int generate_c(TokenVec*, NodeVec*, Vector*, CVec**);
+
+void generate_cmd(uint32_t);
+void generate_fn_cmd(uint32_t);
+void generate_statement(uint32_t);
+void generate_lvalue(uint32_t, uint32_t, int);
+
+uint32_t generate_expr(uint32_t);
+uint32_t generate_arrayindex_expr(uint32_t);
+uint32_t generate_call_expr(uint32_t);
+uint32_t generate_binop_expr(uint32_t);
+uint32_t generate_if_expr(uint32_t);
+uint32_t generate_loop_expr(uint32_t);
+
+char *get_type_name(uint64_t);
+char *get_show_name(uint64_t);
+
+#endif // GENERATOR_H
@@ -0,0 +1,19 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "stringops.h"
+
+#define NO_SYMBOL 0
+// Stands for the text of a number literal, which is never interned and so names nothing
+#define NUMBER_SYMBOL UINT32_MAX
+
+uint32_t intern_ref(StringRef);
+int intern_find(StringRef, uint32_t*);
+StringRef symbol_name(uint32_t);
+uint32_t symbol_count();
+void intern_reset();
+
+#endif // INTERN_H
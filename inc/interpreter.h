@@ -0,0 +1,71 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include <stdint.h>
+
+#include "astnode.h"
+#include "vector.h"
+#include "vecs.h"
+#include "dict.h"
+
+typedef enum { OP_NOP, OP_CONST, OP_LOCAL, OP_GLOBAL, OP_ARRAY_LITERAL, OP_STRUCT_LITERAL, OP_DOT, OP_INDEX, OP_CALL,
+                OP_BUILTIN, OP_BUILTIN2, OP_TO_INT, OP_TO_FLOAT, OP_NEG_INT, OP_NEG_FLOAT, OP_NOT,
+                OP_ADD_INT, OP_SUB_INT, OP_MUL_INT, OP_DIV_INT, OP_MOD_INT,
+                OP_ADD_FLOAT, OP_SUB_FLOAT, OP_MUL_FLOAT, OP_DIV_FLOAT, OP_MOD_FLOAT,
+                OP_LT_INT, OP_LE_INT, OP_GT_INT, OP_GE_INT, OP_EQ_INT, OP_NE_INT,
+                OP_LT_FLOAT, OP_LE_FLOAT, OP_GT_FLOAT, OP_GE_FLOAT, OP_EQ_FLOAT, OP_NE_FLOAT,
+                OP_AND, OP_OR, OP_IF, OP_ARRAY_LOOP, OP_SUM_INT, OP_SUM_FLOAT,
+                OP_LET, OP_ASSERT, OP_RETURN, OP_READ, OP_WRITE, OP_PRINT, OP_SHOW, OP_TIME } OpCode;
+
+// Runtime values. Bools and void are stored as ints. Arrays and structs are immutable and shared by reference.
+typedef union Value {
+    int64_t int_value;
+    double float_value;
+    struct Array *array;
+    union Value *fields;
+} Value;
+
+typedef struct Array {
+    int64_t size;
+    Value *data;
+    int64_t dims[];
+} Array;
+
+// One lowered expression, statement or command. Children are instruction indices, variables are frame slots and
+// variable-arity children occupy 'count' consecutive entries of the operand pool starting at 'list'.
+typedef struct {
+    OpCode op;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+    uint32_t list;
+    uint32_t count;
+    Value value;
+    char *string;
+} Instr;
+
+// Parameters occupy pairs of (slot, dimension count) entries of the operand pool starting at 'params'.
+typedef struct {
+    uint32_t params;
+    uint32_t param_count;
+    uint32_t body;
+    uint32_t body_count;
+    uint32_t frame_size;
+} Function;
+
+int run_program(TokenVec*, NodeVec*, Vector*, int, char**);
+
+uint32_t lower_cmd(uint32_t);
+uint32_t lower_fn_cmd(uint32_t);
+uint32_t lower_statement(uint32_t);
+uint32_t lower_lvalue(uint32_t);
+uint32_t lower_expr(uint32_t);
+uint32_t lower_call_expr(uint32_t);
+uint32_t lower_binop_expr(uint32_t);
+uint32_t lower_loop_expr(uint32_t);
+
+Value evaluate(uint32_t, Value*);
+int execute(uint32_t, Value*, Value*);
+void show_value(Value, uint64_t);
+
+#endif // INTERPRETER_H
@@ -2,6 +2,7 @@
 #define LEXER_H
 
 #include <stdint.h>
+#include <pthread.h>
 #include "token.h"
 #include "dict.h"
 #include "vecs.h"
@@ -39,7 +40,39 @@
 #define IS_DIGIT(c) (c <= '9' && c >= '0')
 #define IS_ILLEGAL(c) (c < 32 || c == 127)
 
+// Typical sources have one token per three to four bytes. Vectors start at this estimate and grow as needed.
+#define TOKEN_ESTIMATE(bytes) ((bytes) / 4 + 16)
+
+// Inputs are split into chunks of at least this many bytes when lexing on several threads
+#define LEX_CHUNK_MIN (1 << 20)
+
+// Streamed lexing hands tokens to the parser in batches of about LEX_BATCH source bytes through a ring of
+// TOKEN_RING tokens
+#define LEX_BATCH (1 << 12)
+#define TOKEN_RING (1 << 12)
+
+typedef struct {
+    char *start;
+    char *stop;
+    char *end;
+    char *limit;
+    TokenVec *vector;
+} LexChunk;
+
+void lex_set_threads(int);
+void lex_setup(char*, size_t);
+int lex_report(TokenVec*, size_t, size_t);
 int lex_string(char*, size_t, TokenVec**);
+char *lex_range(char*, char*, TokenVec*);
+TokenVec *lex_parallel(char*, char**);
+void *lex_chunk(void*);
+TokenVec *free_chunks(LexChunk*, size_t, pthread_t*, int*);
+char *next_split(char*, char*);
+
+int lex_stream_start(char*, size_t);
+int lex_stream_pull(TokenVec*);
+void *lex_stream(void*);
+void stream_push(TokenVec*);
 
 uint32_t lex_var_token(char*, uint32_t, Token*);
 uint32_t lex_num_token(char*, uint32_t, Token*);
@@ -52,7 +85,6 @@ uint32_t lex_string_token(char*, uint32_t, Token*);
 uint32_t lex_bool_token(char*, uint32_t, Token*);
 
 int is_keyword_match(char *, uint32_t, uint32_t, Token*);
-Dict *create_keyword_dictionary();
 
 void lex_error(LexErrorType, Token*);
 
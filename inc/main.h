@@ -1,10 +1,42 @@
 #ifndef MAIN_H
 #define MAIN_H
 
-typedef enum { HELP_MODE, LEX_MODE, PARSE_MODE, TYPE_MODE, C_MODE, COMPILE_MODE, RUN_MODE } RunMode;
-typedef enum { STANDARD_PRINT, NO_PRINT, PRETTY_PRINT, TABBED_PRINT, XML_PRINT } PrintMode;
+#include "vecs.h"
+#include "vector.h"
+#include "cache.h"
+#include "document.h"
+
+typedef enum { HELP_MODE, LEX_MODE, PARSE_MODE, TYPE_MODE, C_MODE, ASM_MODE, COMPILE_MODE, RUN_MODE } RunMode;
+typedef enum { STANDARD_PRINT, NO_PRINT, PRETTY_PRINT, TABBED_PRINT, XML_PRINT, JSON_PRINT, BINARY_PRINT } PrintMode;
 
 #define LINE_SIZE 120
+#define SERVER_PATH "jplc.sock"
+#define SERVER_BACKLOG 64
+
+// The source and results of one compilation. Options that apply to every compilation stay in main.c.
+typedef struct {
+    char *file_name;
+    char *file_string;
+    size_t file_size;
+    char *buffer;
+    int mapped;
+    char *save_path;
+    int load_program;
+    TokenVec *token_vector;
+    NodeVec *node_vector;
+    Vector *cmd_vector;
+    CVec *c_code;
+    CVec *asm_code;
+} Compilation;
+
+// A file compiled in batch mode, with the output it produced
+typedef struct {
+    Compilation unit;
+    char *output;
+    size_t output_size;
+    int status;
+    int done;
+} BatchJob;
 
 int parse_input_args(int, char*[]);
 void insufficient_args();
@@ -12,10 +44,24 @@ void invalid_args(char*);
 void missing_filename();
 void missing_runmode();
 int run_help();
-int open_file();
-int run_compilation();
-void print_success();
+int open_file(Compilation*);
+int read_stream(Compilation*, int);
+void print_too_large(Compilation*);
+void close_file(Compilation*);
+int run_compilation(Compilation*);
+int compile_and_report(Compilation*);
+int compile_cached(Compilation*);
+int run_cached(Compilation*, CacheKey*);
+int run_batch();
+void *batch_worker(void*);
+int run_server();
+int serve_request(int);
+int serve_document(Document*, char*, Compilation*);
+int check_program(Compilation*, int);
+int lex_and_parse(Compilation*);
+void print_success(Compilation*);
 void print_fail();
+void release_compilation(Compilation*);
 void gen_defines();
 
 #endif // MAIN_H
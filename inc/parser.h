@@ -9,20 +9,27 @@
 #include "stringops.h"
 #include "vector.h"
 
+int parse_stream(TokenVec*, NodeVec**, Vector**);
 int parse_tokens(TokenVec*, NodeVec**, Vector**);
+void parse_setup(TokenVec*, NodeVec*);
+int parse_next(uint32_t*, uint32_t*);
+int parse_status();
+void parse_cleanup();
 int expect_token(TokenType, uint32_t, StringRef*);
 TokenType peek_token_type(uint32_t);
+int has_token(uint32_t);
 int try_find_next(uint32_t*, TokenType, TokenType);
 
 void parse_error(ParseErrorType, uint32_t);
+void paren_error(uint32_t, uint32_t);
 
-int parse_command(uint32_t*, uint64_t*);
-int parse_lvalue(uint32_t*, uint64_t*);
-int parse_expression(uint32_t*, uint64_t*, int);
-int parse_expression_literal(uint32_t*, uint64_t*);
-int parse_binding(uint32_t*, uint64_t*);
-int parse_type(uint32_t*, uint64_t*);
-int parse_statement(uint32_t*, uint64_t*);
+int parse_command(uint32_t*, uint32_t*);
+int parse_lvalue(uint32_t*, uint32_t*);
+int parse_expression(uint32_t*, uint32_t*, int);
+int parse_expression_literal(uint32_t*, uint32_t*);
+int parse_binding(uint32_t*, uint32_t*);
+int parse_type(uint32_t*, uint32_t*);
+int parse_statement(uint32_t*, uint32_t*);
 int is_binary_operator(uint32_t);
 int is_boolean_operator(StringRef);
 int get_operator_precedence(StringRef);
@@ -4,8 +4,52 @@
 #include "vecs.h"
 #include "vector.h"
 
+#define DUMP_MAGIC "JPLDUMP\0"
+#define DUMP_VERSION 2
+#define DUMP_NO_TEXT UINT64_MAX
+
+// --binary-print writes a DumpHeader, then sections that each start with a DumpSection giving the size and
+// number of the items that follow. Numbers are in the byte order of the machine that wrote them.
+//   TOKEN_KINDS    uint8 per token, as in TokenVec
+//   TOKEN_OFFSETS  uint32 per token
+//   TOKEN_LENGTHS  uint32 per token
+//   NODES          DumpNode; a node's kind is a value of the enum its category names
+//   COMMANDS       uint32 node indices
+//   POOL           the child pool; the list at offset i holds pool[i] items starting at pool[i + 1]
+//   STRINGS        the source, then any node text that does not lie in it
+// --json-print writes the same arrays as one JSON object, with the names of the kinds.
+typedef enum { DUMP_TOKEN_KINDS, DUMP_TOKEN_OFFSETS, DUMP_TOKEN_LENGTHS, DUMP_NODES, DUMP_COMMANDS, DUMP_POOL,
+               DUMP_STRINGS } DumpTag;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t typed;
+} DumpHeader;
+
+typedef struct {
+    uint32_t tag;
+    uint32_t item_size;
+    uint64_t count;
+} DumpSection;
+
+typedef struct {
+    uint32_t token_index;
+    uint8_t category;
+    uint8_t kind;
+    uint16_t unused;
+    uint64_t field1;
+    uint32_t field2;
+    uint32_t field3;
+    uint32_t field4;
+    uint32_t text_length;
+    uint64_t text_offset;
+} DumpNode;
+
 void print_tokens(TokenVec*);
 void print_nodes(NodeVec*, Vector*, TokenVec*);
+void print_json(TokenVec*, NodeVec*, Vector*);
+void print_binary(TokenVec*, NodeVec*, Vector*);
 void set_type_check();
 
 void print_command(AstNode *);
@@ -0,0 +1,43 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <math.h>
+
+// Value of the JPL 'void' type. C has no empty structs, so it carries one unused byte.
+typedef struct {
+    char unused;
+} jpl_void;
+
+void jpl_fail(const char*);
+void jpl_fail_assertion(const char*);
+void *jpl_alloc(size_t);
+int64_t *jpl_args(int, char**, int64_t*);
+
+void jpl_print(const char*);
+void jpl_show_int(int64_t);
+void jpl_show_float(double);
+void jpl_show_bool(bool);
+void jpl_show_void(jpl_void);
+
+// Prints a value stored as consecutive 8-byte words, followed by a newline. The type descriptor is one of 'i',
+// 'f', 'b', 'v', 'a<rank><element>' or 's<name>(<members>)', e.g. "a2srgba(ffff)".
+void jpl_show(const char*, const void*);
+
+double jpl_get_time();
+void jpl_print_time(double);
+
+void *jpl_read_image(const char*, int64_t*, int64_t*);
+void jpl_write_image(const void*, int64_t, int64_t, const char*);
+
+// Truncates towards zero, saturating at the int range. NaN converts to 0.
+static inline int64_t jpl_to_int(double value) {
+    if (value != value) return 0;
+    if (value >= 9223372036854775807.0) return INT64_MAX;
+    if (value <= -9223372036854775808.0) return INT64_MIN;
+    return (int64_t) value;
+}
+
+#endif // RUNTIME_H
@@ -0,0 +1,12 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+
+// Byte scanners over [start, end). Each returns a pointer to the first byte that stops the scan, or end.
+char *scan_spaces(char*, char*);
+char *scan_identifier(char*, char*);
+char *scan_illegal(char*, char*);
+char *scan_comment(char*, char*);
+
+#endif // SCAN_H
@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
+
 #define MAXIMUM_BUFFER 1024
 #define RED "\033[0;31m"
 #define RED_BOLD "\033[1;31m"
@@ -28,6 +30,7 @@ String *string_from_ref(StringRef);
 StringRef ref_from_array(char* p_c, size_t, size_t);
 StringRef ref_from_string(String*, size_t, size_t);
 char *array_from_ref(StringRef);
+char *array_from_ref_arena(Arena*, StringRef);
 
 void free_string(String*);
 void print_string(String*);
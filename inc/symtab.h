@@ -0,0 +1,37 @@
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "dict.h"
+#include "intern.h"
+
+#define UNBOUND UINT64_MAX
+
+// One change to a binding, undone when its scope is left
+typedef struct {
+    uint32_t symbol;
+    uint64_t previous;
+} ScopeEntry;
+
+// The current binding of every interned symbol, indexed by symbol id. Scopes are marks in the log of bindings
+// made, so leaving one restores the bindings made since without hashing or removing any names.
+typedef struct {
+    uint64_t *bindings;
+    size_t capacity;
+    ScopeEntry *log;
+    size_t log_size;
+    size_t log_capacity;
+} SymbolTable;
+
+SymbolTable *symtab_create();
+void symtab_free(SymbolTable*);
+int symtab_find(SymbolTable*, uint32_t, uint64_t*);
+int symtab_declare(SymbolTable*, uint32_t, uint64_t, uint64_t*);
+void symtab_bind(SymbolTable*, uint32_t, uint64_t);
+size_t symtab_mark(SymbolTable*);
+void symtab_leave(SymbolTable*, size_t);
+Dict *symtab_export(SymbolTable*);
+
+#endif // SYMTAB_H
@@ -7,10 +7,36 @@
 #include "vector.h"
 #include "vecs.h"
 #include "dict.h"
+#include "symtab.h"
 #include "error.h"
 
+#define PREDEF_MAX 32
+#define PREDEF_NODES 64
+#define PREDEF_ITEMS 64
+#define PREDEF_TYPES 7
+#define LINK_TYPE 1
+#define LINK_LIST 2
+
+// What the last check of a top-level command read and declared. The items, which start at an offset into one
+// pool shared by all records, hold the symbols read, then the nodes of the declarations still in scope after the
+// command, then their symbols.
+typedef struct {
+    uint32_t cmd;
+    uint32_t failed;
+    uint32_t read_count;
+    uint32_t decl_count;
+    uint32_t items;
+} CheckRecord;
+
 void generate_predefs(NodeVec*);
+void init_predefs();
+void load_predefs(NodeVec*);
 int type_check(TokenVec*, NodeVec*, Vector*);
+int type_check_update(TokenVec*, NodeVec*, Vector*);
+int lookup_declaration(uint32_t, uint64_t*);
+void type_check_cleanup();
+Dict *get_declarations();
+void set_declarations(Dict*);
 
 int type_check_cmd(uint32_t);
 int type_check_read_cmd(uint32_t);
@@ -40,6 +66,4 @@ int compare_types(uint32_t, uint32_t);
 int expect_type(TypeType, uint32_t);
 void type_error(TypeErrorType, uint32_t, uint32_t);
 
-void remove_lvalue(uint32_t);
-
 #endif // TYPECHECK_H
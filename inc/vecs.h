@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 
 #include "token.h"
 #include "stringops.h"
@@ -14,8 +15,15 @@ typedef struct {
     size_t capacity;
 } CVec;
 
+// Tokens are stored as parallel arrays of kinds, source offsets and lengths. A token's text starts at
+// 'source' plus its offset, which is also its location. Offsets are 32 bits, so no source may be larger.
+#define MAX_SOURCE_SIZE UINT32_MAX
+
 typedef struct {
-    Token *array;
+    uint8_t *kinds;
+    uint32_t *offsets;
+    uint32_t *lengths;
+    char *source;
     size_t size;
     size_t capacity;
 } TokenVec;
@@ -26,6 +34,13 @@ typedef struct {
     size_t capacity;
 } NodeVec;
 
+// Node and token indices, used in place rather than allocated, so that a zeroed one is empty
+typedef struct {
+    uint32_t *array;
+    size_t size;
+    size_t capacity;
+} U32Vec;
+
 CVec *cvec_create_cap(size_t);
 CVec *cvec_create();
 void cvec_expand(CVec*);
@@ -35,19 +50,28 @@ void cvec_append_ref(CVec*, StringRef);
 void cvec_append_array(CVec*, const char*, size_t);
 void cvec_append_ref_line(CVec*, StringRef);
 void cvec_append_array_line(CVec*, const char*, size_t);
+void cvec_append_format(CVec*, const char*, ...);
 size_t cvec_size(CVec*);
 void cvec_clear(CVec*);
 void cvec_print(CVec*);
+void cvec_write(CVec*, FILE*);
+void cvec_flush(CVec*, FILE*);
 void cvec_destroy(CVec*);
 int cvec_is_empty(CVec*);
 
-TokenVec *tokenvec_create_cap(size_t);
-TokenVec *tokenvec_create();
+TokenVec *tokenvec_create_cap(char*, size_t);
+TokenVec *tokenvec_create(char*);
+TokenVec *tokenvec_view(char*, uint8_t*, uint32_t*, uint32_t*, size_t);
 void tokenvec_expand(TokenVec*);
 void tokenvec_shrink(TokenVec*);
 void tokenvec_append(TokenVec*, Token);
-Token *tokenvec_get(TokenVec*, size_t);
-Token *tokenvec_peek_last(TokenVec*);
+void tokenvec_extend(TokenVec*, TokenVec*, size_t);
+void tokenvec_splice(TokenVec*, size_t, size_t, TokenVec*, size_t, int64_t);
+Token *tokenvec_get(TokenVec*, size_t, Token*);
+TokenType tokenvec_kind(TokenVec*, size_t);
+StringRef tokenvec_string(TokenVec*, size_t);
+StringRef tokenvec_text(TokenVec*, AstNode*);
+TokenType tokenvec_last_kind(TokenVec*);
 size_t tokenvec_size(TokenVec*);
 void tokenvec_clear(TokenVec*);
 void tokenvec_destroy(TokenVec*);
@@ -66,4 +90,9 @@ void nodevec_clear(NodeVec*);
 void nodevec_destroy(NodeVec*);
 int nodevec_is_empty(NodeVec*);
 
+void *array_grow(void*, size_t*, size_t, size_t);
+void u32vec_append(U32Vec*, uint32_t);
+uint32_t u32vec_pop_last(U32Vec*);
+void u32vec_release(U32Vec*);
+
 #endif // VECS_H
@@ -3,14 +3,18 @@
 
 #include <stdlib.h>
 
+#include "arena.h"
+
 typedef struct {
     void **array;
     size_t size;
     size_t capacity;
+    Arena *arena;
 } Vector;
 
 Vector *vector_create_cap(size_t);
 Vector *vector_create();
+Vector *vector_create_arena(Arena*, size_t);
 void vector_expand(Vector*);
 void vector_shrink(Vector*);
 void vector_insert(Vector*, size_t, void*);
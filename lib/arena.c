@@ -0,0 +1,111 @@
+#include <string.h>
+
+#include "arena.h"
+
+#define ALIGN_UP(n) (((n) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+
+static _Thread_local Arena *compile;
+
+static ArenaChunk *chunk_create(size_t capacity) {
+    ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + capacity);
+    if (!chunk) return NULL;
+
+    chunk->next = NULL;
+    chunk->used = 0;
+    chunk->capacity = capacity;
+    chunk->data = (char *) chunk + ALIGN_UP(sizeof(ArenaChunk));
+    chunk->capacity -= ALIGN_UP(sizeof(ArenaChunk)) - sizeof(ArenaChunk);
+    return chunk;
+}
+
+Arena *arena_create(size_t chunk_size) {
+    Arena *arena = malloc(sizeof(Arena));
+    if (!arena) return NULL;
+
+    arena->chunk_size = chunk_size ? chunk_size : ARENA_CHUNK;
+    arena->head = chunk_create(arena->chunk_size);
+    if (!arena->head) {
+        free(arena);
+        return NULL;
+    }
+
+    return arena;
+}
+
+// Requests larger than a chunk get a chunk of their own
+void *arena_alloc(Arena *arena, size_t size) {
+    if (!arena) return NULL;
+
+    size = ALIGN_UP(size ? size : 1);
+    ArenaChunk *chunk = arena->head;
+    if (chunk->used + size > chunk->capacity) {
+        size_t capacity = size + ARENA_ALIGN > arena->chunk_size ? size + ARENA_ALIGN : arena->chunk_size;
+        chunk = chunk_create(capacity);
+        if (!chunk) exit(EXIT_FAILURE);
+
+        chunk->next = arena->head;
+        arena->head = chunk;
+    }
+
+    void *pointer = chunk->data + chunk->used;
+    chunk->used += size;
+    return pointer;
+}
+
+// Grows the last allocation in place when there is room, otherwise copies it into a new block
+void *arena_resize(Arena *arena, void *pointer, size_t old_size, size_t new_size) {
+    if (!arena) return NULL;
+    if (!pointer) return arena_alloc(arena, new_size);
+
+    ArenaChunk *chunk = arena->head;
+    old_size = ALIGN_UP(old_size);
+    if ((char *) pointer + old_size == chunk->data + chunk->used) {
+        size_t start = (char *) pointer - chunk->data;
+        if (start + ALIGN_UP(new_size) <= chunk->capacity) {
+            chunk->used = start + ALIGN_UP(new_size);
+            return pointer;
+        }
+    }
+    if (new_size <= old_size) return pointer;
+
+    void *moved = arena_alloc(arena, new_size);
+    memcpy(moved, pointer, old_size);
+    return moved;
+}
+
+// Keeps the first chunk for reuse and frees the rest
+void arena_reset(Arena *arena) {
+    if (!arena) return;
+
+    ArenaChunk *chunk = arena->head;
+    while (chunk->next) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    chunk->used = 0;
+    arena->head = chunk;
+}
+
+void arena_destroy(Arena *arena) {
+    if (!arena) return;
+
+    arena_reset(arena);
+    free(arena->head);
+    free(arena);
+}
+
+// The arena that holds scratch data and containers for the compilation in progress on the calling thread
+Arena *compile_arena() {
+    if (!compile) compile = arena_create(ARENA_CHUNK);
+    if (!compile) exit(EXIT_FAILURE);
+
+    return compile;
+}
+
+// Frees the calling thread's compilation arena. Threads that compile must call this before they exit.
+void compile_arena_cleanup() {
+    arena_destroy(compile);
+    compile = NULL;
+}
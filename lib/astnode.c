@@ -1,6 +1,7 @@
 #include "astnode.h"
+#include "intern.h"
 
-AstNode create_node(uint32_t token_index, uint32_t type, uint32_t node1, uint32_t node2, uint32_t node3, uint32_t node4, StringRef string) {
+AstNode create_node(uint32_t token_index, uint32_t type, uint32_t node1, uint32_t node2, uint32_t node3, uint32_t node4) {
     return (AstNode) {
         token_index,
         {type},
@@ -8,10 +9,75 @@ AstNode create_node(uint32_t token_index, uint32_t type, uint32_t node1, uint32_
         {node2},
         {node3},
         {node4},
-        string
+        NO_SYMBOL
     };
 }
 
 AstNode get_empty_node() {
-    return (AstNode) {0, {0}, {0}, {0}, {0}, {0}, {0, 0}};
+    return (AstNode) {0, {0}, {0}, {0}, {0}, {0}, 0};
+}
+
+// Every child list lives in one flat array as a count followed by its items.
+// Slot 0 is left unused so that a zero ChildList can stand for "no list". Each thread has a pool of its own.
+static _Thread_local uint32_t *child_pool;
+static _Thread_local size_t pool_size;
+static _Thread_local size_t pool_capacity;
+
+ChildList childlist_create(uint32_t *items, size_t count) {
+    if (!child_pool) pool_size = 1;
+
+    if (pool_size + count + 1 > pool_capacity) {
+        size_t capacity = pool_capacity ? pool_capacity : 1024;
+        while (pool_size + count + 1 > capacity) capacity *= 2;
+
+        uint32_t *temp = realloc(child_pool, sizeof(uint32_t) * capacity);
+        if (!temp) exit(EXIT_FAILURE);
+        child_pool = temp;
+        pool_capacity = capacity;
+    }
+
+    ChildList list = pool_size;
+    child_pool[pool_size++] = count;
+    if (count) memcpy(child_pool + pool_size, items, sizeof(uint32_t) * count);
+    pool_size += count;
+
+    return list;
+}
+
+uint32_t childlist_size(ChildList list) {
+    if (!list) return 0;
+
+    return child_pool[list];
+}
+
+uint32_t childlist_get(ChildList list, size_t index) {
+    if (!list || index >= child_pool[list]) return 0;
+
+    return child_pool[list + 1 + index];
+}
+
+// The pool as it stands, so that a compilation can be saved with its lists at the same offsets
+uint32_t *childlist_pool(size_t *size) {
+    *size = pool_size;
+    return child_pool;
+}
+
+// Replaces the pool with a copy of a saved one
+void childlist_load(uint32_t *items, size_t size) {
+    childlist_reset();
+    if (!size) return;
+
+    child_pool = malloc(sizeof(uint32_t) * size);
+    if (!child_pool) exit(EXIT_FAILURE);
+    memcpy(child_pool, items, sizeof(uint32_t) * size);
+    pool_size = size;
+    pool_capacity = size;
+}
+
+// Drops every list in the calling thread's pool
+void childlist_reset() {
+    free(child_pool);
+    child_pool = NULL;
+    pool_size = 0;
+    pool_capacity = 0;
 }
@@ -2,83 +2,147 @@
 #include "dict.h"
 
 #define SEED 0x9747b28c
-#define MAX_LOAD_FACTOR 0.75
 
-Dict *dict_create_big() {
-    Dict* dict = (Dict*) malloc(sizeof(Dict));
-    if (!dict) return NULL;
+// Keeps live and deleted slots to at most three quarters of the table, so every probe meets an empty slot
+#define OVER_LOAD(dict, count) (((count) << 2) > (dict)->capacity * 3)
 
-    dict->array = (Node*) calloc(BIG_SIZE, sizeof(Node));
-    if (!dict->array) {
-        free(dict);
-        return NULL;
-    }
+#define CONTROL_TAG(hash) (DICT_FULL | ((hash) >> 25))
 
-    dict->capacity = BIG_SIZE;
-    dict->size = 0;
-    return dict;
+Dict *dict_create_big() {
+    return dict_create_cap(BIG_SIZE);
 }
 Dict *dict_create_small() {
-    Dict* dict = (Dict*) malloc(sizeof(Dict));
-    if (!dict) return NULL;
-
-    dict->array = (Node*) calloc(SMALL_SIZE, sizeof(Node));
-    if (!dict->array) {
-        free(dict);
-        return NULL;
-    }
-
-    dict->capacity = SMALL_SIZE;
-    dict->size = 0;
-    return dict;
+    return dict_create_cap(SMALL_SIZE);
 }
+// Makes a dictionary with room for 'capacity' slots, rounded up to a power of two
 Dict *dict_create_cap(size_t capacity) {
     Dict* dict = (Dict*) malloc(sizeof(Dict));
     if (!dict) return NULL;
 
-    dict->array = (Node*) calloc(capacity, sizeof(Node));
-    if (!dict->array) {
+    size_t cap = 16;
+    while (cap < capacity) cap <<= 1;
+
+    dict->control = (uint8_t*) calloc(cap, sizeof(uint8_t));
+    dict->array = (Node*) malloc(cap * sizeof(Node));
+    if (!dict->control || !dict->array) {
+        free(dict->control);
+        free(dict->array);
         free(dict);
         return NULL;
     }
 
-    dict->capacity = BIG_SIZE;
+    dict->capacity = cap;
     dict->size = 0;
+    dict->deleted = 0;
     return dict;
 }
 void dict_free(Dict *dict) {
     if (!dict) return;
 
+    free(dict->control);
     free(dict->array);
     free(dict);
 }
 
+// Moves every live entry into a fresh table of 'capacity' slots, dropping the deleted ones
+static void dict_rehash(Dict *dict, size_t capacity) {
+    uint8_t *new_control = (uint8_t*) calloc(capacity, sizeof(uint8_t));
+    Node *new_array = (Node*) malloc(capacity * sizeof(Node));
+    if (!new_control || !new_array) {
+        free(new_control);
+        free(new_array);
+        return;
+    }
+
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < dict->capacity; ++i) {
+        if (!(dict->control[i] & DICT_FULL)) continue;
+
+        Node *node = &dict->array[i];
+        size_t index = node->hash & mask;
+        while (new_control[index] != DICT_EMPTY)
+            index = (index + 1) & mask;
+        new_control[index] = dict->control[i];
+        new_array[index] = *node;
+    }
+
+    free(dict->control);
+    free(dict->array);
+    dict->control = new_control;
+    dict->array = new_array;
+    dict->capacity = capacity;
+    dict->deleted = 0;
+}
+
 void dict_expand(Dict *dict) {
     if (!dict) return;
 
-    size_t old_cap = dict->capacity;
-    size_t old_size = dict->size;
-    Node *old_array = dict->array;
+    dict_rehash(dict, dict->capacity << 1);
+}
+
+// Makes room for one more entry. Deleted slots are cleared out in place when they make up most of the load.
+static void dict_reserve(Dict *dict) {
+    if (!OVER_LOAD(dict, dict->size + dict->deleted + 1)) return;
+
+    if (OVER_LOAD(dict, (dict->size + 1) << 1))
+        dict_expand(dict);
+    else
+        dict_rehash(dict, dict->capacity);
+}
+
+// Probes for 'key'. Returns 1 with its slot in *slot if it is present, or 0 with the slot it would be added
+// at: the first deleted slot on the way, or else the empty slot that ended the probe.
+static int dict_find(Dict *dict, char *key, size_t len, uint32_t hash, size_t *slot) {
+    size_t mask = dict->capacity - 1;
+    size_t index = hash & mask;
+    uint8_t tag = CONTROL_TAG(hash);
+    int has_deleted = 0;
+
+    while (1) {
+        uint8_t control = dict->control[index];
+        if (control == DICT_EMPTY) {
+            if (!has_deleted) *slot = index;
+            return 0;
+        }
+
+        if (control == tag) {
+            Node *node = &dict->array[index];
+            if (node->hash == hash && node->key.length == len && !memcmp(node->key.string, key, len)) {
+                *slot = index;
+                return 1;
+            }
+        }
+        else if (control == DICT_DELETED && !has_deleted) {
+            has_deleted = 1;
+            *slot = index;
+        }
+
+        index = (index + 1) & mask;
+    }
+}
 
-    size_t new_cap = ((old_cap + 1) << 2) - 1;
-    size_t new_size = 0;
-    Node *new_array = (Node*) calloc(new_cap, sizeof(Node));
-    if (!new_array) return;
+// Fills the free 'slot' dict_find gave for a new key
+static void dict_fill(Dict *dict, size_t slot, StringRef key, uint32_t hash, void *value) {
+    if (dict->control[slot] == DICT_DELETED) --dict->deleted;
+    dict->control[slot] = CONTROL_TAG(hash);
+    dict->array[slot] = (Node) { hash, key, value };
+    ++dict->size;
+}
 
-    *dict = (Dict) {new_size, new_cap, new_array};
+// Steps through the entries in no particular order. Start with *cursor at 0; returns 0 once there are no more.
+int dict_next(Dict *dict, size_t *cursor, StringRef *key, void **value) {
+    if (!dict || !cursor) return 0;
 
-    Node *node;
-    size_t count = 0;
-    for (size_t i = 0; i < old_cap; ++i) {
-        node = &old_array[i];
-        if (!node->_node || node->_tombstone) continue;
+    while (*cursor < dict->capacity) {
+        size_t index = (*cursor)++;
+        if (!(dict->control[index] & DICT_FULL)) continue;
 
-        dict_add_ref(dict, node->key, node->value);
-        ++count;
-        if (count == old_size) break;
+        *key = dict->array[index].key;
+        *value = dict->array[index].value;
+        return 1;
     }
 
-    free(old_array);
+    return 0;
 }
 
 int dict_try_string(Dict *dict, String key, void **value) {
@@ -94,31 +158,12 @@ int dict_try_ref(Dict *dict, StringRef key, void **value) {
 int dict_try_array(Dict *dict, char *key, size_t len, void **value) {
     if (!dict || !key || !len) return 0;
 
-    uint32_t hash = hash_string(key, len, SEED);
-
-    size_t base_index = hash % dict->capacity;
-    size_t index;
-    Node node;
-    for (size_t i = 0; i < dict->capacity; ++i) {
-        index = (base_index + i*i) % dict->capacity;
-        node = dict->array[index];
-
-        // No matching node
-        if (!node._node) break;
-
-        // Check if node matches key
-        if (node.key.length != len) continue;
-        if (strncmp(key, node.key.string, len)) continue;
-
-        // If node is not tombstoned then node matches
-        if (node._tombstone) break;
+    size_t slot;
+    if (!dict_find(dict, key, len, hash_string(key, len, SEED), &slot)) return 0;
 
-        if (value != NULL)
-            *value = node.value;
-        return 1;
-    }
-
-    return 0;
+    if (value != NULL)
+        *value = dict->array[slot].value;
+    return 1;
 }
 
 // Adds value to dictionary if key is not associated with another value. Returns 1 on success, 0 on failure.
@@ -133,46 +178,17 @@ int dict_add_ref_if_empty(Dict *dict, StringRef key, void *value, void **output)
     if (!dict || !key.string || !key.length) return 0;
 
     uint32_t hash = hash_string(key.string, key.length, SEED);
-    size_t base_index = hash % dict->capacity;
-    size_t index = 0;
-    size_t tomb_index = 0;
-    size_t tomb_flag = 0;
-    Node *node;
-    for (size_t i = 0; i < dict->capacity; ++i) {
-        index = (base_index + i*i) % dict->capacity;
-        node = &dict->array[index];
-
-        if (tomb_flag) index = tomb_index;
-
-        // No matches
-        if (!node->_node) {
-            ++dict->size;
-            dict->array[index] = (Node) { 1, 0, key, value };
-            break;
-        }
-
-        // Store first available tombstone node
-        if (node->_tombstone && !tomb_flag) {
-            tomb_flag = 1;
-            tomb_index = index;
-        }
-
-        // Check if keys match
-        if (node->key.length != key.length) continue;
-        if (strncmp(node->key.string, key.string, key.length)) continue;
-
-        // Keys must match - If not a tombstone then is an active node
-        if (!node->_tombstone) {
-            *output = node->value;
-            return 0;
-        }
-        ++dict->size;
-        dict->array[index] = (Node) { 1, 0, key, value };
-        break;
+    size_t slot;
+    if (dict_find(dict, key.string, key.length, hash, &slot)) {
+        *output = dict->array[slot].value;
+        return 0;
     }
 
-    double alpha = ((double) dict->size) / ((double) dict->capacity);
-    if (alpha > MAX_LOAD_FACTOR) dict_expand(dict);
+    if (OVER_LOAD(dict, dict->size + dict->deleted + 1)) {
+        dict_reserve(dict);
+        dict_find(dict, key.string, key.length, hash, &slot);
+    }
+    dict_fill(dict, slot, key, hash, value);
     return 1;
 }
 
@@ -190,48 +206,19 @@ void *dict_add_ref(Dict *dict, StringRef key, void *value) {
     if (!dict || !key.string || !key.length) return NULL;
 
     uint32_t hash = hash_string(key.string, key.length, SEED);
-    size_t base_index = hash % dict->capacity;
-    size_t tomb_index = 0;
-    size_t tomb_flag = 0;
-    size_t index;
-    Node *node;
-    void *ret_value = NULL;
-
-    for (size_t i = 0; i < dict->capacity; ++i) {
-        index = (base_index + i*i) % dict->capacity;
-        node = &dict->array[index];
-
-        if (tomb_flag) index = tomb_index;
-
-        // No match
-        if (!node->_node) {
-            ++dict->size;
-            dict->array[index] = (Node) { 1, 0, key, value };
-            ret_value = NULL;
-            break;
-        }
-
-        if (node->_tombstone && !tomb_flag) {
-            tomb_flag = 1;
-            tomb_index = index;
-        }
-
-        if (node->key.length != key.length) continue;
-        if (strncmp(key.string, node->key.string, key.length)) continue;
-
-        if (node->_tombstone) 
-            ++dict->size;
-        else
-            ret_value = node->value;
-
-        dict->array[index] = (Node) {1, 0, key, value};
-        break;
+    size_t slot;
+    if (dict_find(dict, key.string, key.length, hash, &slot)) {
+        void *ret_value = dict->array[slot].value;
+        dict->array[slot] = (Node) { hash, key, value };
+        return ret_value;
     }
 
-    double alpha = ((double) dict->size) / ((double) dict->capacity);
-    if (alpha > MAX_LOAD_FACTOR) dict_expand(dict);
-
-    return ret_value;
+    if (OVER_LOAD(dict, dict->size + dict->deleted + 1)) {
+        dict_reserve(dict);
+        dict_find(dict, key.string, key.length, hash, &slot);
+    }
+    dict_fill(dict, slot, key, hash, value);
+    return NULL;
 }
 
 void *dict_add_array(Dict *dict, char *key, size_t len, void *value) {
@@ -245,26 +232,20 @@ void *dict_remove_string(Dict *dict, String key) {
 void *dict_remove_ref(Dict *dict, StringRef key) {
     if (!dict || !key.string || !key.length) return NULL;
 
-    uint32_t hash = hash_string(key.string, key.length, SEED);
-    size_t base_index = hash % dict->capacity;
-    size_t index;
-    Node *node;
+    size_t slot;
+    if (!dict_find(dict, key.string, key.length, hash_string(key.string, key.length, SEED), &slot)) return NULL;
 
-    for (size_t i = 0; i < dict->capacity; ++i) {
-        index = (base_index + i*i) % dict->capacity;
-        node = &dict->array[index];
-       
-        if (!node->_node) break;
-        if (node->key.length != key.length) continue;
-        if (strncmp(node->key.string, key.string, key.length)) continue;
-        if (node->_tombstone) break;
-
-        node->_tombstone = 1;
-        --dict->size;
-        return node->value;
+    // A slot followed by an empty one ends no probe, so it can be emptied outright
+    size_t next = (slot + 1) & (dict->capacity - 1);
+    if (dict->control[next] == DICT_EMPTY) {
+        dict->control[slot] = DICT_EMPTY;
     }
-
-    return NULL;
+    else {
+        dict->control[slot] = DICT_DELETED;
+        ++dict->deleted;
+    }
+    --dict->size;
+    return dict->array[slot].value;
 }
 void *dict_remove_array(Dict *dict, char *key, size_t len) {
     return dict_remove_ref(dict, (StringRef) {len, key});
@@ -309,3 +290,65 @@ uint32_t hash_string(char* key, size_t len, uint32_t seed)
 	h ^= h >> 16;
 	return h;
 }
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// MurmurHash3 x64_128, for keys that must not collide in practice (the 32-bit hash is only fit for tables)
+void hash_string_128(char *key, size_t len, uint64_t seed, uint64_t out[2]) {
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+    uint64_t h1 = seed;
+    uint64_t h2 = seed;
+    uint64_t k1, k2;
+
+    /* Read in groups of 16. */
+    for (size_t i = len >> 4; i; i--) {
+        memcpy(&k1, key, sizeof(uint64_t));
+        memcpy(&k2, key + sizeof(uint64_t), sizeof(uint64_t));
+        key += 2 * sizeof(uint64_t);
+
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    /* Read the rest. */
+    k1 = 0;
+    k2 = 0;
+    size_t rest = len & 15;
+    for (size_t i = rest; i > 8; i--)
+        k2 = (k2 << 8) | (uint8_t) key[i - 1];
+    for (size_t i = rest < 8 ? rest : 8; i; i--)
+        k1 = (k1 << 8) | (uint8_t) key[i - 1];
+    if (rest > 8) {
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    }
+    if (rest) {
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    /* Finalize. */
+    h1 ^= len;
+    h2 ^= len;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+
+    out[0] = h1;
+    out[1] = h2;
+}
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include "intern.h"
+#include "dict.h"
+#include "arena.h"
+#include "vecs.h"
+
+#define NAMES_DEFAULT 256
+
+// The identifiers of the compilation in progress on this thread. Each distinct name gets the next symbol id,
+// counting from 1 so that a zeroed node has none. Names are copied into the compilation arena, since a
+// document replaces its source on every edit.
+static _Thread_local Dict *interned;
+static _Thread_local StringRef *names;
+static _Thread_local size_t name_count;
+static _Thread_local size_t name_capacity;
+
+// Returns the symbol id of the name, interning it the first time it is seen
+uint32_t intern_ref(StringRef name) {
+    if (!name.string || !name.length) return NO_SYMBOL;
+
+    void *symbol;
+    if (interned && dict_try_ref(interned, name, &symbol)) return (uint64_t) symbol;
+
+    if (!interned) interned = dict_create_big();
+    if (!interned) exit(EXIT_FAILURE);
+    if (name_count + 1 >= name_capacity)
+        names = array_grow(names, &name_capacity, sizeof(StringRef), NAMES_DEFAULT);
+
+    char *copy = arena_alloc(compile_arena(), name.length);
+    memcpy(copy, name.string, name.length);
+    names[++name_count] = (StringRef) {name.length, copy};
+    dict_add_ref(interned, names[name_count], (void*) (uint64_t) name_count);
+    return name_count;
+}
+
+// Finds the symbol id of a name without interning it. Returns 1 on success.
+int intern_find(StringRef name, uint32_t *output) {
+    void *symbol;
+    if (!interned || !dict_try_ref(interned, name, &symbol)) return 0;
+
+    *output = (uint64_t) symbol;
+    return 1;
+}
+
+StringRef symbol_name(uint32_t symbol) {
+    if (symbol == NO_SYMBOL || symbol > name_count) return (StringRef) {0, NULL};
+    return names[symbol];
+}
+
+// The largest symbol id handed out so far
+uint32_t symbol_count() {
+    return name_count;
+}
+
+// Forgets every name. Their copies go with the next reset of the compilation arena.
+void intern_reset() {
+    dict_free(interned);
+    free(names);
+    interned = NULL;
+    names = NULL;
+    name_count = 0;
+    name_capacity = 0;
+}
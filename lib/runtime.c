@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <png.h>
+
+#include "runtime.h"
+
+#define CHANNELS 4
+#define CHANNEL_MAX 255.0
+
+void jpl_fail(const char *message) {
+    fflush(stdout);
+    fprintf(stderr, "[abort] %s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+void jpl_fail_assertion(const char *message) {
+    fflush(stdout);
+    fprintf(stderr, "[abort] Assertion failed: %s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+void *jpl_alloc(size_t size) {
+    void *data = malloc(size ? size : 1);
+    if (!data) jpl_fail("Out of memory");
+    return data;
+}
+
+// Parses the command line into the 'args' array. Returns the array data and stores its length in size.
+int64_t *jpl_args(int argc, char **argv, int64_t *size) {
+    int64_t count = argc > 1 ? argc - 1 : 0;
+    int64_t *data = jpl_alloc(sizeof(int64_t) * count);
+
+    char *end;
+    for (int64_t i = 0; i < count; ++i) {
+        errno = 0;
+        data[i] = strtoll(argv[i + 1], &end, 10);
+        if (errno == ERANGE || *end != '\0' || end == argv[i + 1])
+            jpl_fail("Command line arguments must be integers");
+    }
+
+    *size = count;
+    return data;
+}
+
+void jpl_print(const char *string) {
+    puts(string);
+}
+
+void jpl_show_int(int64_t value) {
+    printf("%ld", value);
+}
+
+void jpl_show_float(double value) {
+    printf("%f", value);
+}
+
+void jpl_show_bool(bool value) {
+    fputs(value ? "true" : "false", stdout);
+}
+
+void jpl_show_void(jpl_void value) {
+    (void) value;
+    fputs("void", stdout);
+}
+
+// Returns the size in bytes of the value a type descriptor describes, and moves the descriptor past it.
+static size_t descriptor_size(const char **type) {
+    size_t size;
+    switch (*(*type)++) {
+        case 'a':
+            size = (strtol(*type, (char**) type, 10) + 1) * sizeof(int64_t);
+            descriptor_size(type);
+            return size;
+        case 's':
+            size = 0;
+            while (*(*type)++ != '(');
+            while (**type != ')')
+                size += descriptor_size(type);
+            ++*type;
+            return size;
+        default:
+            return sizeof(int64_t);
+    }
+}
+
+static void show_words(const char **type, const int64_t *value);
+
+static void show_elements(const char *element, size_t size, int64_t rank, const int64_t *dims, const char **data) {
+    fputs("[", stdout);
+    for (int64_t i = 0; i < dims[0]; ++i) {
+        if (i) fputs(", ", stdout);
+        if (rank > 1)
+            show_elements(element, size, rank - 1, dims + 1, data);
+        else {
+            const char *type = element;
+            show_words(&type, (const int64_t*) *data);
+            *data += size;
+        }
+    }
+    fputs("]", stdout);
+}
+
+static void show_words(const char **type, const int64_t *value) {
+    switch (*(*type)++) {
+        case 'i':
+            jpl_show_int(*value);
+            break;
+        case 'f':
+            jpl_show_float(*(const double*) value);
+            break;
+        case 'b':
+            jpl_show_bool(*value);
+            break;
+        case 'v':
+            fputs("void", stdout);
+            break;
+        case 'a': {
+            int64_t rank = strtol(*type, (char**) type, 10);
+            const char *element = *type;
+            size_t size = descriptor_size(type);
+            const char *data = (const char*) value[rank];
+            show_elements(element, size, rank, value, &data);
+            break;
+        }
+        case 's': {
+            const char *name = *type;
+            while (*(*type)++ != '(');
+            printf("%.*s{", (int) (*type - name - 1), name);
+            for (int first = 1; **type != ')'; first = 0) {
+                if (!first) fputs(", ", stdout);
+                const char *member = *type;
+                size_t size = descriptor_size(type);
+                show_words(&member, value);
+                value += size / sizeof(int64_t);
+            }
+            ++*type;
+            fputs("}", stdout);
+            break;
+        }
+    }
+}
+
+void jpl_show(const char *type, const void *value) {
+    show_words(&type, value);
+    putchar('\n');
+}
+
+double jpl_get_time() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+void jpl_print_time(double seconds) {
+    printf("[time] %f ms\n", seconds * 1000.0);
+}
+
+// Reads a png into a freshly allocated rgba array of height x width pixels.
+void *jpl_read_image(const char *file, int64_t *height, int64_t *width) {
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+
+    if (!png_image_begin_read_from_file(&image, file)) {
+        fprintf(stderr, "[abort] Could not read image '%s': %s\n", file, image.message);
+        exit(EXIT_FAILURE);
+    }
+
+    image.format = PNG_FORMAT_RGBA;
+    size_t pixels = (size_t) image.height * image.width;
+    png_bytep buffer = jpl_alloc(PNG_IMAGE_SIZE(image));
+    if (!png_image_finish_read(&image, NULL, buffer, 0, NULL)) {
+        fprintf(stderr, "[abort] Could not read image '%s': %s\n", file, image.message);
+        exit(EXIT_FAILURE);
+    }
+
+    double *data = jpl_alloc(sizeof(double) * CHANNELS * pixels);
+    for (size_t i = 0; i < CHANNELS * pixels; ++i)
+        data[i] = buffer[i] / CHANNEL_MAX;
+
+    free(buffer);
+    *height = image.height;
+    *width = image.width;
+    return data;
+}
+
+// Writes a height x width rgba array as a png. Channels are clamped to [0, 1].
+void jpl_write_image(const void *pixels, int64_t height, int64_t width, const char *file) {
+    const double *data = pixels;
+    size_t count = (size_t) height * width * CHANNELS;
+
+    png_bytep buffer = jpl_alloc(count);
+    for (size_t i = 0; i < count; ++i) {
+        double channel = data[i];
+        if (!(channel > 0.0)) channel = 0.0;
+        if (channel > 1.0) channel = 1.0;
+        buffer[i] = (png_byte) (channel * CHANNEL_MAX + 0.5);
+    }
+
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    image.width = width;
+    image.height = height;
+    image.format = PNG_FORMAT_RGBA;
+
+    if (!png_image_write_to_file(&image, file, 0, buffer, 0, NULL)) {
+        fprintf(stderr, "[abort] Could not write image '%s': %s\n", file, image.message);
+        exit(EXIT_FAILURE);
+    }
+
+    free(buffer);
+}
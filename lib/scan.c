@@ -0,0 +1,99 @@
+#include "scan.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define CHUNK 16
+
+// Each scanner classifies 16 bytes per step with SSE2 and finishes the last partial chunk one byte at a time,
+// so it never reads past end. Bytes are compared as signed chars, matching the lexer, so non-ASCII bytes count
+// as below ' ' and are illegal.
+
+static inline int is_identifier_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static inline int is_illegal_char(char c) {
+    return c < 32 || c == 127;
+}
+
+#ifdef __SSE2__
+// Returns a pointer to the first byte of the chunk whose bit is clear in the mask, or NULL if all are set.
+static inline char *first_clear(char *chunk, int mask) {
+    if (mask == 0xFFFF) return NULL;
+    return chunk + __builtin_ctz(~mask);
+}
+
+static inline __m128i in_range(__m128i chunk, char low, char high) {
+    return _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8(low - 1)), _mm_cmplt_epi8(chunk, _mm_set1_epi8(high + 1)));
+}
+
+static inline __m128i illegal_mask(__m128i chunk) {
+    return _mm_or_si128(_mm_cmplt_epi8(chunk, _mm_set1_epi8(32)), _mm_cmpeq_epi8(chunk, _mm_set1_epi8(127)));
+}
+#endif
+
+char *scan_spaces(char *start, char *end) {
+    char *c_ptr = start;
+#ifdef __SSE2__
+    const __m128i spaces = _mm_set1_epi8(' ');
+    for (; end - c_ptr >= CHUNK; c_ptr += CHUNK) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*) c_ptr);
+        char *stop = first_clear(c_ptr, _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, spaces)));
+        if (stop) return stop;
+    }
+#endif
+    while (c_ptr < end && *c_ptr == ' ')
+        ++c_ptr;
+    return c_ptr;
+}
+
+char *scan_identifier(char *start, char *end) {
+    char *c_ptr = start;
+#ifdef __SSE2__
+    for (; end - c_ptr >= CHUNK; c_ptr += CHUNK) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*) c_ptr);
+        __m128i letters = in_range(_mm_or_si128(chunk, _mm_set1_epi8(0x20)), 'a', 'z');
+        __m128i digits = in_range(chunk, '0', '9');
+        __m128i scores = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_'));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letters, digits), scores));
+        char *stop = first_clear(c_ptr, mask);
+        if (stop) return stop;
+    }
+#endif
+    while (c_ptr < end && is_identifier_char(*c_ptr))
+        ++c_ptr;
+    return c_ptr;
+}
+
+// Stops at the first newline or other illegal byte.
+char *scan_illegal(char *start, char *end) {
+    char *c_ptr = start;
+#ifdef __SSE2__
+    for (; end - c_ptr >= CHUNK; c_ptr += CHUNK) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*) c_ptr);
+        char *stop = first_clear(c_ptr, ~_mm_movemask_epi8(illegal_mask(chunk)) & 0xFFFF);
+        if (stop) return stop;
+    }
+#endif
+    while (c_ptr < end && !is_illegal_char(*c_ptr))
+        ++c_ptr;
+    return c_ptr;
+}
+
+// Stops at the first '*', newline or other illegal byte, the only bytes a block comment has to look at.
+char *scan_comment(char *start, char *end) {
+    char *c_ptr = start;
+#ifdef __SSE2__
+    for (; end - c_ptr >= CHUNK; c_ptr += CHUNK) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*) c_ptr);
+        __m128i stops = _mm_or_si128(illegal_mask(chunk), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('*')));
+        char *stop = first_clear(c_ptr, ~_mm_movemask_epi8(stops) & 0xFFFF);
+        if (stop) return stop;
+    }
+#endif
+    while (c_ptr < end && *c_ptr != '*' && !is_illegal_char(*c_ptr))
+        ++c_ptr;
+    return c_ptr;
+}
@@ -92,6 +92,16 @@ char *array_from_ref(StringRef strref) {
     return string;
 }
 
+// Copies the reference into the arena as a terminated string. A NULL reference gives an empty string.
+char *array_from_ref_arena(Arena *arena, StringRef strref) {
+    size_t length = strref.string ? strref.length : 0;
+    char *string = arena_alloc(arena, length + 1); if (!string) return NULL;
+
+    if (length) memcpy(string, strref.string, length);
+    string[length] = '\0';
+    return string;
+}
+
 void free_string(String *string) {
     free(string->string);
 }
@@ -114,10 +124,10 @@ int string_ref_cmp(StringRef string1, StringRef string2) {
 }
 
 int ref_array_cmp(StringRef string1, char* string2) {
-    if (!string2) return 0;
+    if (!string2) return 1;
 
     size_t len = strlen(string2);
-    if (len != string1.length) return 0;
+    if (len != string1.length) return 1;
 
     return strncmp(string1.string, string2, len);
 }
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include "symtab.h"
+
+#define SYMBOLS_DEFAULT 256
+#define LOG_DEFAULT 256
+
+SymbolTable *symtab_create() {
+    SymbolTable *table = (SymbolTable*) calloc(1, sizeof(SymbolTable));
+    if (!table) return NULL;
+
+    table->bindings = (uint64_t*) malloc(sizeof(uint64_t) * SYMBOLS_DEFAULT);
+    table->log = (ScopeEntry*) malloc(sizeof(ScopeEntry) * LOG_DEFAULT);
+    if (!table->bindings || !table->log) {
+        symtab_free(table);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < SYMBOLS_DEFAULT; ++i)
+        table->bindings[i] = UNBOUND;
+    table->capacity = SYMBOLS_DEFAULT;
+    table->log_capacity = LOG_DEFAULT;
+    return table;
+}
+
+void symtab_free(SymbolTable *table) {
+    if (!table) return;
+
+    free(table->bindings);
+    free(table->log);
+    free(table);
+}
+
+// Finds what the symbol is bound to in the innermost scope binding it. Returns 1 on success.
+int symtab_find(SymbolTable *table, uint32_t symbol, uint64_t *output) {
+    if (!table || symbol == NO_SYMBOL || symbol >= table->capacity) return 0;
+
+    uint64_t binding = table->bindings[symbol];
+    if (binding == UNBOUND) return 0;
+
+    *output = binding;
+    return 1;
+}
+
+// Binds the symbol in the current scope, whatever it was bound to before
+void symtab_bind(SymbolTable *table, uint32_t symbol, uint64_t value) {
+    if (!table || symbol == NO_SYMBOL || symbol == NUMBER_SYMBOL) return;
+
+    if (symbol >= table->capacity) {
+        size_t capacity = table->capacity * 2;
+        while (capacity <= symbol) capacity *= 2;
+        uint64_t *bindings = realloc(table->bindings, sizeof(uint64_t) * capacity);
+        if (!bindings) exit(EXIT_FAILURE);
+        for (size_t i = table->capacity; i < capacity; ++i)
+            bindings[i] = UNBOUND;
+        table->bindings = bindings;
+        table->capacity = capacity;
+    }
+
+    if (table->log_size == table->log_capacity) {
+        size_t capacity = table->log_capacity * 2;
+        ScopeEntry *log = realloc(table->log, sizeof(ScopeEntry) * capacity);
+        if (!log) exit(EXIT_FAILURE);
+        table->log = log;
+        table->log_capacity = capacity;
+    }
+
+    table->log[table->log_size++] = (ScopeEntry) { symbol, table->bindings[symbol] };
+    table->bindings[symbol] = value;
+}
+
+// Binds the symbol in the current scope if it is not bound in any. Returns 1 on success, 0 on failure.
+// On failure, the existing binding is returned in output. Nodes left without a symbol by a failed parse can
+// never be looked up, so declaring one, or a number it was mistaken for, binds nothing and succeeds.
+int symtab_declare(SymbolTable *table, uint32_t symbol, uint64_t value, uint64_t *output) {
+    if (!table) return 0;
+    if (symbol == NO_SYMBOL || symbol == NUMBER_SYMBOL) return 1;
+    if (symtab_find(table, symbol, output)) return 0;
+
+    symtab_bind(table, symbol, value);
+    return 1;
+}
+
+// Opens a scope, returning the mark to leave it by
+size_t symtab_mark(SymbolTable *table) {
+    return table->log_size;
+}
+
+// Undoes every binding made since the mark, newest first
+void symtab_leave(SymbolTable *table, size_t mark) {
+    while (table->log_size > mark) {
+        ScopeEntry *entry = &table->log[--table->log_size];
+        table->bindings[entry->symbol] = entry->previous;
+    }
+}
+
+// Copies every name bound at the moment into a new dictionary
+Dict *symtab_export(SymbolTable *table) {
+    if (!table) return NULL;
+
+    Dict *dict = dict_create_big();
+    if (!dict) return NULL;
+
+    for (size_t i = 1; i < table->capacity; ++i)
+        if (table->bindings[i] != UNBOUND)
+            dict_add_ref(dict, symbol_name(i), (void*) table->bindings[i]);
+    return dict;
+}
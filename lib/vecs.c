@@ -1,3 +1,5 @@
+#include <stdarg.h>
+
 #include "vecs.h"
 
 #define VECTOR_SIZE (vector->size)
@@ -75,6 +77,25 @@ void cvec_append_array_line(CVec *vector, const char *string, size_t len) {
     cvec_append(vector, '\n');
 }
 
+void cvec_append_format(CVec *vector, const char *format, ...) {
+    if (!vector || !format) return;
+
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (len < 0) return;
+
+    while (VECTOR_SIZE + len + 1 > VECTOR_CAPACITY) {
+        cvec_expand(vector);
+    }
+
+    va_start(args, format);
+    vsnprintf(&VECTOR_ARRAY[VECTOR_SIZE], len + 1, format, args);
+    va_end(args);
+    VECTOR_SIZE += len;
+}
+
 char cvec_pop_last(CVec *vector) {
     if (!vector) return '\0';
     if VECTOR_IS_EMPTY return '\0';
@@ -109,11 +130,23 @@ void cvec_clear(CVec *vector) {
 }
 
 void cvec_print(CVec *vector) {
-    if (!vector) return;
+    cvec_write(vector, stdout);
+}
+
+void cvec_write(CVec *vector, FILE *stream) {
+    if (!vector || !stream) return;
 
     cvec_append(vector, '\0');
 
-    fputs(vector->array, stdout);
+    fputs(vector->array, stream);
+}
+
+// Writes out what the vector holds and empties it, keeping its capacity
+void cvec_flush(CVec *vector, FILE *stream) {
+    if (!vector || !stream) return;
+
+    fwrite(VECTOR_ARRAY, 1, VECTOR_SIZE, stream);
+    VECTOR_SIZE = 0;
 }
 
 void cvec_destroy(CVec *vector) {
@@ -122,64 +155,151 @@ void cvec_destroy(CVec *vector) {
     free(vector);
 }
 
-TokenVec *tokenvec_create_cap(size_t capacity) {
+TokenVec *tokenvec_create_cap(char *source, size_t capacity) {
     if (capacity == 0) return NULL;
 
-    TokenVec *vector = (TokenVec *) malloc(sizeof(Token));
+    TokenVec *vector = (TokenVec *) malloc(sizeof(TokenVec));
     if (!vector) return NULL;
 
-    VECTOR_ARRAY = (Token *) malloc(sizeof(Token) * capacity);
-    if (!VECTOR_ARRAY) {
-        free(vector);
+    vector->kinds = (uint8_t *) malloc(sizeof(uint8_t) * capacity);
+    vector->offsets = (uint32_t *) malloc(sizeof(uint32_t) * capacity);
+    vector->lengths = (uint32_t *) malloc(sizeof(uint32_t) * capacity);
+    vector->source = source;
+    VECTOR_SIZE = 0;
+    VECTOR_CAPACITY = capacity;
+    if (!vector->kinds || !vector->offsets || !vector->lengths) {
+        tokenvec_destroy(vector);
         return NULL;
     }
 
-    VECTOR_SIZE = 0;
-    VECTOR_CAPACITY = capacity;
+    return vector;
+}
+
+// Wraps token arrays that belong to someone else, such as a mapped file. A view must not grow; destroying it
+// leaves the arrays alone.
+TokenVec *tokenvec_view(char *source, uint8_t *kinds, uint32_t *offsets, uint32_t *lengths, size_t size) {
+    TokenVec *vector = (TokenVec *) malloc(sizeof(TokenVec));
+    if (!vector) return NULL;
 
+    *vector = (TokenVec) { kinds, offsets, lengths, source, size, 0 };
     return vector;
 }
 
-TokenVec *tokenvec_create() {
-    return tokenvec_create_cap(CAPACITY_DEFAULT);
+TokenVec *tokenvec_create(char *source) {
+    return tokenvec_create_cap(source, CAPACITY_DEFAULT);
+}
+
+static int tokenvec_resize(TokenVec *vector, size_t capacity) {
+    uint8_t *kinds = (uint8_t *) realloc(vector->kinds, sizeof(uint8_t) * capacity);
+    if (!kinds) return 0;
+    vector->kinds = kinds;
+
+    uint32_t *offsets = (uint32_t *) realloc(vector->offsets, sizeof(uint32_t) * capacity);
+    if (!offsets) return 0;
+    vector->offsets = offsets;
+
+    uint32_t *lengths = (uint32_t *) realloc(vector->lengths, sizeof(uint32_t) * capacity);
+    if (!lengths) return 0;
+    vector->lengths = lengths;
+
+    VECTOR_CAPACITY = capacity;
+    return 1;
 }
 
+// Large arrays are grown with realloc, which can remap pages instead of copying them
 void tokenvec_expand(TokenVec *vector) {
     if (!vector) return;
 
-    Token *temp_array = VECTOR_ARRAY;
-    
-    VECTOR_ARRAY = (Token *) malloc(sizeof(Token) * VECTOR_CAPACITY * 2);
-    if (!VECTOR_ARRAY) return;
+    if (!tokenvec_resize(vector, VECTOR_CAPACITY * 2)) exit(EXIT_FAILURE);
+}
 
-    memcpy(VECTOR_ARRAY, temp_array, VECTOR_CAPACITY * sizeof(Token));
+// Releases unused capacity once no more tokens will be added
+void tokenvec_shrink(TokenVec *vector) {
+    if (!vector || VECTOR_SIZE == VECTOR_CAPACITY || VECTOR_IS_EMPTY) return;
 
-    VECTOR_CAPACITY *= 2;
-    free(temp_array);
+    tokenvec_resize(vector, VECTOR_SIZE);
 }
 
+// The token's text must lie in the vector's source, starting at its location
 void tokenvec_append(TokenVec* vector, Token token) {
     if (!vector) return;
 
     if (VECTOR_SIZE == VECTOR_CAPACITY) tokenvec_expand(vector);
 
-    VECTOR_ARRAY[VECTOR_SIZE].type = token.type;
-    VECTOR_ARRAY[VECTOR_SIZE].loc = token.loc;
-    VECTOR_ARRAY[VECTOR_SIZE].strref = token.strref;
+    vector->kinds[VECTOR_SIZE] = token.type;
+    vector->offsets[VECTOR_SIZE] = token.loc;
+    vector->lengths[VECTOR_SIZE] = token.strref.length;
 
     ++VECTOR_SIZE;
 }
 
-Token *tokenvec_get(TokenVec *vector, size_t index) {
-    if (!vector || index >= VECTOR_SIZE) return NULL;
+// Appends the tokens of 'from' starting at 'first'. Both vectors must share a source.
+void tokenvec_extend(TokenVec *vector, TokenVec *from, size_t first) {
+    if (!vector || !from || first >= from->size) return;
+
+    size_t count = from->size - first;
+    while (VECTOR_SIZE + count > VECTOR_CAPACITY) tokenvec_expand(vector);
 
-    return VECTOR_ARRAY + index;
+    memcpy(vector->kinds + VECTOR_SIZE, from->kinds + first, sizeof(uint8_t) * count);
+    memcpy(vector->offsets + VECTOR_SIZE, from->offsets + first, sizeof(uint32_t) * count);
+    memcpy(vector->lengths + VECTOR_SIZE, from->lengths + first, sizeof(uint32_t) * count);
+    VECTOR_SIZE += count;
 }
 
-Token *tokenvec_peek_last(TokenVec *vector) {
-    if (!vector || VECTOR_IS_EMPTY) return NULL;
+// Replaces the tokens from 'first' up to 'end' by those of 'from' starting at 'from_first'. The tokens after them
+// move by 'shift' bytes, as the source they point into has changed size between them.
+void tokenvec_splice(TokenVec *vector, size_t first, size_t end, TokenVec *from, size_t from_first, int64_t shift) {
+    if (!vector || !from || first > end || end > VECTOR_SIZE || from_first > from->size) return;
+    if (!VECTOR_CAPACITY) return;
+
+    size_t count = from->size - from_first;
+    size_t tail = VECTOR_SIZE - end;
+    while (first + count + tail > VECTOR_CAPACITY) tokenvec_expand(vector);
+
+    memmove(vector->kinds + first + count, vector->kinds + end, sizeof(uint8_t) * tail);
+    memmove(vector->offsets + first + count, vector->offsets + end, sizeof(uint32_t) * tail);
+    memmove(vector->lengths + first + count, vector->lengths + end, sizeof(uint32_t) * tail);
+    for (size_t i = first + count; i < first + count + tail; ++i)
+        vector->offsets[i] += shift;
 
-    return tokenvec_get(vector, LAST_INDEX);
+    memcpy(vector->kinds + first, from->kinds + from_first, sizeof(uint8_t) * count);
+    memcpy(vector->offsets + first, from->offsets + from_first, sizeof(uint32_t) * count);
+    memcpy(vector->lengths + first, from->lengths + from_first, sizeof(uint32_t) * count);
+    VECTOR_SIZE = first + count + tail;
+}
+
+// Unpacks a token into 'out'. Returns 'out', or NULL if there is no such token.
+Token *tokenvec_get(TokenVec *vector, size_t index, Token *out) {
+    if (!vector || !out || index >= VECTOR_SIZE) return NULL;
+
+    uint32_t offset = vector->offsets[index];
+    *out = create_token(vector->kinds[index], offset, vector->lengths[index], vector->source + offset);
+    return out;
+}
+
+TokenType tokenvec_kind(TokenVec *vector, size_t index) {
+    if (!vector || index >= VECTOR_SIZE) return INVALID;
+
+    return vector->kinds[index];
+}
+
+StringRef tokenvec_string(TokenVec *vector, size_t index) {
+    if (!vector || index >= VECTOR_SIZE) return (StringRef) {0, NULL};
+
+    return (StringRef) {vector->lengths[index], vector->source + vector->offsets[index]};
+}
+
+// The text of a node, which a number literal takes from its token rather than from a symbol
+StringRef tokenvec_text(TokenVec *vector, AstNode *node) {
+    if (node->symbol == NUMBER_SYMBOL) return tokenvec_string(vector, node->field2.node);
+
+    return symbol_name(node->symbol);
+}
+
+TokenType tokenvec_last_kind(TokenVec *vector) {
+    if (!vector || VECTOR_IS_EMPTY) return INVALID;
+
+    return vector->kinds[LAST_INDEX];
 }
 
 size_t tokenvec_size(TokenVec *vector) {
@@ -191,17 +311,16 @@ size_t tokenvec_size(TokenVec *vector) {
 void tokenvec_clear(TokenVec *vector) {
     if (!vector) return;
 
-    for (size_t i = 0; i < VECTOR_SIZE; ++i) {
-        VECTOR_ARRAY[i].loc = 0;
-        VECTOR_ARRAY[i].type = 0;
-        VECTOR_ARRAY[i].strref.length = 0;
-        VECTOR_ARRAY[i].strref.string = NULL;
-    }
+    VECTOR_SIZE = 0;
 }
 
 void tokenvec_destroy(TokenVec *vector) {
     if (!vector) return;
-    free(VECTOR_ARRAY);
+    if (VECTOR_CAPACITY) {
+        free(vector->kinds);
+        free(vector->offsets);
+        free(vector->lengths);
+    }
     free(vector);
 }
 
@@ -232,17 +351,25 @@ NodeVec *nodevec_create() {
 void nodevec_expand(NodeVec *vector) {
     if (!vector) return;
 
-    AstNode *temp = VECTOR_ARRAY;
-    VECTOR_ARRAY = malloc(sizeof(AstNode) * 2 * VECTOR_CAPACITY);
-    if (!VECTOR_ARRAY) {
-        free(temp);
+    AstNode *temp = realloc(VECTOR_ARRAY, sizeof(AstNode) * 2 * VECTOR_CAPACITY);
+    if (!temp) {
+        free(VECTOR_ARRAY);
+        VECTOR_ARRAY = NULL;
         return;
     }
 
-    memcpy(VECTOR_ARRAY, temp, VECTOR_CAPACITY * sizeof(AstNode));
-
+    VECTOR_ARRAY = temp;
     VECTOR_CAPACITY *= 2;
-    free(temp);
+}
+
+void nodevec_shrink(NodeVec *vector) {
+    if (!vector || VECTOR_SIZE == VECTOR_CAPACITY || VECTOR_IS_EMPTY) return;
+
+    AstNode *temp = realloc(VECTOR_ARRAY, sizeof(AstNode) * VECTOR_SIZE);
+    if (!temp) return;
+
+    VECTOR_ARRAY = temp;
+    VECTOR_CAPACITY = VECTOR_SIZE;
 }
 
 size_t nodevec_append(NodeVec *vector, AstNode node) {
@@ -281,6 +408,7 @@ AstNode nodevec_pop_last(NodeVec *vector) {
 }
 
 void nodevec_destroy(NodeVec *vector) {
+    if (!vector) return;
     free(VECTOR_ARRAY);
     free(vector);
 }
@@ -289,3 +417,33 @@ int nodevec_is_empty(NodeVec *vector) {
     if (!vector || VECTOR_IS_EMPTY) return 0;
     return 1;
 }
+
+// Doubles an array that has run out of room, starting at 'initial' items. Running out of memory ends the process,
+// as it does wherever the compiler grows its stacks.
+void *array_grow(void *array, size_t *capacity, size_t item_size, size_t initial) {
+    size_t grown = *capacity ? *capacity * 2 : initial;
+    void *temp = realloc(array, item_size * grown);
+    if (!temp) exit(EXIT_FAILURE);
+
+    *capacity = grown;
+    return temp;
+}
+
+void u32vec_append(U32Vec *vector, uint32_t item) {
+    if (VECTOR_SIZE == VECTOR_CAPACITY)
+        VECTOR_ARRAY = array_grow(VECTOR_ARRAY, &VECTOR_CAPACITY, sizeof(uint32_t), 256);
+
+    VECTOR_ARRAY[VECTOR_SIZE++] = item;
+}
+
+uint32_t u32vec_pop_last(U32Vec *vector) {
+    if (VECTOR_IS_EMPTY) return 0;
+
+    return VECTOR_ARRAY[--VECTOR_SIZE];
+}
+
+// Frees the items, leaving an empty vector that can be used again
+void u32vec_release(U32Vec *vector) {
+    free(VECTOR_ARRAY);
+    *vector = (U32Vec) {0};
+}
@@ -26,6 +26,7 @@ Vector *vector_create_cap(size_t capacity) {
 
     VECTOR_SIZE = 0;
     VECTOR_CAPACITY = capacity;
+    vector->arena = NULL;
 
     VECTOR_ARRAY = (void**) malloc(sizeof(void*) * capacity);
     if (!VECTOR_ARRAY) {
@@ -41,12 +42,31 @@ Vector *vector_create() {
     return vector_create_cap(CAPACITY_DEFAULT);
 }
 
+// Creates an empty vector whose struct and array live in the given arena. It is released with the arena.
+Vector *vector_create_arena(Arena *arena, size_t capacity) {
+    if (!arena || !capacity) return NULL;
+
+    Vector *vector = (Vector*) arena_alloc(arena, sizeof(Vector));
+    VECTOR_ARRAY = (void**) arena_alloc(arena, sizeof(void*) * capacity);
+    VECTOR_SIZE = 0;
+    VECTOR_CAPACITY = capacity;
+    vector->arena = arena;
+
+    return vector;
+}
+
 // Expands the vector's capacity by a factor of 2.
 void vector_expand(Vector *vector) {
     if (!vector) {
         fprintf(stderr, "Invalid vector reference.\n");
         return;
     }
+    if (vector->arena) {
+        VECTOR_ARRAY = (void**) arena_resize(vector->arena, VECTOR_ARRAY, sizeof(void*) * VECTOR_CAPACITY,
+                                             sizeof(void*) * 2 * VECTOR_CAPACITY);
+        VECTOR_CAPACITY *= 2;
+        return;
+    }
 
     void **temp_array = VECTOR_ARRAY;
 
@@ -68,6 +88,12 @@ void vector_shrink(Vector *vector) {
         fprintf(stderr, "Invalid vector reference.\n");
         return;
     }
+    if (vector->arena) {
+        VECTOR_ARRAY = (void**) arena_resize(vector->arena, VECTOR_ARRAY, sizeof(void*) * VECTOR_CAPACITY,
+                                             sizeof(void*) * (VECTOR_CAPACITY / 2));
+        VECTOR_CAPACITY /= 2;
+        return;
+    }
 
     void **temp_array = VECTOR_ARRAY;
 
@@ -238,6 +264,7 @@ void vector_destroy_deep(Vector *vector) {
     }
 
     vector_clear(vector);
+    if (vector->arena) return;
     free(vector -> array);
     free(vector);
 }
@@ -248,6 +275,7 @@ void vector_destroy(Vector *vector) {
         fprintf(stderr, "Invalid vector reference.\n");
         return;
     }
+    if (vector->arena) return;
 
     free(vector->array);
     free(vector);
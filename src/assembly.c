@@ -0,0 +1,1039 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "assembly.h"
+#include "typecheck.h"
+
+#define INDENT_WIDTH 4
+#define WORD 8
+#define PACKED 16
+#define REF_ARGS(ref) (int) (ref).length, (ref).string
+
+// A stack machine for x86-64 in GNU assembler Intel syntax. Every expression pushes its value onto the stack as
+// 8-byte words laid out as in memory: structs are their members in order, arrays are their dimensions followed
+// by a pointer to a row-major buffer. Variables are left where their value was pushed and addressed relative to
+// rbp, or to r12 for globals, which holds main's frame. 'depth' tracks rbp - rsp, so calls into C can realign
+// the stack to 16 bytes. JPL functions take their arguments on the stack, above a slot for their return value.
+//
+// Float comprehensions and sums whose body is elementwise in the innermost loop variable are also given an
+// SSE2 path that evaluates two iterations at once in packed registers.
+
+static TokenVec *token_list;
+static NodeVec *node_list;
+
+static CVec *code;
+static CVec *data_buffer;
+static CVec *fn_buffer;
+static CVec *main_buffer;
+
+static Dict *symbols;
+
+static char *builtins[] = { "exp", "sin", "cos", "tan", "asin", "acos", "atan", "log", "pow", "atan2" };
+
+static int64_t depth;
+static int64_t return_offset;
+static uint32_t label_count;
+static uint32_t string_count;
+
+static void emit(const char *format, ...) {
+    cvec_append_format(code, "%*s", INDENT_WIDTH, "");
+
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    char line[len + 1];
+    va_start(args, format);
+    vsnprintf(line, len + 1, format, args);
+    va_end(args);
+
+    cvec_append_array_line(code, line, len);
+}
+
+static void emit_label(uint32_t label) {
+    cvec_append_format(code, ".L%u:\n", label);
+}
+
+static void emit_reserve(int64_t bytes) {
+    if (!bytes) return;
+    emit("sub rsp, %ld", bytes);
+    depth += bytes;
+}
+
+static void emit_release(int64_t bytes) {
+    if (!bytes) return;
+    emit("add rsp, %ld", bytes);
+    depth -= bytes;
+}
+
+static void emit_push(const char *reg) {
+    emit("push %s", reg);
+    depth += WORD;
+}
+
+static void emit_pop(const char *reg) {
+    emit("pop %s", reg);
+    depth -= WORD;
+}
+
+// Calls a C function, realigning the stack to the 16 bytes the System V ABI requires.
+static void emit_call(const char *name) {
+    if (depth % PACKED) emit("sub rsp, %d", WORD);
+    emit("call %s@PLT", name);
+    if (depth % PACKED) emit("add rsp, %d", WORD);
+}
+
+// Copies words between two memory regions. Copies from the highest word down when the regions overlap and the
+// destination lies above the source.
+static void emit_copy(const char *src, int64_t src_offset, const char *dst, int64_t dst_offset, int64_t size) {
+    for (int64_t i = size - WORD; i >= 0; i -= WORD) {
+        emit("mov r11, qword ptr [%s%+ld]", src, src_offset + i);
+        emit("mov qword ptr [%s%+ld], r11", dst, dst_offset + i);
+    }
+}
+
+// Stores a string in the data section and returns its label number.
+static uint32_t save_string(const char *string, size_t length) {
+    uint32_t label = string_count++;
+    cvec_append_format(data_buffer, ".Lstr%u:\n%*s.string \"", label, INDENT_WIDTH, "");
+    for (size_t i = 0; i < length; ++i) {
+        if (string[i] == '\\' || string[i] == '"')
+            cvec_append(data_buffer, '\\');
+        cvec_append(data_buffer, string[i]);
+    }
+    cvec_append_array(data_buffer, "\"\n", 2);
+    return label;
+}
+
+// Saves a JPL string token without its quotes.
+static uint32_t save_token_string(StringRef string) {
+    return save_string(string.string + 1, string.length - 2);
+}
+
+static void bind_symbol(StringRef name, int64_t offset) {
+    uint64_t location = (uint32_t) (int32_t) offset | (uint64_t) (code == main_buffer) << 32;
+    dict_add_ref(symbols, name, (void*) location);
+}
+
+// Formats the address of a word inside a variable.
+static void var_address(StringRef name, int64_t offset, char *buffer) {
+    uint64_t location = 0;
+    dict_try_ref(symbols, name, (void**) &location);
+    snprintf(buffer, MAXIMUM_BUFFER, "qword ptr [%s%+ld]", location >> 32 ? "r12" : "rbp",
+             (int32_t) (uint32_t) location + offset);
+}
+
+static void unbind_lvalue(uint32_t lvalue_index) {
+    AstNode *lvalue = nodevec_get(node_list, lvalue_index);
+    if (!lvalue) return;
+
+    dict_remove_ref(symbols, symbol_name(lvalue->symbol));
+    if (lvalue->type.lvalue != ARRAY_LVALUE) return;
+    for (size_t i = 0; i < childlist_size(lvalue->field1.list); ++i)
+        dict_remove_ref(symbols, symbol_name(nodevec_get(node_list, childlist_get(lvalue->field1.list, i))->symbol));
+}
+
+static int is_builtin(StringRef name) {
+    size_t len = sizeof(builtins) / sizeof(char*);
+    for (size_t i = 0; i < len; ++i) {
+        if (!ref_array_cmp(name, builtins[i])) return 1;
+    }
+    return 0;
+}
+
+static void asm_assert(uint32_t expr_index, StringRef message) {
+    uint32_t string = save_token_string(message);
+    uint32_t label = label_count++;
+    asm_expr(expr_index);
+    emit_pop("rax");
+    emit("test rax, rax");
+    emit("jne .L%u", label);
+    emit("lea rdi, [rip+.Lstr%u]", string);
+    emit("and rsp, -16");
+    emit("call jpl_fail_assertion@PLT");
+    emit_label(label);
+}
+
+static AstNode *get_expr_type(uint32_t expr_index) {
+    return nodevec_get(node_list, nodevec_get(node_list, expr_index)->field4.node);
+}
+
+static ChildList get_members(AstNode *type) {
+    uint64_t cmd_index;
+    if (!lookup_declaration(type->symbol, &cmd_index)) return 0;
+    return nodevec_get(node_list, cmd_index)->field1.list;
+}
+
+static int64_t type_size(uint64_t type_index) {
+    AstNode *type = nodevec_get(node_list, type_index);
+    if (!type) return WORD;
+
+    if (type->type.type == ARRAY_TYPE)
+        return WORD * (type->field1.int_value + 1);
+    if (type->type.type != STRUCT_TYPE)
+        return WORD;
+
+    ChildList members = get_members(type);
+    int64_t size = 0;
+    for (size_t i = 0; i < childlist_size(members); ++i)
+        size += type_size(nodevec_get(node_list, childlist_get(members, i))->field2.node);
+    return size;
+}
+
+// Returns the offset of a member within its struct and stores its size.
+static int64_t member_offset(uint64_t type_index, uint32_t symbol, int64_t *size) {
+    ChildList members = get_members(nodevec_get(node_list, type_index));
+    int64_t offset = 0;
+    for (size_t i = 0; i < childlist_size(members); ++i) {
+        AstNode *member = nodevec_get(node_list, childlist_get(members, i));
+        *size = type_size(member->field2.node);
+        if (member->symbol == symbol) return offset;
+        offset += *size;
+    }
+    return offset;
+}
+
+// Appends the type descriptor 'jpl_show' reads values with.
+static void append_descriptor(CVec *buffer, uint64_t type_index) {
+    AstNode *type = nodevec_get(node_list, type_index);
+    if (!type) return;
+
+    switch (type->type.type) {
+        case INT_TYPE:
+            cvec_append(buffer, 'i');
+            break;
+        case FLOAT_TYPE:
+            cvec_append(buffer, 'f');
+            break;
+        case BOOL_TYPE:
+            cvec_append(buffer, 'b');
+            break;
+        case VOID_TYPE:
+        case VAR_TYPE:
+            cvec_append(buffer, 'v');
+            break;
+        case ARRAY_TYPE:
+            cvec_append_format(buffer, "a%ld", type->field1.int_value);
+            append_descriptor(buffer, type->field2.node);
+            break;
+        case STRUCT_TYPE: {
+            ChildList members = get_members(type);
+            cvec_append_format(buffer, "s%.*s(", REF_ARGS(symbol_name(type->symbol)));
+            for (size_t i = 0; i < childlist_size(members); ++i)
+                append_descriptor(buffer, nodevec_get(node_list, childlist_get(members, i))->field2.node);
+            cvec_append(buffer, ')');
+            break;
+        }
+    }
+}
+
+int generate_asm(TokenVec *tokens, NodeVec *nodes, Vector *cmd_nodes, CVec **output) {
+    if (!tokens || !nodes || !cmd_nodes || !output) return EXIT_FAILURE;
+
+    token_list = tokens;
+    node_list = nodes;
+
+    data_buffer = cvec_create();
+    fn_buffer = cvec_create();
+    main_buffer = cvec_create();
+    symbols = dict_create_small();
+    if (!data_buffer || !fn_buffer || !main_buffer || !symbols) return EXIT_FAILURE;
+
+    cvec_append_format(data_buffer, ".Lbounds_msg:\n    .string \"Index out of bounds\"\n");
+    cvec_append_format(data_buffer, ".Lloop_msg:\n    .string \"Non-positive loop bound\"\n");
+    cvec_append_format(data_buffer, ".Ldiv_msg:\n    .string \"Division by zero\"\n");
+    cvec_append_format(data_buffer, ".Lmod_msg:\n    .string \"Modulo by zero\"\n");
+
+    // main's frame holds the globals. r12 is callee-saved, so it keeps pointing there inside functions.
+    code = main_buffer;
+    emit("push rbp");
+    emit("mov rbp, rsp");
+    emit("push r12");
+    emit("mov r12, rbp");
+    depth = WORD;
+
+    // Command line arguments, above one word of padding
+    emit_reserve(3 * WORD);
+    emit("lea rdx, [rsp]");
+    emit_call("jpl_args");
+    emit("mov qword ptr [rsp+%d], rax", WORD);
+    bind_symbol((StringRef) {4, "args"}, -depth);
+    bind_symbol((StringRef) {6, "argnum"}, -depth);
+
+    for (size_t i = 0; i < cmd_nodes->size; ++i)
+        asm_cmd((uint64_t) vector_get(cmd_nodes, i));
+
+    emit("xor eax, eax");
+    emit("mov r12, qword ptr [rbp-%d]", WORD);
+    emit("leave");
+    emit("ret");
+
+    // Shared failure paths. They never return, so the stack is simply realigned.
+    const char *failures[] = { "bounds", "loop", "div", "mod" };
+    for (size_t i = 0; i < sizeof(failures) / sizeof(char*); ++i) {
+        cvec_append_format(code, ".L%s:\n", failures[i]);
+        emit("lea rdi, [rip+.L%s_msg]", failures[i]);
+        emit("and rsp, -16");
+        emit("call jpl_fail@PLT");
+    }
+
+    CVec *asm_code = cvec_create_cap(data_buffer->size + fn_buffer->size + main_buffer->size + MAXIMUM_BUFFER);
+    if (!asm_code) return EXIT_FAILURE;
+
+    cvec_append_format(asm_code, "    .intel_syntax noprefix\n    .section .rodata\n");
+    cvec_append_array(asm_code, data_buffer->array, data_buffer->size);
+    cvec_append_format(asm_code, "\n    .text\n");
+    cvec_append_array(asm_code, fn_buffer->array, fn_buffer->size);
+    cvec_append_format(asm_code, "    .globl main\nmain:\n");
+    cvec_append_array(asm_code, main_buffer->array, main_buffer->size);
+    cvec_append_format(asm_code, "\n    .section .note.GNU-stack,\"\",@progbits\n");
+
+    cvec_destroy(data_buffer);
+    cvec_destroy(fn_buffer);
+    cvec_destroy(main_buffer);
+    dict_free(symbols);
+
+    *output = asm_code;
+    return EXIT_SUCCESS;
+}
+
+void asm_cmd(uint32_t cmd_index) {
+    AstNode *cmd = nodevec_get(node_list, cmd_index);
+    if (!cmd) return;
+
+    uint32_t string;
+    int64_t start;
+    switch (cmd->type.cmd) {
+        case READ_CMD:
+            string = save_token_string(symbol_name(cmd->symbol));
+            emit_reserve(3 * WORD);
+            emit("lea rdi, [rip+.Lstr%u]", string);
+            emit("lea rsi, [rsp]");
+            emit("lea rdx, [rsp+%d]", WORD);
+            emit_call("jpl_read_image");
+            emit("mov qword ptr [rsp+%d], rax", 2 * WORD);
+            asm_lvalue(cmd->field1.node);
+            break;
+        case WRITE_CMD:
+            string = save_token_string(symbol_name(cmd->symbol));
+            asm_expr(cmd->field1.node);
+            emit("mov rdi, qword ptr [rsp+%d]", 2 * WORD);
+            emit("mov rsi, qword ptr [rsp]");
+            emit("mov rdx, qword ptr [rsp+%d]", WORD);
+            emit("lea rcx, [rip+.Lstr%u]", string);
+            emit_call("jpl_write_image");
+            emit_release(3 * WORD);
+            break;
+        case LET_CMD:
+            asm_expr(cmd->field3.node);
+            asm_lvalue(cmd->field1.node);
+            break;
+        case ASSERT_CMD:
+            asm_assert(cmd->field1.node, symbol_name(cmd->symbol));
+            break;
+        case PRINT_CMD:
+            string = save_token_string(symbol_name(cmd->symbol));
+            emit("lea rdi, [rip+.Lstr%u]", string);
+            emit_call("jpl_print");
+            break;
+        case SHOW_CMD: {
+            uint64_t type = nodevec_get(node_list, cmd->field1.node)->field4.node;
+            CVec *descriptor = cvec_create(); if (!descriptor) exit(EXIT_FAILURE);
+            append_descriptor(descriptor, type);
+            string = save_string(descriptor->array, descriptor->size);
+            cvec_destroy(descriptor);
+
+            asm_expr(cmd->field1.node);
+            emit("lea rdi, [rip+.Lstr%u]", string);
+            emit("lea rsi, [rsp]");
+            emit_call("jpl_show");
+            emit_release(type_size(type));
+            break;
+        }
+        case TIME_CMD:
+            emit_call("jpl_get_time");
+            emit_reserve(WORD);
+            emit("movsd qword ptr [rsp], xmm0");
+            start = depth;
+            asm_cmd(cmd->field1.node);
+            emit_call("jpl_get_time");
+            emit("subsd xmm0, qword ptr [rbp-%ld]", start);
+            emit_call("jpl_print_time");
+            break;
+        case FN_CMD:
+            asm_fn_cmd(cmd_index);
+            break;
+        case STRUCT_CMD:
+            break;
+    }
+}
+
+void asm_fn_cmd(uint32_t cmd_index) {
+    AstNode *cmd = nodevec_get(node_list, cmd_index);
+    if (!cmd) return;
+
+    CVec *saved_code = code;
+    int64_t saved_depth = depth;
+    code = fn_buffer;
+    depth = 0;
+
+    ChildList bind_list = cmd->field1.list;
+    ChildList stmt_list = cmd->field3.list;
+
+    cvec_append_format(code, "f_%.*s:\n", REF_ARGS(symbol_name(cmd->symbol)));
+    emit("push rbp");
+    emit("mov rbp, rsp");
+
+    // Arguments sit above the return address and saved rbp, the first one lowest
+    int64_t offset = 2 * WORD;
+    for (size_t i = 0; i < childlist_size(bind_list); ++i) {
+        AstNode *bind = nodevec_get(node_list, childlist_get(bind_list, i));
+        AstNode *lvalue = nodevec_get(node_list, bind->field1.node);
+        bind_symbol(symbol_name(lvalue->symbol), offset);
+        for (size_t j = 0; lvalue->type.lvalue == ARRAY_LVALUE && j < childlist_size(lvalue->field1.list); ++j)
+            bind_symbol(symbol_name(nodevec_get(node_list, childlist_get(lvalue->field1.list, j))->symbol),
+                        offset + WORD * j);
+        offset += type_size(bind->field2.node);
+    }
+    return_offset = offset;
+
+    for (size_t i = 0; i < childlist_size(stmt_list); ++i)
+        asm_statement(childlist_get(stmt_list, i));
+
+    // Void functions may end without a return statement
+    emit("mov qword ptr [rbp+%ld], 0", return_offset);
+    emit("leave");
+    emit("ret");
+    cvec_append(code, '\n');
+
+    for (size_t i = 0; i < childlist_size(bind_list); ++i)
+        unbind_lvalue(nodevec_get(node_list, childlist_get(bind_list, i))->field1.node);
+    for (size_t i = 0; i < childlist_size(stmt_list); ++i) {
+        AstNode *stmt = nodevec_get(node_list, childlist_get(stmt_list, i));
+        if (stmt->type.stmt == LET_STMT)
+            unbind_lvalue(stmt->field1.node);
+    }
+
+    code = saved_code;
+    depth = saved_depth;
+}
+
+void asm_statement(uint32_t stmt_index) {
+    AstNode *stmt = nodevec_get(node_list, stmt_index);
+    if (!stmt) return;
+
+    int64_t size;
+    switch (stmt->type.stmt) {
+        case LET_STMT:
+            asm_expr(stmt->field3.node);
+            asm_lvalue(stmt->field1.node);
+            break;
+        case ASSERT_STMT:
+            asm_assert(stmt->field1.node, symbol_name(stmt->symbol));
+            break;
+        case RETURN_STMT:
+            asm_expr(stmt->field1.node);
+            size = type_size(nodevec_get(node_list, stmt->field1.node)->field4.node);
+            emit_copy("rsp", 0, "rbp", return_offset, size);
+            emit("leave");
+            emit("ret");
+            depth -= size;
+            break;
+    }
+}
+
+// Binds the value on top of the stack to an lvalue. It stays in place for the rest of its scope.
+void asm_lvalue(uint32_t lvalue_index) {
+    AstNode *lvalue = nodevec_get(node_list, lvalue_index);
+    if (!lvalue) return;
+
+    bind_symbol(symbol_name(lvalue->symbol), -depth);
+    if (lvalue->type.lvalue != ARRAY_LVALUE) return;
+
+    ChildList list = lvalue->field1.list;
+    for (size_t i = 0; i < childlist_size(list); ++i)
+        bind_symbol(symbol_name(nodevec_get(node_list, childlist_get(list, i))->symbol), -depth + WORD * i);
+}
+
+void asm_expr(uint32_t expr_index) {
+    AstNode *expr = nodevec_get(node_list, expr_index);
+    if (!expr) return;
+
+    ChildList list = expr->field1.list;
+    int64_t size = type_size(expr->field4.node);
+    int64_t offset, member_size = WORD;
+    uint32_t label;
+    char address[MAXIMUM_BUFFER];
+    AstNode *type;
+
+    switch (expr->type.expr) {
+        case INT_EXPR:
+            emit("mov rax, %ld", (int64_t) expr->field1.int_value);
+            emit_push("rax");
+            break;
+        case FLOAT_EXPR: {
+            uint64_t bits;
+            memcpy(&bits, &expr->field1.float_value, sizeof(bits));
+            emit("mov rax, %#lx", bits);
+            emit_push("rax");
+            break;
+        }
+        case TRUE_EXPR:
+            emit("push 1");
+            depth += WORD;
+            break;
+        case FALSE_EXPR:
+        case VOID_EXPR:
+            emit("push 0");
+            depth += WORD;
+            break;
+        case VAR_EXPR:
+            emit_reserve(size);
+            for (int64_t i = 0; i < size; i += WORD) {
+                var_address(symbol_name(expr->symbol), i, address);
+                emit("mov rax, %s", address);
+                emit("mov qword ptr [rsp+%ld], rax", i);
+            }
+            break;
+        case ARRAYLITERAL_EXPR: {
+            int64_t element = type_size(nodevec_get(node_list, expr->field4.node)->field2.node);
+            for (size_t i = childlist_size(list); i > 0; --i)
+                asm_expr(childlist_get(list, i - 1));
+            emit("mov rdi, %ld", element * childlist_size(list));
+            emit_call("jpl_alloc");
+            emit_copy("rsp", 0, "rax", 0, element * childlist_size(list));
+            emit_release(element * childlist_size(list));
+            emit_push("rax");
+            emit("mov rax, %zu", childlist_size(list));
+            emit_push("rax");
+            break;
+        }
+        case STRUCTLITERAL_EXPR:
+            for (size_t i = childlist_size(list); i > 0; --i)
+                asm_expr(childlist_get(list, i - 1));
+            break;
+        case DOT_EXPR: {
+            uint64_t struct_type = nodevec_get(node_list, expr->field1.node)->field4.node;
+            int64_t struct_size = type_size(struct_type);
+            asm_expr(expr->field1.node);
+            offset = member_offset(struct_type, expr->symbol, &member_size);
+            emit_copy("rsp", offset, "rsp", struct_size - member_size, member_size);
+            emit_release(struct_size - member_size);
+            break;
+        }
+        case ARRAYINDEX_EXPR:
+            asm_arrayindex_expr(expr_index);
+            break;
+        case CALL_EXPR:
+            asm_call_expr(expr_index);
+            break;
+        case UNOP_EXPR:
+            asm_expr(expr->field1.node);
+            type = get_expr_type(expr_index);
+            if (*symbol_name(expr->symbol).string == '!')
+                emit("xor qword ptr [rsp], 1");
+            else if (type->type.type == INT_TYPE)
+                emit("neg qword ptr [rsp]");
+            else
+                emit("btc qword ptr [rsp], 63");
+            break;
+        case BINOP_EXPR:
+            asm_binop_expr(expr_index);
+            break;
+        case IF_EXPR: {
+            uint32_t end = label_count++;
+            label = label_count++;
+            asm_expr(expr->field1.node);
+            emit_pop("rax");
+            emit("test rax, rax");
+            emit("je .L%u", label);
+            asm_expr(expr->field2.node);
+            emit("jmp .L%u", end);
+            depth -= size;
+            emit_label(label);
+            asm_expr(expr->field3.node);
+            emit_label(end);
+            break;
+        }
+        case ARRAYLOOP_EXPR:
+        case SUMLOOP_EXPR:
+            asm_loop_expr(expr_index);
+            break;
+    }
+}
+
+// Indices are pushed last to first, then the array, so index i sits i words above the array.
+void asm_arrayindex_expr(uint32_t expr_index) {
+    AstNode *expr = nodevec_get(node_list, expr_index);
+    if (!expr) return;
+
+    ChildList list = expr->field2.list;
+    int64_t rank = childlist_size(list);
+    int64_t array = WORD * (rank + 1);
+    int64_t element = type_size(expr->field4.node);
+
+    for (int64_t i = rank; i > 0; --i)
+        asm_expr(childlist_get(list, i - 1));
+    asm_expr(expr->field1.node);
+
+    for (int64_t i = 0; i < rank; ++i) {
+        emit("mov rax, qword ptr [rsp+%ld]", array + WORD * i);
+        emit("test rax, rax");
+        emit("js .Lbounds");
+        emit("cmp rax, qword ptr [rsp+%ld]", WORD * i);
+        emit("jge .Lbounds");
+    }
+
+    emit("mov rax, qword ptr [rsp+%ld]", array);
+    for (int64_t i = 1; i < rank; ++i) {
+        emit("imul rax, qword ptr [rsp+%ld]", WORD * i);
+        emit("add rax, qword ptr [rsp+%ld]", array + WORD * i);
+    }
+    emit("imul rax, rax, %ld", element);
+    emit("add rax, qword ptr [rsp+%ld]", WORD * rank);
+
+    emit_release(array + WORD * rank);
+    emit_reserve(element);
+    emit_copy("rax", 0, "rsp", 0, element);
+}
+
+void asm_call_expr(uint32_t expr_index) {
+    AstNode *expr = nodevec_get(node_list, expr_index);
+    if (!expr) return;
+
+    ChildList list = expr->field1.list;
+    StringRef name = symbol_name(expr->symbol);
+
+    // Builtins take their arguments in registers
+    if (!ref_array_cmp(name, "to_float")) {
+        asm_expr(childlist_get(list, 0));
+        emit("cvtsi2sd xmm0, qword ptr [rsp]");
+        emit("movsd qword ptr [rsp], xmm0");
+        return;
+    }
+    if (!ref_array_cmp(name, "to_int")) {
+        // cvttsd2si yields INT64_MIN when out of range. NaN becomes 0 and large values saturate.
+        asm_expr(childlist_get(list, 0));
+        emit("movsd xmm0, qword ptr [rsp]");
+        emit("cvttsd2si rax, xmm0");
+        emit("xor r10d, r10d");
+        emit("ucomisd xmm0, xmm0");
+        emit("cmovp rax, r10");
+        emit("mov r10, 0x43e0000000000000");
+        emit("movq xmm1, r10");
+        emit("ucomisd xmm0, xmm1");
+        emit("mov r10, 0x7fffffffffffffff");
+        emit("cmovae rax, r10");
+        emit("mov qword ptr [rsp], rax");
+        return;
+    }
+    if (!ref_array_cmp(name, "sqrt")) {
+        asm_expr(childlist_get(list, 0));
+        emit("sqrtsd xmm0, qword ptr [rsp]");
+        emit("movsd qword ptr [rsp], xmm0");
+        return;
+    }
+
+    if (is_builtin(name)) {
+        for (size_t i = childlist_size(list); i > 0; --i)
+            asm_expr(childlist_get(list, i - 1));
+        emit("movsd xmm0, qword ptr [rsp]");
+        if (childlist_size(list) > 1)
+            emit("movsd xmm1, qword ptr [rsp+%d]", WORD);
+
+        char builtin[MAXIMUM_BUFFER];
+        snprintf(builtin, MAXIMUM_BUFFER, "%.*s", REF_ARGS(name));
+        emit_call(builtin);
+        emit_release(WORD * (childlist_size(list) - 1));
+        emit("movsd qword ptr [rsp], xmm0");
+        return;
+    }
+
+    // Padding goes below the return slot so the callee's frame starts 16-byte aligned
+    int64_t result = type_size(expr->field4.node);
+    int64_t args = 0;
+    for (size_t i = 0; i < childlist_size(list); ++i)
+        args += type_size(nodevec_get(node_list, childlist_get(list, i))->field4.node);
+    int64_t padding = (PACKED - (depth + result + args) % PACKED) % PACKED;
+
+    emit_reserve(padding + result);
+    for (size_t i = childlist_size(list); i > 0; --i)
+        asm_expr(childlist_get(list, i - 1));
+    emit("call f_%.*s", REF_ARGS(name));
+    emit_release(args);
+
+    if (padding) {
+        emit_copy("rsp", 0, "rsp", padding, result);
+        emit_release(padding);
+    }
+}
+
+void asm_binop_expr(uint32_t expr_index) {
+    AstNode *expr = nodevec_get(node_list, expr_index);
+    if (!expr) return;
+
+    StringRef op = symbol_name(expr->symbol);
+    uint32_t label;
+
+    // Short-circuiting operators only evaluate their right side when needed
+    if (!ref_array_cmp(op, "&&") || !ref_array_cmp(op, "||")) {
+        label = label_count++;
+        asm_expr(expr->field1.node);
+        emit("mov rax, qword ptr [rsp]");
+        emit("test rax, rax");
+        emit(*op.string == '&' ? "je .L%u" : "jne .L%u", label);
+        emit_release(WORD);
+        asm_expr(expr->field2.node);
+        emit_label(label);
+        return;
+    }
+
+    asm_expr(expr->field1.node);
+    asm_expr(expr->field2.node);
+    TypeType operand_type = get_expr_type(expr->field1.node)->type.type;
+
+    if (operand_type != FLOAT_TYPE) {
+        emit_pop("r10");
+        emit("mov rax, qword ptr [rsp]");
+        const char *condition = NULL;
+        switch (*op.string) {
+            case '+': emit("add rax, r10"); break;
+            case '-': emit("sub rax, r10"); break;
+            case '*': emit("imul rax, r10"); break;
+            case '/':
+            case '%': {
+                uint32_t end = label_count++;
+                label = label_count++;
+                emit("test r10, r10");
+                emit(*op.string == '/' ? "je .Ldiv" : "je .Lmod");
+                // idiv traps on INT64_MIN / -1, so -1 negates, wrapping as neg does, and leaves no remainder
+                emit("cmp r10, -1");
+                emit("jne .L%u", label);
+                emit(*op.string == '/' ? "neg rax" : "xor eax, eax");
+                emit("jmp .L%u", end);
+                emit_label(label);
+                emit("cqo");
+                emit("idiv r10");
+                if (*op.string == '%') emit("mov rax, rdx");
+                emit_label(end);
+                break;
+            }
+            case '<': condition = op.length == 1 ? "l" : "le"; break;
+            case '>': condition = op.length == 1 ? "g" : "ge"; break;
+            case '=': condition = "e"; break;
+            case '!': condition = "ne"; break;
+        }
+        if (condition) {
+            emit("cmp rax, r10");
+            emit("set%s al", condition);
+            emit("movzx eax, al");
+        }
+        emit("mov qword ptr [rsp], rax");
+        return;
+    }
+
+    emit("movsd xmm1, qword ptr [rsp]");
+    emit_release(WORD);
+    emit("movsd xmm0, qword ptr [rsp]");
+
+    // Comparisons produce an all-ones mask, in xmm1 when the operands are swapped
+    const char *compare = NULL;
+    const char *result = "xmm0";
+    switch (*op.string) {
+        case '+': emit("addsd xmm0, xmm1"); break;
+        case '-': emit("subsd xmm0, xmm1"); break;
+        case '*': emit("mulsd xmm0, xmm1"); break;
+        case '/': emit("divsd xmm0, xmm1"); break;
+        case '%': emit_call("fmod"); break;
+        case '<': compare = op.length == 1 ? "cmpltsd xmm0, xmm1" : "cmplesd xmm0, xmm1"; break;
+        case '>':
+            compare = op.length == 1 ? "cmpltsd xmm1, xmm0" : "cmplesd xmm1, xmm0";
+            result = "xmm1";
+            break;
+        case '=': compare = "cmpeqsd xmm0, xmm1"; break;
+        case '!': compare = "cmpneqsd xmm0, xmm1"; break;
+    }
+    if (compare) {
+        emit(compare);
+        emit("movq rax, %s", result);
+        emit("and eax, 1");
+        emit("mov qword ptr [rsp], rax");
+    }
+    else
+        emit("movsd qword ptr [rsp], xmm0");
+}
+
+// Layout, from the top of the stack down: the loop variables i0..iN, the bounds b0..bN, then the array pointer
+// or the sum. The bounds and pointer together are already the resulting array value. The innermost loop runs
+// two iterations at a time through the packed body while at least two remain, then finishes one at a time.
+void asm_loop_expr(uint32_t expr_index) {
+    AstNode *expr = nodevec_get(node_list, expr_index);
+    if (!expr) return;
+
+    ChildList var_list = expr->field1.list;
+    ChildList bound_list = expr->field2.list;
+    int64_t rank = childlist_size(var_list);
+    int is_array = expr->type.expr == ARRAYLOOP_EXPR;
+    AstNode *type = get_expr_type(expr_index);
+    uint64_t element_type = is_array ? type->field2.node : expr->field4.node;
+    int64_t element = type_size(element_type);
+    int is_float = nodevec_get(node_list, element_type)->type.type == FLOAT_TYPE;
+
+    StringRef vars[rank];
+    for (int64_t i = 0; i < rank; ++i)
+        vars[i] = symbol_name(nodevec_get(node_list, childlist_get(var_list, i))->symbol);
+    int packed = is_float && is_packable(expr->field3.node, intern_ref(vars[rank - 1]));
+
+    emit("push 0");
+    depth += WORD;
+    int64_t result = depth;
+    int64_t packed_sum = 0;
+    if (packed && !is_array) {
+        emit_reserve(PACKED);
+        emit("xorpd xmm0, xmm0");
+        emit("movupd [rsp], xmm0");
+        packed_sum = depth;
+    }
+
+    int64_t bounds[rank];
+    for (int64_t i = rank; i > 0; --i) {
+        asm_expr(childlist_get(bound_list, i - 1));
+        emit("cmp qword ptr [rsp], 0");
+        emit("jle .Lloop");
+        bounds[i - 1] = depth;
+    }
+
+    if (is_array) {
+        emit("mov rdi, %ld", element);
+        for (int64_t i = 0; i < rank; ++i)
+            emit("imul rdi, qword ptr [rbp-%ld]", bounds[i]);
+        emit_call("jpl_alloc");
+        emit("mov qword ptr [rbp-%ld], rax", result);
+    }
+
+    int64_t indices[rank];
+    for (int64_t i = rank; i > 0; --i) {
+        emit("push 0");
+        depth += WORD;
+        indices[i - 1] = depth;
+        bind_symbol(vars[i - 1], -depth);
+    }
+
+    int64_t last = rank - 1;
+    uint32_t body = label_count++;
+    uint32_t scalar = label_count++;
+    uint32_t next = label_count++;
+    emit_label(body);
+
+    if (packed) {
+        uint32_t pair = label_count++;
+        emit_label(pair);
+        emit("mov rax, qword ptr [rbp-%ld]", indices[last]);
+        emit("lea r10, [rax+1]");
+        emit("cmp r10, qword ptr [rbp-%ld]", bounds[last]);
+        emit("jge .L%u", scalar);
+
+        asm_packed_expr(expr->field3.node, vars[last]);
+        emit("movupd xmm0, [rsp]");
+        if (is_array) {
+            emit("mov rax, qword ptr [rbp-%ld]", indices[0]);
+            for (int64_t i = 1; i < rank; ++i) {
+                emit("imul rax, qword ptr [rbp-%ld]", bounds[i]);
+                emit("add rax, qword ptr [rbp-%ld]", indices[i]);
+            }
+            emit("mov r10, qword ptr [rbp-%ld]", result);
+            emit("movupd [r10+rax*8], xmm0");
+        }
+        else {
+            emit("movupd xmm1, [rbp-%ld]", packed_sum);
+            emit("addpd xmm1, xmm0");
+            emit("movupd [rbp-%ld], xmm1", packed_sum);
+        }
+        emit_release(PACKED);
+        emit("add qword ptr [rbp-%ld], 2", indices[last]);
+        emit("jmp .L%u", pair);
+    }
+
+    emit_label(scalar);
+    emit("mov rax, qword ptr [rbp-%ld]", indices[last]);
+    emit("cmp rax, qword ptr [rbp-%ld]", bounds[last]);
+    emit("jge .L%u", next);
+
+    asm_expr(expr->field3.node);
+    if (is_array) {
+        emit("mov rax, qword ptr [rbp-%ld]", indices[0]);
+        for (int64_t i = 1; i < rank; ++i) {
+            emit("imul rax, qword ptr [rbp-%ld]", bounds[i]);
+            emit("add rax, qword ptr [rbp-%ld]", indices[i]);
+        }
+        emit("imul rax, rax, %ld", element);
+        emit("add rax, qword ptr [rbp-%ld]", result);
+        emit_copy("rsp", 0, "rax", 0, element);
+        emit_release(element);
+    }
+    else if (is_float) {
+        emit("movsd xmm0, qword ptr [rbp-%ld]", result);
+        emit("addsd xmm0, qword ptr [rsp]");
+        emit("movsd qword ptr [rbp-%ld], xmm0", result);
+        emit_release(WORD);
+    }
+    else {
+        emit_pop("rax");
+        emit("add qword ptr [rbp-%ld], rax", result);
+    }
+    emit("inc qword ptr [rbp-%ld]", indices[last]);
+    emit("jmp .L%u", scalar);
+
+    // Outer loop variables step like an odometer
+    emit_label(next);
+    emit("mov qword ptr [rbp-%ld], 0", indices[last]);
+    for (int64_t i = last - 1; i >= 0; --i) {
+        emit("inc qword ptr [rbp-%ld]", indices[i]);
+        emit("mov rax, qword ptr [rbp-%ld]", indices[i]);
+        emit("cmp rax, qword ptr [rbp-%ld]", bounds[i]);
+        emit("jl .L%u", body);
+        emit("mov qword ptr [rbp-%ld], 0", indices[i]);
+    }
+
+    emit_release(WORD * rank);
+    for (int64_t i = 0; i < rank; ++i)
+        dict_remove_ref(symbols, vars[i]);
+    if (is_array) return;
+
+    if (packed) {
+        emit("movupd xmm0, [rbp-%ld]", packed_sum);
+        emit("movapd xmm1, xmm0");
+        emit("unpckhpd xmm1, xmm1");
+        emit("addsd xmm0, xmm1");
+        emit("addsd xmm0, qword ptr [rbp-%ld]", result);
+        emit("movsd qword ptr [rbp-%ld], xmm0", result);
+    }
+    emit_release(WORD * rank + (packed ? PACKED : 0));
+}
+
+// Whether a float expression can be evaluated for two consecutive values of the given loop variable at once:
+// arithmetic and sqrt over constants, loop-invariant float variables, and float arrays indexed by integer
+// variables whose last index is the loop variable, so both lanes load from adjacent elements.
+int is_packable(uint32_t expr_index, uint32_t var) {
+    AstNode *expr = nodevec_get(node_list, expr_index);
+    if (!expr || get_expr_type(expr_index)->type.type != FLOAT_TYPE) return 0;
+
+    switch (expr->type.expr) {
+        case FLOAT_EXPR:
+        case VAR_EXPR:
+            return 1;
+        case UNOP_EXPR:
+            return is_packable(expr->field1.node, var);
+        case BINOP_EXPR:
+            if (*symbol_name(expr->symbol).string == '%') return 0;
+            return is_packable(expr->field1.node, var) && is_packable(expr->field2.node, var);
+        case CALL_EXPR:
+            if (ref_array_cmp(symbol_name(expr->symbol), "sqrt")) return 0;
+            return is_packable(childlist_get(expr->field1.list, 0), var);
+        case ARRAYINDEX_EXPR: {
+            if (nodevec_get(node_list, expr->field1.node)->type.expr != VAR_EXPR) return 0;
+
+            ChildList list = expr->field2.list;
+            for (size_t i = 0; i < childlist_size(list); ++i) {
+                AstNode *index = nodevec_get(node_list, childlist_get(list, i));
+                if (index->type.expr != VAR_EXPR) return 0;
+                if ((index->symbol == var) != (i == childlist_size(list) - 1)) return 0;
+            }
+            return 1;
+        }
+        default:
+            return 0;
+    }
+}
+
+// Pushes a packed pair of float values for the current and next value of the given loop variable.
+void asm_packed_expr(uint32_t expr_index, StringRef var) {
+    AstNode *expr = nodevec_get(node_list, expr_index);
+    if (!expr) return;
+
+    char address[MAXIMUM_BUFFER];
+    switch (expr->type.expr) {
+        case FLOAT_EXPR: {
+            uint64_t bits;
+            memcpy(&bits, &expr->field1.float_value, sizeof(bits));
+            emit("mov rax, %#lx", bits);
+            emit("movq xmm0, rax");
+            emit("unpcklpd xmm0, xmm0");
+            break;
+        }
+        case VAR_EXPR:
+            var_address(symbol_name(expr->symbol), 0, address);
+            emit("movsd xmm0, %s", address);
+            emit("unpcklpd xmm0, xmm0");
+            break;
+        case UNOP_EXPR:
+            asm_packed_expr(expr->field1.node, var);
+            emit("mov rax, 0x8000000000000000");
+            emit("movq xmm1, rax");
+            emit("unpcklpd xmm1, xmm1");
+            emit("movupd xmm0, [rsp]");
+            emit("xorpd xmm0, xmm1");
+            emit("movupd [rsp], xmm0");
+            return;
+        case BINOP_EXPR: {
+            asm_packed_expr(expr->field1.node, var);
+            asm_packed_expr(expr->field2.node, var);
+            emit("movupd xmm1, [rsp]");
+            emit_release(PACKED);
+            emit("movupd xmm0, [rsp]");
+            const char *op = "addpd";
+            switch (*symbol_name(expr->symbol).string) {
+                case '-': op = "subpd"; break;
+                case '*': op = "mulpd"; break;
+                case '/': op = "divpd"; break;
+            }
+            emit("%s xmm0, xmm1", op);
+            emit("movupd [rsp], xmm0");
+            return;
+        }
+        case CALL_EXPR:
+            asm_packed_expr(childlist_get(expr->field1.list, 0), var);
+            emit("movupd xmm0, [rsp]");
+            emit("sqrtpd xmm0, xmm0");
+            emit("movupd [rsp], xmm0");
+            return;
+        case ARRAYINDEX_EXPR: {
+            // Both lanes must be in bounds. The loop variable is never negative.
+            StringRef array = symbol_name(nodevec_get(node_list, expr->field1.node)->symbol);
+            ChildList list = expr->field2.list;
+            size_t last = childlist_size(list) - 1;
+            for (size_t i = 0; i <= last; ++i) {
+                var_address(symbol_name(nodevec_get(node_list, childlist_get(list, i))->symbol), 0, address);
+                emit("mov r10, %s", address);
+                var_address(array, WORD * i, address);
+                if (i == last) {
+                    emit("lea r11, [r10+1]");
+                    emit("cmp r11, %s", address);
+                }
+                else {
+                    emit("test r10, r10");
+                    emit("js .Lbounds");
+                    emit("cmp r10, %s", address);
+                }
+                emit("jge .Lbounds");
+                if (!i)
+                    emit("mov rax, r10");
+                else {
+                    emit("imul rax, %s", address);
+                    emit("add rax, r10");
+                }
+            }
+            var_address(array, WORD * childlist_size(list), address);
+            emit("mov r11, %s", address);
+            emit("movupd xmm0, [r11+rax*8]");
+            break;
+        }
+        default:
+            break;
+    }
+
+    emit_reserve(PACKED);
+    emit("movupd [rsp], xmm0");
+}
@@ -0,0 +1,452 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "astfile.h"
+
+#define ALIGN_UP(n) (((n) + AST_ALIGN - 1) & ~((size_t) AST_ALIGN - 1))
+#define NO_STRING UINT64_MAX
+
+// Where each section starts, worked out from the header alone
+typedef struct {
+    size_t strings;
+    size_t kinds;
+    size_t offsets;
+    size_t lengths;
+    size_t nodes;
+    size_t cmds;
+    size_t pool;
+    size_t symbols;
+    size_t names;
+    size_t end;
+} AstLayout;
+
+static AstLayout ast_layout(AstHeader *header) {
+    AstLayout layout;
+    layout.strings = ALIGN_UP(sizeof(AstHeader));
+    layout.kinds = ALIGN_UP(layout.strings + header->string_size);
+    layout.offsets = ALIGN_UP(layout.kinds + header->token_count);
+    layout.lengths = ALIGN_UP(layout.offsets + sizeof(uint32_t) * header->token_count);
+    layout.nodes = ALIGN_UP(layout.lengths + sizeof(uint32_t) * header->token_count);
+    layout.cmds = ALIGN_UP(layout.nodes + sizeof(SavedNode) * header->node_count);
+    layout.pool = ALIGN_UP(layout.cmds + sizeof(uint32_t) * header->cmd_count);
+    layout.symbols = ALIGN_UP(layout.pool + sizeof(uint32_t) * header->pool_size);
+    layout.names = ALIGN_UP(layout.symbols + sizeof(SavedSymbol) * header->symbol_count);
+    layout.end = layout.names + sizeof(SavedName) * header->name_count;
+    return layout;
+}
+
+// Hashes the sections one after another, each seeded with the hash so far
+static void checksum_add(uint64_t checksum[2], void *data, size_t size) {
+    hash_string_128(data, size, checksum[0] ^ checksum[1], checksum);
+}
+
+static void ast_checksum(AstHeader *header, char *source, char *extras, uint8_t *kinds, uint32_t *offsets,
+                         uint32_t *lengths, SavedNode *nodes, uint32_t *cmds, uint32_t *pool, SavedSymbol *symbols,
+                         SavedName *names, uint64_t checksum[2]) {
+    checksum[0] = AST_VERSION;
+    checksum[1] = header->string_size;
+    checksum_add(checksum, source, header->source_size);
+    checksum_add(checksum, extras, header->string_size - header->source_size);
+    checksum_add(checksum, kinds, header->token_count);
+    checksum_add(checksum, offsets, sizeof(uint32_t) * header->token_count);
+    checksum_add(checksum, lengths, sizeof(uint32_t) * header->token_count);
+    checksum_add(checksum, nodes, sizeof(SavedNode) * header->node_count);
+    checksum_add(checksum, cmds, sizeof(uint32_t) * header->cmd_count);
+    checksum_add(checksum, pool, sizeof(uint32_t) * header->pool_size);
+    checksum_add(checksum, symbols, sizeof(SavedSymbol) * header->symbol_count);
+    checksum_add(checksum, names, sizeof(SavedName) * header->name_count);
+}
+
+// Places the text of every symbol in a string section made of the source followed by 'extras': at a token that
+// spells it where there is one, otherwise appended to 'extras'. Returns the offsets, indexed by symbol.
+uint64_t *symbol_offsets(TokenVec *tokens, size_t source_size, CVec *extras) {
+    uint32_t symbols = symbol_count();
+    uint64_t *offsets = malloc(sizeof(uint64_t) * (symbols + 1)); if (!offsets) exit(EXIT_FAILURE);
+    for (uint32_t i = 0; i <= symbols; ++i)
+        offsets[i] = NO_STRING;
+
+    uint32_t symbol;
+    for (size_t i = 0; i < tokens->size; ++i)
+        if ((uint64_t) tokens->offsets[i] + tokens->lengths[i] <= source_size
+            && intern_find(tokenvec_string(tokens, i), &symbol) && symbol <= symbols)
+            offsets[symbol] = tokens->offsets[i];
+
+    for (uint32_t i = 1; i <= symbols; ++i) {
+        if (offsets[i] != NO_STRING) continue;
+
+        StringRef text = symbol_name(i);
+        offsets[i] = source_size + cvec_size(extras);
+        cvec_append_array(extras, text.string, text.length);
+    }
+    return offsets;
+}
+
+// Pads a section of 'size' bytes with zeros up to the next section boundary
+static int write_padding(FILE *file, size_t size) {
+    static const char zeros[AST_ALIGN];
+    size_t pad = ALIGN_UP(size) - size;
+    return !pad || fwrite(zeros, 1, pad, file) == pad;
+}
+
+static int write_section(FILE *file, void *data, size_t size) {
+    if (size && fwrite(data, 1, size, file) != size) return 0;
+    return write_padding(file, size);
+}
+
+// Saves a type-checked program. The file is written under a temporary name and renamed into place, so a reader
+// never maps half a program.
+int ast_save(char *path, size_t source_size, TokenVec *tokens, NodeVec *nodes, Vector *cmds, Dict *declarations) {
+    if (!path || !tokens || !nodes || !cmds) return EXIT_FAILURE;
+
+    char *source = tokens->source;
+    CVec *extras = cvec_create(); if (!extras) return EXIT_FAILURE;
+
+    SavedNode *saved_nodes = malloc(sizeof(SavedNode) * (nodes->size + 1));
+    uint32_t *saved_cmds = malloc(sizeof(uint32_t) * (cmds->size + 1));
+    SavedName *saved_names = malloc(sizeof(SavedName) * ((declarations ? declarations->size : 0) + 1));
+    uint32_t symbols = symbol_count();
+    SavedSymbol *saved_symbols = malloc(sizeof(SavedSymbol) * (symbols + 1));
+    if (!saved_nodes || !saved_cmds || !saved_names || !saved_symbols) exit(EXIT_FAILURE);
+
+    uint64_t *offsets = symbol_offsets(tokens, source_size, extras);
+    for (uint32_t i = 1; i <= symbols; ++i)
+        saved_symbols[i - 1] = (SavedSymbol) { offsets[i], symbol_name(i).length };
+    free(offsets);
+
+    for (size_t i = 0; i < nodes->size; ++i) {
+        AstNode *node = &nodes->array[i];
+        saved_nodes[i] = (SavedNode) { node->token_index, node->type.cmd, node->field1.int_value, node->field2.node,
+                                       node->field3.node, node->field4.node, node->symbol };
+    }
+
+    for (size_t i = 0; i < cmds->size; ++i)
+        saved_cmds[i] = (uint64_t) vector_get(cmds, i);
+
+    size_t name_count = 0;
+    size_t cursor = 0;
+    StringRef name;
+    void *value;
+    uint32_t symbol;
+    while (dict_next(declarations, &cursor, &name, &value))
+        if (intern_find(name, &symbol))
+            saved_names[name_count++] = (SavedName) { symbol, (uint64_t) value };
+
+    size_t pool_size;
+    uint32_t *pool = childlist_pool(&pool_size);
+
+    AstHeader header = { AST_MAGIC, AST_VERSION, sizeof(SavedNode), source_size,
+                         source_size + cvec_size(extras), tokens->size, nodes->size, cmds->size, pool_size,
+                         symbols, name_count, {0} };
+    ast_checksum(&header, source, extras->array, tokens->kinds, tokens->offsets, tokens->lengths, saved_nodes,
+                 saved_cmds, pool, saved_symbols, saved_names, header.checksum);
+
+    char temp[strlen(path) + 8];
+    snprintf(temp, sizeof(temp), "%s.XXXXXX", path);
+    int fd = mkstemp(temp);
+    if (fd >= 0) fchmod(fd, 0644);
+    FILE *file = fd < 0 ? NULL : fdopen(fd, "wb");
+
+    int written = file
+        && write_section(file, &header, sizeof(header))
+        && fwrite(source, 1, source_size, file) == source_size
+        && fwrite(extras->array, 1, cvec_size(extras), file) == cvec_size(extras)
+        && write_padding(file, header.string_size)
+        && write_section(file, tokens->kinds, tokens->size)
+        && write_section(file, tokens->offsets, sizeof(uint32_t) * tokens->size)
+        && write_section(file, tokens->lengths, sizeof(uint32_t) * tokens->size)
+        && write_section(file, saved_nodes, sizeof(SavedNode) * nodes->size)
+        && write_section(file, saved_cmds, sizeof(uint32_t) * cmds->size)
+        && write_section(file, pool, sizeof(uint32_t) * pool_size)
+        && write_section(file, saved_symbols, sizeof(SavedSymbol) * symbols)
+        && write_section(file, saved_names, sizeof(SavedName) * name_count);
+
+    if (file && fclose(file) != 0) written = 0;
+    else if (!file && fd >= 0) close(fd);
+    if (fd >= 0 && (!written || rename(temp, path) != 0)) {
+        unlink(temp);
+        written = 0;
+    }
+
+    cvec_destroy(extras);
+    free(saved_nodes);
+    free(saved_cmds);
+    free(saved_names);
+    free(saved_symbols);
+    return written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// A saved program is walked from its commands and names, the way the stages after type checking walk it, since
+// which fields hold node indices and child lists depends on what a node is reached as. A node is checked once
+// for each category it is reached as, with a bit for each in 'entered' and 'left'. The walk is depth first, so
+// reaching a node that was entered but not yet left is a cycle, which those stages would follow forever.
+#define LEAVING 0x80
+
+typedef struct {
+    AstHeader *header;
+    SavedNode *nodes;
+    uint32_t *pool;
+    uint32_t *declared;
+    uint8_t *entered;
+    uint8_t *left;
+    U32Vec stack;
+} LinkCheck;
+
+static int reach(LinkCheck *check, uint64_t node, NodeCategory category) {
+    if (node >= check->header->node_count) return 0;
+
+    u32vec_append(&check->stack, node);
+    u32vec_append(&check->stack, category);
+    return 1;
+}
+
+static int reach_list(LinkCheck *check, uint32_t list, NodeCategory category) {
+    if (!list) return 1;
+    if (list >= check->header->pool_size || check->pool[list] >= check->header->pool_size - list) return 0;
+
+    for (uint32_t i = 0; i < check->pool[list]; ++i)
+        if (!reach(check, check->pool[list + 1 + i], category)) return 0;
+    return 1;
+}
+
+// Checks the fields of one node that the given category reads, queueing the nodes they lead to
+static int node_links_valid(LinkCheck *check, SavedNode *node, NodeCategory category) {
+    uint32_t field1 = (uint32_t) node->field1;
+    switch (category) {
+        case COMMAND_NODE:
+            switch (node->type) {
+                case READ_CMD:
+                    return reach(check, field1, LVALUE_NODE) && reach(check, node->field2, TYPE_NODE);
+                case LET_CMD:
+                    return reach(check, field1, LVALUE_NODE) && reach(check, node->field3, EXPRESSION_NODE);
+                case WRITE_CMD:
+                case ASSERT_CMD:
+                case SHOW_CMD:
+                    return reach(check, field1, EXPRESSION_NODE);
+                case PRINT_CMD:
+                    return 1;
+                case TIME_CMD:
+                    return reach(check, field1, COMMAND_NODE);
+                case FN_CMD:
+                    return reach_list(check, field1, BINDING_NODE) && reach(check, node->field2, TYPE_NODE)
+                        && reach_list(check, node->field3, STATEMENT_NODE);
+                case STRUCT_CMD:
+                    return reach_list(check, field1, MEMBER_NODE) && reach(check, node->field2, TYPE_NODE);
+                default:
+                    return 0;
+            }
+        case EXPRESSION_NODE:
+            if (node->type > SUMLOOP_EXPR || !reach(check, node->field4, TYPE_NODE)) return 0;
+            switch (node->type) {
+                case ARRAYLITERAL_EXPR:
+                case STRUCTLITERAL_EXPR:
+                case CALL_EXPR:
+                    return reach_list(check, field1, EXPRESSION_NODE);
+                case ARRAYINDEX_EXPR:
+                    return reach(check, field1, EXPRESSION_NODE) && reach_list(check, node->field2, EXPRESSION_NODE);
+                case IF_EXPR:
+                    return reach(check, field1, EXPRESSION_NODE) && reach(check, node->field2, EXPRESSION_NODE)
+                        && reach(check, node->field3, EXPRESSION_NODE);
+                case BINOP_EXPR:
+                    return reach(check, field1, EXPRESSION_NODE) && reach(check, node->field2, EXPRESSION_NODE);
+                case DOT_EXPR:
+                case UNOP_EXPR:
+                    return reach(check, field1, EXPRESSION_NODE);
+                case ARRAYLOOP_EXPR:
+                case SUMLOOP_EXPR:
+                    return reach_list(check, field1, LVALUE_NODE) && reach_list(check, node->field2, EXPRESSION_NODE)
+                        && reach(check, node->field3, EXPRESSION_NODE);
+                default:
+                    return 1;
+            }
+        case LVALUE_NODE:
+            if (node->type > ARRAY_LVALUE || !reach(check, node->field2, TYPE_NODE)) return 0;
+            return node->type != ARRAY_LVALUE || reach_list(check, field1, LVALUE_NODE);
+        case STATEMENT_NODE:
+            switch (node->type) {
+                case LET_STMT:
+                    return reach(check, field1, LVALUE_NODE) && reach(check, node->field3, EXPRESSION_NODE);
+                case ASSERT_STMT:
+                    return reach(check, field1, EXPRESSION_NODE);
+                case RETURN_STMT:
+                    return reach(check, field1, EXPRESSION_NODE) && reach(check, node->field2, TYPE_NODE);
+                default:
+                    return 0;
+            }
+        case TYPE_NODE:
+            if (node->type > VAR_TYPE) return 0;
+            if (node->type == ARRAY_TYPE) return reach(check, node->field2, TYPE_NODE);
+            // A struct type is looked up by name to find its members
+            if (node->type == STRUCT_TYPE && node->symbol != NUMBER_SYMBOL && check->declared[node->symbol]) {
+                SavedNode *cmd = &check->nodes[check->declared[node->symbol] - 1];
+                return cmd->type == STRUCT_CMD && reach_list(check, (uint32_t) cmd->field1, MEMBER_NODE);
+            }
+            return 1;
+        case BINDING_NODE:
+            return reach(check, field1, LVALUE_NODE) && reach(check, node->field2, TYPE_NODE);
+        case MEMBER_NODE:
+            return reach(check, node->field2, TYPE_NODE);
+        default:
+            return 0;
+    }
+}
+
+// Checks every index a saved program holds against the count of what it indexes
+static int links_valid(char *data, AstHeader *header, AstLayout layout) {
+    uint8_t *kinds = (uint8_t *) (data + layout.kinds);
+    uint32_t *offsets = (uint32_t *) (data + layout.offsets);
+    uint32_t *lengths = (uint32_t *) (data + layout.lengths);
+    for (size_t i = 0; i < header->token_count; ++i) {
+        if (kinds[i] > COMMENT || offsets[i] > header->source_size) return 0;
+        // The end of the file is one byte long, past the source but still inside the buffer
+        if (kinds[i] != END_OF_FILE && (uint64_t) offsets[i] + lengths[i] > header->source_size) return 0;
+    }
+
+    SavedSymbol *symbols = (SavedSymbol *) (data + layout.symbols);
+    for (size_t i = 0; i < header->symbol_count; ++i)
+        if (symbols[i].offset > header->string_size || symbols[i].length > header->string_size - symbols[i].offset)
+            return 0;
+
+    LinkCheck check = { header, (SavedNode *) (data + layout.nodes), (uint32_t *) (data + layout.pool),
+                        calloc(header->symbol_count + 1, sizeof(uint32_t)), calloc(header->node_count + 1, 1),
+                        calloc(header->node_count + 1, 1), {0} };
+    if (!check.declared || !check.entered || !check.left) exit(EXIT_FAILURE);
+
+    int valid = 1;
+    for (size_t i = 0; valid && i < header->node_count; ++i) {
+        SavedNode *node = &check.nodes[i];
+        valid = node->token_index < header->token_count && (node->symbol <= header->symbol_count
+            || (node->symbol == NUMBER_SYMBOL && node->field2 < header->token_count));
+    }
+
+    SavedName *names = (SavedName *) (data + layout.names);
+    for (size_t i = 0; valid && i < header->name_count; ++i) {
+        SavedName *name = &names[i];
+        valid = name->symbol != NO_SYMBOL && name->symbol <= header->symbol_count && !check.declared[name->symbol]
+            && name->node < header->node_count && reach(&check, check.nodes[name->node].field2, TYPE_NODE);
+        if (valid) check.declared[name->symbol] = name->node + 1;
+    }
+
+    uint32_t *cmds = (uint32_t *) (data + layout.cmds);
+    for (size_t i = 0; valid && i < header->cmd_count; ++i)
+        valid = reach(&check, cmds[i], COMMAND_NODE);
+
+    while (valid && check.stack.size) {
+        uint32_t category = u32vec_pop_last(&check.stack);
+        uint32_t node = u32vec_pop_last(&check.stack);
+        uint8_t bit = 1 << (category & ~LEAVING);
+        if (category & LEAVING) {
+            check.left[node] |= bit;
+            continue;
+        }
+        if (check.entered[node] & bit) {
+            valid = (check.left[node] & bit) != 0;
+            continue;
+        }
+
+        check.entered[node] |= bit;
+        u32vec_append(&check.stack, node);
+        u32vec_append(&check.stack, category | LEAVING);
+        valid = node_links_valid(&check, &check.nodes[node], category);
+    }
+
+    u32vec_release(&check.stack);
+    free(check.declared);
+    free(check.entered);
+    free(check.left);
+    return valid;
+}
+
+// Checks that a buffer holds a program saved by this version, with every section inside it and every index
+// inside what it indexes
+int ast_valid(char *data, size_t size) {
+    if (!data || size < sizeof(AstHeader)) return 0;
+
+    AstHeader *header = (AstHeader *) data;
+    if (memcmp(header->magic, AST_MAGIC, sizeof(header->magic)) || header->version != AST_VERSION) return 0;
+    if (header->node_size != sizeof(SavedNode) || header->source_size > header->string_size) return 0;
+    if (header->source_size > MAX_SOURCE_SIZE) return 0;
+
+    // Counts large enough to wrap the layout around cannot come from a file that fits in memory
+    if ((header->string_size | header->token_count | header->node_count | header->cmd_count | header->pool_size |
+         header->symbol_count | header->name_count) >> 40) return 0;
+
+    // Indices are 32 bits wide
+    if ((header->token_count | header->node_count | header->pool_size | header->symbol_count) >> 32) return 0;
+
+    AstLayout layout = ast_layout(header);
+    if (layout.end > size) return 0;
+
+    uint64_t checksum[2];
+    char *strings = data + layout.strings;
+    ast_checksum(header, strings, strings + header->source_size, (uint8_t *) (data + layout.kinds),
+                 (uint32_t *) (data + layout.offsets), (uint32_t *) (data + layout.lengths),
+                 (SavedNode *) (data + layout.nodes), (uint32_t *) (data + layout.cmds),
+                 (uint32_t *) (data + layout.pool), (SavedSymbol *) (data + layout.symbols),
+                 (SavedName *) (data + layout.names), checksum);
+    if (checksum[0] != header->checksum[0] || checksum[1] != header->checksum[1]) return 0;
+
+    return links_valid(data, header, layout);
+}
+
+// The size of the source a saved program was compiled from, or 0 when the buffer holds no saved program
+uint64_t ast_source_size(char *data, size_t size) {
+    if (!data || size < sizeof(AstHeader)) return 0;
+    AstHeader *header = (AstHeader *) data;
+    return memcmp(header->magic, AST_MAGIC, sizeof(header->magic)) ? 0 : header->source_size;
+}
+
+// The source text inside a saved program, which diagnostics locate tokens in
+char *ast_source(char *data, size_t *size) {
+    AstHeader *header = (AstHeader *) data;
+    *size = header->source_size;
+    return data + ast_layout(header).strings;
+}
+
+// Loads a program from a buffer that ast_valid accepted, typically a mapped file. Tokens and the source are used
+// in place, so the buffer must outlive the compilation. Nodes are copied, since their symbols are interned again.
+int ast_load(char *data, size_t size, TokenVec **tokens, NodeVec **nodes, Vector **cmds, Dict **declarations) {
+    if (!ast_valid(data, size)) return EXIT_FAILURE;
+
+    AstHeader *header = (AstHeader *) data;
+    AstLayout layout = ast_layout(header);
+    char *strings = data + layout.strings;
+
+    *tokens = tokenvec_view(strings, (uint8_t *) (data + layout.kinds), (uint32_t *) (data + layout.offsets),
+                            (uint32_t *) (data + layout.lengths), header->token_count);
+    *nodes = nodevec_create_cap(header->node_count + 1);
+    *cmds = vector_create_arena(compile_arena(), header->cmd_count + 1);
+    *declarations = dict_create_big();
+    if (!*tokens || !*nodes || !*cmds || !*declarations) return EXIT_FAILURE;
+
+    // Saved symbol ids become the ids of this thread's interner
+    SavedSymbol *saved_symbols = (SavedSymbol *) (data + layout.symbols);
+    uint32_t *symbols = arena_alloc(compile_arena(), sizeof(uint32_t) * (header->symbol_count + 1));
+    symbols[0] = NO_SYMBOL;
+    for (size_t i = 0; i < header->symbol_count; ++i)
+        symbols[i + 1] = intern_ref((StringRef) {saved_symbols[i].length, strings + saved_symbols[i].offset});
+
+    SavedNode *saved_nodes = (SavedNode *) (data + layout.nodes);
+    for (size_t i = 0; i < header->node_count; ++i) {
+        SavedNode *saved = &saved_nodes[i];
+        AstNode node = create_node(saved->token_index, saved->type, 0, saved->field2, saved->field3, saved->field4);
+        node.field1.int_value = saved->field1;
+        node.symbol = saved->symbol == NUMBER_SYMBOL ? NUMBER_SYMBOL : symbols[saved->symbol];
+        nodevec_append(*nodes, node);
+    }
+
+    uint32_t *saved_cmds = (uint32_t *) (data + layout.cmds);
+    for (size_t i = 0; i < header->cmd_count; ++i)
+        vector_append(*cmds, (void*) (uint64_t) saved_cmds[i]);
+
+    childlist_load((uint32_t *) (data + layout.pool), header->pool_size);
+
+    SavedName *saved_names = (SavedName *) (data + layout.names);
+    for (size_t i = 0; i < header->name_count; ++i) {
+        SavedName *saved = &saved_names[i];
+        dict_add_ref(*declarations, symbol_name(symbols[saved->symbol]), (void*) (uint64_t) saved->node);
+    }
+
+    return EXIT_SUCCESS;
+}
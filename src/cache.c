@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "dict.h"
+
+#define KEY_SEED 0x6a706c63
+
+#define BUILD_CHUNK 65536
+
+static char *cache_dir;
+static size_t cache_hits;
+static size_t cache_misses;
+static uint64_t build_hash[2];
+
+// Hashes the running compiler, so that a rebuilt one never replays what an older one printed. A binary that
+// cannot be read leaves the hash at zero, and CACHE_VERSION alone tells builds apart.
+static void hash_build() {
+    FILE *file = fopen("/proc/self/exe", "rb");
+    if (!file) return;
+
+    char chunk[BUILD_CHUNK];
+    uint64_t hash[2] = {KEY_SEED, 0};
+    size_t size;
+    while ((size = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        hash_string_128(chunk, size, hash[0] ^ hash[1], hash);
+    if (!ferror(file)) memcpy(build_hash, hash, sizeof(hash));
+    fclose(file);
+}
+
+// Enables the cache in 'dir'. Entries are one file each, named after their key.
+void cache_setup(char *dir) {
+    if (!cache_dir) hash_build();
+    cache_dir = dir;
+}
+
+int cache_enabled() {
+    return cache_dir != NULL;
+}
+
+// The context holds the mode, file name and flags, which all change what a compilation prints. The hash of the
+// compiler itself goes in as well.
+CacheKey cache_key(char *source, size_t size, char *context, size_t context_size) {
+    CacheKey key = { {0, 0}, size };
+    uint64_t source_hash[2];
+
+    hash_string_128(source, size, KEY_SEED, source_hash);
+    hash_string_128(context, context_size, source_hash[0] ^ source_hash[1], key.hash);
+    key.hash[0] ^= build_hash[0];
+    key.hash[1] ^= build_hash[1];
+    return key;
+}
+
+static int entry_path(CacheKey *key, char *suffix, char *path) {
+    int len = snprintf(path, CACHE_PATH, "%s/%016" PRIx64 "%016" PRIx64 "%s", cache_dir, key->hash[0], key->hash[1],
+                       suffix);
+    return len > 0 && len < CACHE_PATH;
+}
+
+// Names the file for an entry that the caller reads and writes itself, and makes sure its directory exists
+int cache_path(CacheKey *key, char *suffix, char *path) {
+    if (!cache_dir || !entry_path(key, suffix, path)) return 0;
+
+    return mkdir(cache_dir, 0755) == 0 || errno == EEXIST;
+}
+
+// Counts a lookup made through cache_path
+void cache_count(int hit) {
+    __atomic_fetch_add(hit ? &cache_hits : &cache_misses, 1, __ATOMIC_RELAXED);
+}
+
+// Reads the output and exit status stored under 'key'. Returns 1 on a hit; the output must then be freed.
+int cache_load(CacheKey *key, char **output, size_t *size, int *status) {
+    char path[CACHE_PATH];
+    if (!cache_dir || !entry_path(key, "", path)) return 0;
+
+    FILE *file = fopen(path, "rb");
+    CacheHeader header;
+    int hit = file && fread(&header, sizeof(header), 1, file) == 1
+        && !memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) && header.version == CACHE_VERSION
+        && !memcmp(&header.key, key, sizeof(CacheKey));
+
+    if (hit) {
+        *output = malloc(header.output_size + 1);
+        hit = *output && fread(*output, 1, header.output_size, file) == header.output_size;
+        if (!hit) free(*output);
+    }
+    if (file) fclose(file);
+
+    if (hit) {
+        *size = header.output_size;
+        *status = header.status;
+    }
+    cache_count(hit);
+    return hit;
+}
+
+// Entries are written to a temporary file and renamed into place, so readers never see half an entry.
+// Failing to store is not an error; the next compilation simply misses again.
+void cache_store(CacheKey *key, char *output, size_t size, int status) {
+    char path[CACHE_PATH];
+    char temp[CACHE_PATH + 8];
+    if (!cache_path(key, "", path)) return;
+
+    snprintf(temp, sizeof(temp), "%s.XXXXXX", path);
+    int fd = mkstemp(temp);
+    if (fd < 0) return;
+
+    FILE *file = fdopen(fd, "wb");
+    if (!file) {
+        close(fd);
+        unlink(temp);
+        return;
+    }
+
+    CacheHeader header = { CACHE_MAGIC, CACHE_VERSION, status, *key, size };
+    int written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(output, 1, size, file) == size;
+    if (fclose(file) != 0 || !written || rename(temp, path) != 0)
+        unlink(temp);
+}
+
+// Goes to stderr so that the compiler's own output is the same with or without the cache
+void cache_print_stats() {
+    size_t total = cache_hits + cache_misses;
+    fprintf(stderr, "Cache: %zu hits, %zu misses (%.1f%% hit rate)\n", cache_hits, cache_misses,
+            total ? 100.0 * cache_hits / total : 0.0);
+}
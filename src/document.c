@@ -0,0 +1,323 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "document.h"
+#include "lexer.h"
+#include "parser.h"
+#include "typecheck.h"
+#include "arena.h"
+#include "error.h"
+
+// The segments of a document as they are made, along with their parse errors
+typedef struct { Segment *items; size_t size; size_t capacity; ParseErrorList errors; } SegmentList;
+
+static void segment_push(SegmentList *list, Segment segment) {
+    if (list->size == list->capacity)
+        list->items = array_grow(list->items, &list->capacity, sizeof(Segment), 64);
+    list->items[list->size++] = segment;
+}
+
+// A segment is where the lexer can restart if it follows a NEWLINE, since the lexer carries nothing else
+// from one line to the next
+static int is_stable(Document *doc, size_t segment) {
+    uint32_t first = doc->segments[segment].first_token;
+    return first == 0 || tokenvec_kind(doc->tokens, first - 1) == NEWLINE;
+}
+
+// The byte a stable segment starts at, just past the NEWLINE before it
+static int64_t segment_byte(Document *doc, size_t segment) {
+    uint32_t first = doc->segments[segment].first_token;
+    return first ? doc->tokens->offsets[first - 1] + 1 : 0;
+}
+
+static int has_lex_error(TokenVec *tokens, uint32_t first, uint32_t end) {
+    for (uint32_t i = first; i < end && i < tokens->size; ++i) {
+        TokenType kind = tokens->kinds[i];
+        if (kind == INVALID || kind == ILLEGAL || kind == UNCLOSED) return 1;
+    }
+    return 0;
+}
+
+// Parses one step at a time from 'index' until the parse reaches END_OF_FILE or the start of an old segment
+// from 'keep' on, whose tokens moved by 'shift'. Returns the old segment it stopped at, or 'count'. The parse
+// errors must be saved to the list's.
+static size_t parse_segments(Document *doc, uint32_t index, Segment *old, size_t keep, size_t count, int64_t shift,
+                             SegmentList *list) {
+    uint32_t first, cmd_index;
+    size_t first_node, first_error;
+    int kept;
+    while (1) {
+        parse_setup(doc->tokens, doc->nodes);
+        while (keep < count && old[keep].first_token + shift < index) ++keep;
+        if (keep < count && old[keep].first_token + shift == index) return keep;
+
+        // A failed command can read past END_OF_FILE, but the last segment still starts at it
+        first_node = doc->nodes->size;
+        first_error = list->errors.size;
+        if (peek_token_type(index) == END_OF_FILE || !has_token(index)) {
+            uint32_t last = doc->tokens->size - 1;
+            segment_push(list, (Segment) {index < last ? index : last, first_node, first_node, first_error, 0,
+                                          NO_COMMAND, 0});
+            return count;
+        }
+
+        first = index;
+        if (index == 0 && peek_token_type(index) == NEWLINE) {
+            segment_push(list, (Segment) {0, first_node, first_node, first_error, 0, NO_COMMAND, 0});
+            ++index;
+            continue;
+        }
+
+        kept = parse_next(&index, &cmd_index);
+        int failed = parse_status() == EXIT_FAILURE || has_lex_error(doc->tokens, first, index);
+        segment_push(list, (Segment) {first, first_node, doc->nodes->size, first_error,
+                                      list->errors.size - first_error, kept ? cmd_index : NO_COMMAND, failed});
+    }
+}
+
+static void collect_commands(Document *doc) {
+    vector_destroy(doc->cmds);
+    doc->cmds = vector_create_cap(doc->segment_count + 1);
+    if (!doc->cmds) exit(EXIT_FAILURE);
+
+    for (size_t i = 0; i < doc->segment_count; ++i)
+        if (doc->segments[i].cmd != NO_COMMAND)
+            vector_append(doc->cmds, (void*) (uint64_t) doc->segments[i].cmd);
+}
+
+// Whether the document compiles, given the status of its last type check
+static int document_status(Document *doc, int type_status) {
+    for (size_t i = 0; i < doc->segment_count; ++i)
+        if (doc->segments[i].failed) return EXIT_FAILURE;
+    return type_status;
+}
+
+// Lexes, parses and type-checks a copy of 'source' as a new document, reporting errors as usual. Any document
+// open on this thread must be closed first.
+int document_open(Document *doc, char *name, char *source, size_t size) {
+    *doc = (Document) {0};
+    doc->name = strdup(name);
+    doc->source = malloc(size + 1);
+    if (!doc->name || !doc->source) exit(EXIT_FAILURE);
+    memcpy(doc->source, source, size);
+    doc->source[size] = '\0';
+    doc->size = size;
+
+    error_setup(doc->name, doc->source, doc->size);
+    lex_string(doc->source, doc->size, &doc->tokens);
+    doc->nodes = nodevec_create_cap(doc->tokens->size + 16);
+    if (!doc->nodes) exit(EXIT_FAILURE);
+
+    SegmentList list = {0};
+    save_parse_errors(&list.errors);
+    parse_segments(doc, 0, NULL, 0, 0, 0, &list);
+    save_parse_errors(NULL);
+    doc->segments = list.items;
+    doc->segment_count = list.size;
+    doc->parse_errors = list.errors;
+    collect_commands(doc);
+
+    token_list_setup(doc->tokens);
+    int status = document_status(doc, type_check(doc->tokens, doc->nodes, doc->cmds));
+    print_errors();
+    return status;
+}
+
+// Moves the token indices in a kept segment's nodes by 'shift', with the token a number literal takes its text from.
+// Only the tokens from 'first' on moved, where the kept segments start after the edit; a node can still name a token
+// before them, such as the first one, which stays where it is.
+static void move_segment(Document *doc, Segment *segment, uint32_t first, int64_t shift) {
+    int64_t moved = (int64_t) first - shift;
+    for (uint32_t i = segment->first_node; i < segment->end_node; ++i) {
+        AstNode *node = &doc->nodes->array[i];
+        if (node->token_index >= moved) node->token_index += shift;
+        if (node->symbol == NUMBER_SYMBOL && node->field2.node >= moved) node->field2.node += shift;
+        assert(node->token_index < doc->tokens->size);
+    }
+}
+
+// Points a token of the old source at the same text in the edited one, 'delta' bytes on, or at the new end of
+// the source for END_OF_FILE. Tokens made up by the parser, such as the expected token of an error, stay as they
+// are.
+static void move_token(Document *doc, Token *token, char *old_source, size_t old_size, int64_t delta) {
+    char *text = token->strref.string;
+    if (text < old_source || text > old_source + old_size) return;
+
+    if (token->type == END_OF_FILE) {
+        token->loc = doc->size;
+        token->strref.string = doc->source + doc->size;
+        return;
+    }
+    token->loc += delta;
+    token->strref.string = doc->source + (text - old_source) + delta;
+}
+
+// Adds a kept segment to 'list', with its tokens moved by 'shift' and its bytes by 'delta'. Its parse errors are
+// reported again, so that an edit reports the same errors as compiling the edited source.
+static void keep_segment(Document *doc, SegmentList *list, Segment segment, int64_t shift, int64_t delta,
+                         char *old_source, size_t old_size) {
+    segment.first_token += shift;
+    uint32_t first_error = list->errors.size;
+    for (uint32_t i = 0; i < segment.error_count; ++i) {
+        SavedParseError error = doc->parse_errors.items[segment.first_error + i];
+        move_token(doc, &error.error_token, old_source, old_size, delta);
+        move_token(doc, &error.ref_token, old_source, old_size, delta);
+        add_parse_error(error.type, &error.error_token, error.has_ref ? &error.ref_token : NULL);
+    }
+    segment.first_error = first_error;
+    segment_push(list, segment);
+}
+
+// Reports the lex errors of a failed segment again, since its tokens were not lexed again
+static void report_lex_errors(Document *doc, size_t segment, int64_t shift) {
+    if (!doc->segments[segment].failed) return;
+
+    size_t end = doc->tokens->size;
+    if (segment + 1 < doc->segment_count) end = doc->segments[segment + 1].first_token + shift;
+    lex_report(doc->tokens, doc->segments[segment].first_token + shift, end);
+}
+
+// Replaces 'removed' bytes at 'offset' with 'text'. Only the commands the edit can reach are lexed and parsed
+// again: lexing restarts after the NEWLINE before the edit and stops at the first NEWLINE after it where it is
+// back in step with the old tokens, and parsing stops where it reaches the start of an old command again. The
+// commands in between get new nodes; every other command keeps its nodes, and type checking reuses their types.
+// Reports the lex and parse errors of the whole edited source, since kept segments report theirs again. Once the
+// nodes of replaced commands outnumber the rest, the edited source is compiled from scratch instead, which frees
+// them along with their child lists and keeps memory in proportion to the document.
+int document_edit(Document *doc, size_t offset, size_t removed, char *text, size_t text_size) {
+    if (!doc->source || offset > doc->size || removed > doc->size - offset) return EXIT_FAILURE;
+
+    size_t size = doc->size - removed + text_size;
+    size_t edit_end = offset + removed;
+    int64_t delta = (int64_t) text_size - (int64_t) removed;
+    char *source = malloc(size + 1);
+    if (!source) exit(EXIT_FAILURE);
+    memcpy(source, doc->source, offset);
+    memcpy(source + offset, text, text_size);
+    memcpy(source + offset + text_size, doc->source + edit_end, doc->size - edit_end);
+    source[size] = '\0';
+
+    // The last stable segment starting at or before the edit
+    size_t count = doc->segment_count;
+    size_t start = 0;
+    for (size_t low = 0, high = count; low < high; ) {
+        size_t middle = low + (high - low) / 2;
+        if (segment_byte(doc, middle) <= (int64_t) offset) low = middle + 1, start = middle;
+        else high = middle;
+    }
+    // A failed command before END_OF_FILE can have read up to it, so text added at the end is parsed with it
+    if (start && start == count - 1 && doc->segments[start - 1].failed) --start;
+    while (start && !is_stable(doc, start)) --start;
+
+    // A command missing a part it failed to parse points at node 0 in its place, which is the first node of the
+    // first command with any. Parsing that command again would leave node 0 behind, so it is compiled with the rest.
+    if (doc->segments[start].first_node == 0 ||
+        (doc->orphaned >= REBUILD_NODES && doc->orphaned > doc->nodes->size - doc->orphaned)) {
+        char *name = strdup(doc->name);
+        if (!name) exit(EXIT_FAILURE);
+        document_close(doc);
+        int status = document_open(doc, name, source, size);
+        free(name);
+        free(source);
+        return status;
+    }
+    error_setup(doc->name, source, size);
+
+    // A copy of the NEWLINE before the segment lets the lexer drop a newline that follows it, as it did before
+    TokenVec *fresh = tokenvec_create_cap(source, TOKEN_ESTIMATE(text_size) + 16);
+    if (!fresh) exit(EXIT_FAILURE);
+    uint32_t first = doc->segments[start].first_token;
+    size_t seeded = first > 0;
+    Token token;
+    if (seeded) tokenvec_append(fresh, *tokenvec_get(doc->tokens, first - 1, &token));
+
+    lex_setup(source, size);
+    char *position = source + segment_byte(doc, start);
+    size_t sync = start + 1;
+    int synced = 0;
+    while (1) {
+        while (sync < count && (!is_stable(doc, sync) || segment_byte(doc, sync) - 1 < (int64_t) edit_end ||
+                                segment_byte(doc, sync) + delta < position - source))
+            ++sync;
+        if (sync == count) {
+            position = lex_range(position, source + size, fresh);
+            tokenvec_append(fresh, create_token(END_OF_FILE, position - source, 1, position));
+            break;
+        }
+
+        char *target = source + segment_byte(doc, sync) + delta;
+        position = lex_range(position, target, fresh);
+        if (position == target && tokenvec_last_kind(fresh) == NEWLINE) {
+            synced = 1;
+            break;
+        }
+        ++sync;
+    }
+
+    uint32_t end = synced ? doc->segments[sync].first_token : doc->tokens->size;
+    size_t fresh_count = fresh->size - seeded;
+    int64_t shift = (int64_t) fresh_count - (int64_t) (end - first);
+    tokenvec_splice(doc->tokens, first, end, fresh, seeded, delta);
+    tokenvec_destroy(fresh);
+    doc->tokens->source = source;
+    token_list_setup(doc->tokens);
+
+    char *old_source = doc->source;
+    size_t old_size = doc->size;
+    doc->source = source;
+    doc->size = size;
+
+    // Every lex error comes before the parse errors, as when the whole source is lexed first
+    for (size_t i = 0; i < start; ++i)
+        report_lex_errors(doc, i, 0);
+    lex_report(doc->tokens, first, first + fresh_count);
+    for (size_t i = synced ? sync : count; i < count; ++i)
+        report_lex_errors(doc, i, shift);
+
+    SegmentList list = {0};
+    save_parse_errors(&list.errors);
+    for (size_t i = 0; i < start; ++i)
+        keep_segment(doc, &list, doc->segments[i], 0, 0, old_source, old_size);
+    size_t keep = parse_segments(doc, first, doc->segments, synced ? sync : count, count, shift, &list);
+    for (size_t i = start; i < keep; ++i)
+        doc->orphaned += doc->segments[i].end_node - doc->segments[i].first_node;
+    for (size_t i = keep; i < count; ++i)
+        keep_segment(doc, &list, doc->segments[i], shift, delta, old_source, old_size);
+    save_parse_errors(NULL);
+
+    free(old_source);
+    size_t moved = list.size - (count - keep);
+    if (shift && keep < count)
+        for (size_t i = moved; i < list.size; ++i)
+            move_segment(doc, &list.items[i], list.items[moved].first_token, shift);
+
+    free(doc->segments);
+    free(doc->parse_errors.items);
+    doc->segments = list.items;
+    doc->segment_count = list.size;
+    doc->parse_errors = list.errors;
+    collect_commands(doc);
+
+    int status = document_status(doc, type_check_update(doc->tokens, doc->nodes, doc->cmds));
+    print_errors();
+    return status;
+}
+
+// Frees the document along with everything the thread allocated while compiling it
+void document_close(Document *doc) {
+    arena_reset(compile_arena());
+    intern_reset();
+    childlist_reset();
+    parse_cleanup();
+    clear_errors();
+    type_check_cleanup();
+    tokenvec_destroy(doc->tokens);
+    nodevec_destroy(doc->nodes);
+    vector_destroy(doc->cmds);
+    free(doc->segments);
+    free(doc->parse_errors.items);
+    free(doc->source);
+    free(doc->name);
+    *doc = (Document) {0};
+}
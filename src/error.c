@@ -34,38 +34,251 @@
 #define STYLE_ITALIC       "\x1b[3m"
 #define STYLE_UNDERLINE    "\x1b[4m"
 
-static char *file_string;
-static char *file_name;
-static TokenVec *token_list;
+static _Thread_local char *file_string;
+static _Thread_local char *file_end;
+static _Thread_local char *file_name;
+static _Thread_local TokenVec *token_list;
+static _Thread_local FILE *output;
+
+// The offset each line of the source starts at, built the first time a location is asked for
+static _Thread_local U32Vec line_starts;
+static _Thread_local char *indexed_string;
+
+// Errors wait here until print_errors sorts and prints them. Each keeps a copy of the tokens or nodes it names,
+// since the caller's may be on the stack or move as their vector grows.
+typedef struct {
+    ErrorToken error;
+    uint32_t loc;
+    uint32_t order;
+    union { Token token; AstNode node; } first, second;
+} PendingError;
+
+static _Thread_local PendingError *pending;
+static _Thread_local size_t pending_count;
+static _Thread_local size_t pending_capacity;
+static _Thread_local ParseErrorList *saved_parse_errors;
+static size_t max_errors = DEFAULT_MAX_ERRORS;
+
+// Diagnostics and listings go to stdout unless the calling thread has redirected them
+void set_output(FILE *stream) {
+    output = stream;
+}
+
+FILE *get_output() {
+    return output ? output : stdout;
+}
 
-void error_setup(char *file, char *string) {
+void error_setup(char *file, char *string, size_t size) {
     if (!file || !string) return;
 
     file_string = string;
+    file_end = string + size;
     file_name = file;
+    indexed_string = NULL;
+}
+
+// Sets how many errors print_errors shows at most. Zero shows every one.
+void set_max_errors(size_t count) {
+    max_errors = count;
+}
+
+size_t get_max_errors() {
+    return max_errors;
+}
+
+// Drops any errors not yet printed and frees the line index kept for the last source
+void clear_errors() {
+    free(pending);
+    pending = NULL;
+    pending_count = 0;
+    pending_capacity = 0;
+
+    u32vec_release(&line_starts);
+    indexed_string = NULL;
+}
+
+static void index_lines() {
+    if (indexed_string == file_string) return;
+
+    line_starts.size = 0;
+    u32vec_append(&line_starts, 0);
+    for (char *c = file_string; c && (c = memchr(c, '\n', file_end - c)); ++c)
+        u32vec_append(&line_starts, c + 1 - file_string);
+    indexed_string = file_string;
+}
+
+// The index of the last line starting at or before 'loc'
+static size_t find_line(uint32_t loc) {
+    index_lines();
+
+    size_t low = 0, high = line_starts.size;
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (line_starts.array[middle] <= loc) low = middle;
+        else high = middle;
+    }
+    return low;
+}
+
+// The end of the line holding 'string', at its newline, a NUL or the end of the source
+static char *line_end(Token *token, char *string) {
+    if (token->type == NEWLINE || token->type == END_OF_FILE || string < file_string || string >= file_end)
+        return string;
+
+    size_t next = find_line(string - file_string) + 1;
+    char *end = next < line_starts.size ? file_string + line_starts.array[next] - 1 : file_end;
+    return string + strnlen(string, end - string);
 }
 
 void token_list_setup(TokenVec* tokens) {
     token_list = tokens;
 }
 
+static PendingError *pending_push(ErrorToken error, uint32_t loc) {
+    if (pending_count == pending_capacity)
+        pending = array_grow(pending, &pending_capacity, sizeof(PendingError), 64);
+
+    PendingError *entry = &pending[pending_count];
+    *entry = (PendingError) {error, loc, pending_count, {{0}}, {{0}}};
+    ++pending_count;
+    return entry;
+}
+
 void add_lex_error(LexErrorType type, Token *token) {
     if (!token) return;
 
-    ErrorToken new_error = (ErrorToken) { LEX_ERROR, {.lex_error = type}, token, NULL };
-    print_lex_error(&new_error);
+    ErrorToken new_error = (ErrorToken) { LEX_ERROR, {.lex_error = type}, NULL, NULL };
+    pending_push(new_error, token->loc)->first.token = *token;
 }
 
 void add_parse_error(ParseErrorType type, Token *error_token, Token *ref_token) {
     if (!error_token) return;
-    ErrorToken new_error = (ErrorToken) { PARSE_ERROR, {.parse_error = type}, error_token, ref_token };
-    print_parse_error(&new_error);
+
+    ErrorToken new_error = (ErrorToken) { PARSE_ERROR, {.parse_error = type}, NULL, NULL };
+    PendingError *entry = pending_push(new_error, error_token->loc);
+    entry->first.token = *error_token;
+    if (ref_token) {
+        entry->second.token = *ref_token;
+        entry->error.second_token = &entry->second.token;
+    }
+
+    ParseErrorList *list = saved_parse_errors;
+    if (!list) return;
+    if (list->size == list->capacity)
+        list->items = array_grow(list->items, &list->capacity, sizeof(SavedParseError), 16);
+    Token ref = ref_token ? *ref_token : (Token) {0};
+    list->items[list->size++] = (SavedParseError) {type, ref_token != NULL, *error_token, ref};
+}
+
+// Copies the parse errors reported from now on into 'list' as well, until called again with NULL
+void save_parse_errors(ParseErrorList *list) {
+    saved_parse_errors = list;
 }
 
 void add_type_error(TypeErrorType type, AstNode *error_node, AstNode *ref_node) {
     if (!ref_node || !error_node) return;
-    ErrorToken new_error = (ErrorToken) { TYPE_ERROR, {.type_error = type}, error_node, ref_node };
-    print_type_error(&new_error);
+
+    Token value;
+    Token *token = tokenvec_get(token_list, error_node->token_index, &value);
+    ErrorToken new_error = (ErrorToken) { TYPE_ERROR, {.type_error = type}, NULL, NULL };
+    PendingError *entry = pending_push(new_error, token ? token->loc : UINT32_MAX);
+    entry->first.node = *error_node;
+    entry->second.node = *ref_node;
+}
+
+static int compare_pending(const void *a, const void *b) {
+    const PendingError *x = a, *y = b;
+    if (x->loc != y->loc) return (x->loc > y->loc) - (x->loc < y->loc);
+    return (x->order > y->order) - (x->order < y->order);
+}
+
+static int same_text(StringRef a, StringRef b) {
+    if (!a.string || !b.string) return a.string == b.string;
+    return !string_ref_cmp(a, b);
+}
+
+// Errors are the same when they are of one kind and their messages name the same text at the same places
+static int same_error(PendingError *a, PendingError *b) {
+    if (a->error.error_type != b->error.error_type || a->loc != b->loc) return 0;
+    switch (a->error.error_type) {
+        case LEX_ERROR:
+            return a->error.error_subtype.lex_error == b->error.error_subtype.lex_error &&
+                   same_text(a->first.token.strref, b->first.token.strref);
+        case PARSE_ERROR:
+            if (a->error.error_subtype.parse_error != b->error.error_subtype.parse_error) return 0;
+            if (!a->error.second_token != !b->error.second_token) return 0;
+            return same_text(a->first.token.strref, b->first.token.strref) &&
+                   (!a->error.second_token || (a->second.token.loc == b->second.token.loc &&
+                                               same_text(a->second.token.strref, b->second.token.strref)));
+        case TYPE_ERROR:
+            return a->error.error_subtype.type_error == b->error.error_subtype.type_error &&
+                   a->second.node.token_index == b->second.node.token_index &&
+                   same_text(tokenvec_text(token_list, &a->first.node), tokenvec_text(token_list, &b->first.node)) &&
+                   same_text(tokenvec_text(token_list, &a->second.node), tokenvec_text(token_list, &b->second.node));
+    }
+    return 0;
+}
+
+static void print_error(ErrorToken *error) {
+    switch (error->error_type) {
+        case LEX_ERROR: print_lex_error(error); break;
+        case PARSE_ERROR: print_parse_error(error); break;
+        case TYPE_ERROR: print_type_error(error); break;
+    }
+}
+
+// Prints the errors reported since it last ran in source order with one write. An error that repeats one
+// already printed for its line is dropped, since one bad token can report the same error more than once, and at
+// most max_errors are printed.
+void print_errors() {
+    if (!pending_count) return;
+
+    qsort(pending, pending_count, sizeof(PendingError), compare_pending);
+
+    FILE *destination = get_output();
+    char *text;
+    size_t size;
+    FILE *stream = open_memstream(&text, &size);
+    if (!stream) exit(EXIT_FAILURE);
+    FILE *saved = output;
+    output = stream;
+
+    size_t printed = 0, hidden = 0, line_first = 0;
+    size_t line = SIZE_MAX;
+    for (size_t i = 0; i < pending_count; ++i) {
+        PendingError *entry = &pending[i];
+        size_t entry_line = find_line(entry->loc);
+        if (entry_line != line) {
+            line = entry_line;
+            line_first = i;
+        }
+
+        int repeated = 0;
+        for (size_t j = line_first; j < i && !repeated; ++j)
+            repeated = same_error(&pending[j], entry);
+        if (repeated) continue;
+
+        if (max_errors && printed == max_errors) {
+            ++hidden;
+            continue;
+        }
+
+        // Sorting moved the copies, so the pointers are set now. Until then, a parse error's second token
+        // only says whether it has one.
+        entry->error.first_token = &entry->first;
+        if (entry->error.error_type == TYPE_ERROR) entry->error.second_token = &entry->second;
+        else if (entry->error.second_token) entry->error.second_token = &entry->second.token;
+        print_error(&entry->error);
+        ++printed;
+    }
+    if (hidden)
+        fprintf(output, "%zu more errors not shown. Use --max-errors to change the limit.\n\n", hidden);
+
+    output = saved;
+    fclose(stream);
+    fwrite(text, 1, size, destination);
+    free(text);
+    pending_count = 0;
 }
 
 void print_lex_error(ErrorToken *error) {
@@ -77,12 +290,12 @@ void print_lex_error(ErrorToken *error) {
     uint32_t col = 1;
     get_error_loc(token, &col, &line);
 
-    printf("Lex error at %s:%d:%d\n\n", file_name, line, col);
+    fprintf(get_output(), "Lex error at %s:%d:%d\n\n", file_name, line, col);
 
     char c;
     switch (error->error_subtype.lex_error) {
         case UNCLOSED_STRING:
-            printf("\tUnclosed string:\n\n");
+            fprintf(get_output(), "\tUnclosed string:\n\n");
             print_one_token_line(token);
             break;
         case INVALID_LEX:
@@ -90,7 +303,7 @@ void print_lex_error(ErrorToken *error) {
             break;
         case ILLEGAL_LEX:
             c = *token->strref.string;
-            printf("\tIllegal character: " COLOR_RED STYLE_BOLD "'%d'\n\n" RESET_ALL, c);
+            fprintf(get_output(), "\tIllegal character: " COLOR_RED STYLE_BOLD "'%d'\n\n" RESET_ALL, c);
             break;
     }
 }
@@ -105,7 +318,7 @@ void print_parse_error(ErrorToken *error) {
     uint32_t col = 1;
     get_error_loc(first_token, &col, &line);
 
-    printf("Parse error at %s:%d:%d\n", file_name, line, col);
+    fprintf(get_output(), "Parse error at %s:%d:%d\n", file_name, line, col);
 
     size_t length1 = first_token->strref.length;
     size_t length2 = 0;
@@ -113,11 +326,14 @@ void print_parse_error(ErrorToken *error) {
     char misc_1[length1 + 1];
     char misc_2[length2 + 1];
 
-    strncpy(misc_1, first_token->strref.string, length1);
+    // The end of file token points just past the source
+    if (first_token->type == END_OF_FILE) length1 = 0;
+    memcpy(misc_1, first_token->strref.string, length1);
     misc_1[length1] = '\0';
 
+    if (second_token != NULL && second_token->type == END_OF_FILE) length2 = 0;
     if (second_token != NULL)
-        strncpy(misc_2, second_token->strref.string, length2);
+        memcpy(misc_2, second_token->strref.string, length2);
     misc_2[length2] = '\0';
 
     char *string1;
@@ -151,51 +367,51 @@ void print_parse_error(ErrorToken *error) {
 
     switch (error->error_subtype.parse_error) {
         case UNEXPECTED_TOKEN:
-            printf("\tUnexpected token type encountered.\n\tExpected type '%s', found: '%s'\n\n", string2, string1);
+            fprintf(get_output(), "\tUnexpected token type encountered.\n\tExpected type '%s', found: '%s'\n\n", string2, string1);
             print_one_token_line(first_token);
             break;
         case UNCLOSED_PAREN:
-            printf("\tUnclosed parenthetical.\n\n");
+            fprintf(get_output(), "\tUnclosed parenthetical.\n\n");
             print_two_token_line(second_token, first_token);
             break;
         case INT_RANGE:
-            printf("\tInteger value exceeds INTMAX.\n\n");
+            fprintf(get_output(), "\tInteger value exceeds INTMAX.\n\n");
             print_one_token_line(first_token);
             break;
         case FLOAT_RANGE:
-            printf("\tFloating point value exceeds DOUBLEMAX.\n\n");
+            fprintf(get_output(), "\tFloating point value exceeds DOUBLEMAX.\n\n");
             print_one_token_line(first_token);
             break;
         case BAD_BIND:
-            printf("\tExpected BINDING, found '%s'\n\n", string1);
+            fprintf(get_output(), "\tExpected BINDING, found '%s'\n\n", string1);
             print_one_token_line(first_token);
             break;
         case BAD_CMD:
-            printf("\tExpected COMMAND, found '%s'\n\n", string1);
+            fprintf(get_output(), "\tExpected COMMAND, found '%s'\n\n", string1);
             print_one_token_line(first_token);
             break;
         case BAD_EXPR:
-            printf("\tExpected EXPRESSION, found '%s'\n\n", string1);
+            fprintf(get_output(), "\tExpected EXPRESSION, found '%s'\n\n", string1);
             print_one_token_line(first_token);
             break;
         case BAD_LVALUE:
-            printf("\tExpected LVALUE, found '%s'\n\n", string1);
+            fprintf(get_output(), "\tExpected LVALUE, found '%s'\n\n", string1);
             print_one_token_line(first_token);
             break;
         case BAD_STMT:
-            printf("\tExpected STATEMENT, found '%s'\n\n", string1);
+            fprintf(get_output(), "\tExpected STATEMENT, found '%s'\n\n", string1);
             print_one_token_line(first_token);
             break;  
         case BAD_TYPE:
-            printf("\tExpected TYPE, found '%s'\n\n", string1);
+            fprintf(get_output(), "\tExpected TYPE, found '%s'\n\n", string1);
             print_one_token_line(first_token);
             break;
         case BAD_UNARY:
-            printf("\tInvalid unary operator; expected '-' or '!', found '%s'\n\n", string1);
+            fprintf(get_output(), "\tInvalid unary operator; expected '-' or '!', found '%s'\n\n", string1);
             print_one_token_line(first_token);
             break;
         case BAD_BINARY:
-            printf("\tInvalid binary operator; expected boolean or math operator, found '%s'\n\n", string1);
+            fprintf(get_output(), "\tInvalid binary operator; expected boolean or math operator, found '%s'\n\n", string1);
             print_one_token_line(first_token);
             break;
         default:
@@ -206,143 +422,129 @@ void print_parse_error(ErrorToken *error) {
 void print_type_error(ErrorToken *error) {
     AstNode *error_node = error->first_token;
     AstNode *ref_node = error->second_token;
-    Token *error_token = tokenvec_get(token_list, error_node->token_index);
-    Token *ref_token = tokenvec_get(token_list, ref_node->token_index);
+    Token error_value, ref_value;
+    Token *error_token = tokenvec_get(token_list, error_node->token_index, &error_value);
+    Token *ref_token = tokenvec_get(token_list, ref_node->token_index, &ref_value);
     uint32_t line = 1;
     uint32_t col = 1;
     get_error_loc(error_token, &col, &line);
 
-    printf("Type-check error at %s:%d:%d\n", file_name, line, col);
+    fprintf(get_output(), "Type-check error at %s:%d:%d\n", file_name, line, col);
 
-    if (!error_node->string.string) {
-        error_node->string = (StringRef) {0, ""};
+    StringRef text = tokenvec_text(token_list, error_node);
+    if (!text.string) {
+        text = (StringRef) {0, ""};
     }
 
-    char *string2 = NULL;
-    char *string1 = malloc(error_node->string.length + 1); if (!string1) return;
-    strncpy(string1, error_node->string.string, error_node->string.length);
-    string1[error_node->string.length] = '\0';
-
-    uint32_t string2_len;
-    if (!ref_node->string.string || !ref_node->string.length)
-        string2_len = 0;
-    else
-        string2_len = ref_node->string.length;
-
-    string2 = malloc(string2_len + 1); if (!string2) return;
-    if (ref_node->string.string != NULL)
-        strncpy(string2, ref_node->string.string, string2_len);
-    string2[string2_len] = '\0';
+    char *string1 = array_from_ref_arena(compile_arena(), text); if (!string1) return;
+    char *string2 = array_from_ref_arena(compile_arena(), tokenvec_text(token_list, ref_node)); if (!string2) return;
 
     switch (error->error_subtype.type_error) {
         case UNEXPECTED_TYPE:
-            printf("\tUnexpected expression type encountered.\n\tExpected: %s\n\tFound: %s\n\n", string2, string1);
+            fprintf(get_output(), "\tUnexpected expression type encountered.\n\tExpected: %s\n\tFound: %s\n\n", string2, string1);
             print_one_token_line(error_token);
             break;
         case UNRESOLVED_TYPE:
-            printf("\tReference to variable '%s' of unresolved type.\n\n", string1);
+            fprintf(get_output(), "\tReference to variable '%s' of unresolved type.\n\n", string1);
             print_one_token_line(error_token);
             break;
         case MISMATCHED_BINOP:
-            printf("\tAttempted binary operation on incompatible types: '%s' and '%s'\n\n", string1, string2);
+            fprintf(get_output(), "\tAttempted binary operation on incompatible types: '%s' and '%s'\n\n", string1, string2);
             print_two_token_line(error_token, ref_token);
             break;
         case MISMATCHED_IF:
-            printf("\tIf-Then-Else expression returns incompatible types on separate branches\n\n");
+            fprintf(get_output(), "\tIf-Then-Else expression returns incompatible types on separate branches\n\n");
             print_two_token_line(ref_token, error_token);
             break;
         case BAD_BINOP:
-            printf("\tAttempted binary operation '%s' on invalid type: '%s'\n\n", string2, string1);
+            fprintf(get_output(), "\tAttempted binary operation '%s' on invalid type: '%s'\n\n", string2, string1);
             print_two_token_line(error_token, ref_token);
             break;
         case BAD_UNOP:
-            printf("\tAttempted unary operation '%s' on invalid type: '%s'\n\n", string1, string2);
+            fprintf(get_output(), "\tAttempted unary operation '%s' on invalid type: '%s'\n\n", string1, string2);
             print_two_token_line(ref_token, error_token);
             break;
         case BAD_INDEX:
-            printf("\tAttempt to index array with non-integer type\n\n");
+            fprintf(get_output(), "\tAttempt to index array with non-integer type\n\n");
             print_one_token_line(error_token);
             break;
         case BAD_DERFERENCE:
-            printf("\tAttempt to dereference non-struct variable '%s'\n\n", string1);
+            fprintf(get_output(), "\tAttempt to dereference non-struct variable '%s'\n\n", string1);
             print_one_token_line(error_token);
             break;
         case BAD_MEMBER:
-            printf("\tAttempt to dereference invalid member '%s' from struct type '%s'\n\n", string1, string2);
+            fprintf(get_output(), "\tAttempt to dereference invalid member '%s' from struct type '%s'\n\n", string1, string2);
             print_one_token_line(error_token);
-            printf("\tStruct type declared here:\n\n");
+            fprintf(get_output(), "\tStruct type declared here:\n\n");
             print_one_token_line(ref_token);
             break;
         case UNDECLARED_VARIABLE:
-            printf("\tAttempt to access undeclared variable: '%s'\n\n", string1);
+            fprintf(get_output(), "\tAttempt to access undeclared variable: '%s'\n\n", string1);
             print_one_token_line(error_token);
             break;
         case SHADOWED_VARIABLE:
-            printf("\tVariable '%s' shadows previously declared variable.\n\n", string1);
+            fprintf(get_output(), "\tVariable '%s' shadows previously declared variable.\n\n", string1);
             print_one_token_line(error_token);
-            printf("\tDeclared here:\n\n");
+            fprintf(get_output(), "\tDeclared here:\n\n");
             print_one_token_line(ref_token);
             break;
         case NO_RETURN:
-            printf("\tFunction '%s' missing return statement.\n\n", string1);
+            fprintf(get_output(), "\tFunction '%s' missing return statement.\n\n", string1);
             print_one_token_line(error_token);
             break;
         case BAD_RETURN:
-            printf("\tStatement returns invalid type for function '%s'\n\n", string1);
+            fprintf(get_output(), "\tStatement returns invalid type for function '%s'\n\n", string1);
             print_one_token_line(error_token);
-            printf("\tDeclared here:\n\n");
+            fprintf(get_output(), "\tDeclared here:\n\n");
             print_one_token_line(ref_token);
             break;
         case STRUCT_ASSIGN:
-            printf("\tAttempt to assign struct type to variable '%s'\n\n", string1);
+            fprintf(get_output(), "\tAttempt to assign struct type to variable '%s'\n\n", string1);
             print_one_token_line(error_token);
-            printf("\tDeclared here:\n\n");
+            fprintf(get_output(), "\tDeclared here:\n\n");
             print_one_token_line(ref_token);
             break;
         case VOID_ASSIGN:
-            printf("\tAttempt to assign VOID type value to variable '%s'\n\n", string1);
+            fprintf(get_output(), "\tAttempt to assign VOID type value to variable '%s'\n\n", string1);
             print_one_token_line(error_token);
             break;
         case MISMATCHED_MEMBERS:
-            printf("\tStruct members misaligned for struct '%s'\n\n", string2);
+            fprintf(get_output(), "\tStruct members misaligned for struct '%s'\n\n", string2);
             print_one_token_line(error_token);
-            printf("\tDeclared here:\n\n");
+            fprintf(get_output(), "\tDeclared here:\n\n");
             print_one_token_line(ref_token);
             break;
         case EMPTY_ARRAY:
-            printf("\tArray literal constructor cannot be empty.\n\n");
+            fprintf(get_output(), "\tArray literal constructor cannot be empty.\n\n");
             print_one_token_line(error_token);
             break;
         case MISMATCHED_ARRAY:
-            printf("\tNon-matching array index types\n\n");
+            fprintf(get_output(), "\tNon-matching array index types\n\n");
             print_two_token_line(ref_token, error_token);
             break;
         case NO_INDEX:
-            printf("\tArray index cannot be empty.\n\n");
+            fprintf(get_output(), "\tArray index cannot be empty.\n\n");
             print_one_token_line(error_token);
             break;
         case BAD_RANK:
-            printf("\tArray rank doesn't match assignment rank.\n\n");
+            fprintf(get_output(), "\tArray rank doesn't match assignment rank.\n\n");
             print_two_token_line(error_token, ref_token);
             break;
         case BAD_FN:
-            printf("\tAttempt to call non-function variable '%s'\n\n", string1);
+            fprintf(get_output(), "\tAttempt to call non-function variable '%s'\n\n", string1);
             print_one_token_line(error_token);
-            printf("\tDeclared here:\n\n");
+            fprintf(get_output(), "\tDeclared here:\n\n");
             print_one_token_line(ref_token);
             break;
         case BAD_DIMENSION:
-            printf("\tAttempt to index array with non-matching dimension.\n\n");
+            fprintf(get_output(), "\tAttempt to index array with non-matching dimension.\n\n");
             print_two_token_line(error_token, ref_token);
             break;
         case BAD_SUM:
-            printf("\tAttempt to add non-numeric expresion\n\n");
+            fprintf(get_output(), "\tAttempt to add non-numeric expresion\n\n");
             print_one_token_line(error_token);
             break;
     }
-
-    free(string1);
-    free(string2);
 }
 
 void print_one_token_line(Token *token) {
@@ -355,20 +557,14 @@ void print_one_token_line(Token *token) {
     StringRef string = token->strref;
     uint32_t span = string.length;
 
-    uint32_t post_span = 0;
     char *pc = string.string + string.length;
-    while (1) {
-        if (token->type == NEWLINE || token->type == END_OF_FILE) break;
-        char c = *(pc + post_span);
-        if (c == '\n' || c == '\0') break;
-        ++post_span;
-    }
+    uint32_t post_span = line_end(token, pc) - pc;
 
     char prefix[col];
     char postfix[post_span + 1];
     char error[span + 1];
 
-    strncpy(prefix, string.string-(col-1), col);
+    strncpy(prefix, string.string-(col-1), col-1);
 
     if (token->type == NEWLINE || token->type == END_OF_FILE)
         error[0] = ' ';
@@ -381,20 +577,20 @@ void print_one_token_line(Token *token) {
     error[span] = '\0';
     postfix[post_span] = '\0';
 
-    printf("%6d | %s" COLOR_RED STYLE_BOLD "%s" RESET_ALL "%s\n", line, prefix, error, postfix);
+    fprintf(get_output(), "%6d | %s" COLOR_RED STYLE_BOLD "%s" RESET_ALL "%s\n", line, prefix, error, postfix);
 
     size_t prefix_len = strlen(prefix) + 9;
     size_t i;
 
-    printf(COLOR_RED STYLE_BOLD);
+    fprintf(get_output(), COLOR_RED STYLE_BOLD);
     for (i = 0; i < prefix_len; ++i) {
-        fputc(' ', stdout);
+        fputc(' ', get_output());
     }
-    putc ('^', stdout);
+    putc ('^', get_output());
     for (i = 0; i < span-1; ++i) {
-        fputc('~', stdout);
+        fputc('~', get_output());
     }
-    printf(RESET_ALL "\n\n");
+    fprintf(get_output(), RESET_ALL "\n\n");
 }
 
 void print_two_token_line(Token *start_token, Token *end_token) {
@@ -431,19 +627,14 @@ void print_two_token_line(Token *start_token, Token *end_token) {
     char *pc = start_string.string + start_span;
     while (pc + mid_span != end_string.string) {
         if (start_token->type == NEWLINE || start_token->type == END_OF_FILE) break;
+        if (pc + mid_span >= file_end) break;
         char c = *(pc + mid_span);
         if (c == '\n' || c == '\0') break;
         ++mid_span;
     }
 
-    uint32_t post_span = 0;
     pc = end_string.string + end_span;
-    while (1) {
-        if (end_token->type == NEWLINE || end_token->type == END_OF_FILE) break;
-        char c = *(pc + post_span);
-        if (c == '\n' || c == '\0') break;
-        ++post_span;
-    }
+    uint32_t post_span = line_end(end_token, pc) - pc;
 
     char prefix[start_col];
     char start[start_span + 1];
@@ -451,7 +642,7 @@ void print_two_token_line(Token *start_token, Token *end_token) {
     char end[end_span + 1];
     char postfix[post_span + 1];
 
-    strncpy(prefix, start_string.string-(start_col-1), start_col);
+    strncpy(prefix, start_string.string-(start_col-1), start_col-1);
     prefix[start_col-1] = '\0';
 
     if (start_token->type == NEWLINE || start_token->type == END_OF_FILE)
@@ -474,44 +665,34 @@ void print_two_token_line(Token *start_token, Token *end_token) {
     strncpy(postfix, end_string.string + end_string.length, post_span);
     postfix[post_span] = '\0';
 
-    printf("%6d | %s" COLOR_RED STYLE_BOLD "%s" RESET_ALL "%s" COLOR_RED STYLE_BOLD "%s" RESET_ALL "%s\n", 
+    fprintf(get_output(), "%6d | %s" COLOR_RED STYLE_BOLD "%s" RESET_ALL "%s" COLOR_RED STYLE_BOLD "%s" RESET_ALL "%s\n", 
         start_line, prefix, start, midfix, end, postfix);
 
     size_t prefix_len = strlen(prefix) + 9;
     size_t i;
 
-    printf(COLOR_RED STYLE_BOLD);
+    fprintf(get_output(), COLOR_RED STYLE_BOLD);
     for (i = 0; i < prefix_len; ++i) {
-        fputc(' ', stdout);
+        fputc(' ', get_output());
     }
-    fputc ('^', stdout);
+    fputc ('^', get_output());
     for (i = 0; i < start_span-1; ++i) {
-        fputc('~', stdout);
+        fputc('~', get_output());
     }
     for (i = 0; i < mid_span; ++i) {
-        fputc(' ', stdout);
+        fputc(' ', get_output());
     }
-    fputc('^', stdout);
+    fputc('^', get_output());
     for (i = 0; i < end_span-1; ++i) {
-        fputc('~', stdout);
+        fputc('~', get_output());
     }
-    printf(RESET_ALL "\n\n");
+    fprintf(get_output(), RESET_ALL "\n\n");
 }
 
 void get_error_loc(Token *token, uint32_t *col, uint32_t *line) {
     if (!token || !col || !line) return;
 
-    uint32_t loc = token->loc;
-
-    *line = 1;
-    *col = 1;
-
-    for (uint32_t i = 0; i < loc; ++i) {
-        if (file_string[i] == '\n') {
-            ++(*line);
-            *col = 1;
-        }
-        else
-            ++(*col);
-    }
+    size_t index = find_line(token->loc);
+    *line = index + 1;
+    *col = token->loc - line_starts.array[index] + 1;
 }
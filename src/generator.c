@@ -0,0 +1,860 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "generator.h"
+#include "typecheck.h"
+
+#define INDENT_WIDTH 4
+#define REF_ARGS(ref) (int) (ref).length, (ref).string
+
+// Every expression is lowered into a numbered temporary '_N' so that loops and short-circuiting, which have no
+// C expression form, can be emitted as plain statements. Arrays are a struct of their dimensions plus one
+// contiguous row-major buffer, so comprehensions become flat nested 'for' loops the C compiler can vectorize.
+
+// An index variable of a comprehension currently being generated. Bounds checks on it are hoisted into
+// 'checks', ahead of the loop nest, so the loop body stays branch-free. 'checked' holds the array symbol and
+// dimension of each check already hoisted, so that indexing the same array again adds none.
+typedef struct {
+    StringRef var;
+    uint32_t symbol;
+    uint32_t bound;
+    uint32_t branch_depth;
+    uint32_t indent;
+    CVec *checks;
+    U32Vec checked;
+} LoopVar;
+
+static TokenVec *token_list;
+static NodeVec *node_list;
+
+static CVec *code;
+static CVec *type_buffer;
+static CVec *global_buffer;
+static CVec *show_buffer;
+static CVec *fn_buffer;
+static CVec *main_buffer;
+
+static Dict *type_names;
+static Dict *show_names;
+static Vector *name_list;
+
+static Vector *open_loops;
+
+static uint32_t indent;
+static uint32_t temp_count;
+static uint32_t branch_depth;
+
+static char *builtins[] = { "sqrt", "exp", "sin", "cos", "tan", "asin", "acos", "atan", "log", "pow", "atan2" };
+
+static void emit(const char *format, ...) {
+    cvec_append_format(code, "%*s", indent * INDENT_WIDTH, "");
+
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    char line[len + 1];
+    va_start(args, format);
+    vsnprintf(line, len + 1, format, args);
+    va_end(args);
+
+    cvec_append_array_line(code, line, len);
+}
+
+static char *format_string(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    char *string = malloc(len + 1); if (!string) exit(EXIT_FAILURE);
+    va_start(args, format);
+    vsnprintf(string, len + 1, format, args);
+    va_end(args);
+
+    return string;
+}
+
+// Stores a name so it outlives the generator's scratch buffers and registers it in the given dictionary.
+static char *save_name(Dict *dict, char *name) {
+    char *saved = format_string("%s", name);
+    vector_append(name_list, saved);
+    dict_add_array(dict, saved, strlen(saved), saved);
+    return saved;
+}
+
+// Converts a JPL string token, quotes included, into an equivalent C string literal.
+static char *c_string(StringRef string) {
+    CVec *buffer = cvec_create_cap(string.length * 2 + 1); if (!buffer) exit(EXIT_FAILURE);
+
+    for (size_t i = 0; i < string.length; ++i) {
+        char c = string.string[i];
+        if (c == '\\' || (c == '"' && i != 0 && i != string.length - 1))
+            cvec_append(buffer, '\\');
+        cvec_append(buffer, c);
+    }
+    cvec_append(buffer, '\0');
+
+    char *output = buffer->array;
+    free(buffer);
+    return output;
+}
+
+// Builds the row-major offset of the given indices, e.g. (i0 * d1 + i1) * d2 + i2.
+static char *flat_index(size_t rank, char **indices, char **dims) {
+    CVec *buffer = cvec_create(); if (!buffer) exit(EXIT_FAILURE);
+
+    for (size_t i = 2; i < rank; ++i)
+        cvec_append(buffer, '(');
+    cvec_append_format(buffer, "%s", indices[0]);
+    for (size_t i = 1; i < rank; ++i) {
+        cvec_append_format(buffer, " * %s + %s", dims[i], indices[i]);
+        if (i < rank - 1)
+            cvec_append(buffer, ')');
+    }
+    cvec_append(buffer, '\0');
+
+    char *output = buffer->array;
+    free(buffer);
+    return output;
+}
+
+static void free_strings(char **strings, size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        free(strings[i]);
+}
+
+// Returns the enclosing loop whose index variable is the given expression, if every iteration of that loop
+// evaluates the expression.
+static LoopVar *find_loop_var(uint32_t expr_index) {
+    AstNode *expr = nodevec_get(node_list, expr_index);
+    if (!expr || expr->type.expr != VAR_EXPR) return NULL;
+
+    for (size_t i = open_loops->size; i > 0; --i) {
+        LoopVar *loop = vector_get(open_loops, i - 1);
+        if (loop->symbol != expr->symbol) continue;
+        return loop->branch_depth == branch_depth ? loop : NULL;
+    }
+
+    return NULL;
+}
+
+// Notes a check of the array dimension against the loop bound. Returns 0 if the loop already hoists it.
+static int add_loop_check(LoopVar *loop, uint32_t array, uint32_t dim) {
+    for (size_t i = 0; i < loop->checked.size; i += 2)
+        if (loop->checked.array[i] == array && loop->checked.array[i + 1] == dim) return 0;
+
+    u32vec_append(&loop->checked, array);
+    u32vec_append(&loop->checked, dim);
+    return 1;
+}
+
+static int is_builtin(StringRef name) {
+    size_t len = sizeof(builtins) / sizeof(char*);
+    for (size_t i = 0; i < len; ++i) {
+        if (!ref_array_cmp(name, builtins[i])) return 1;
+    }
+    return 0;
+}
+
+int generate_c(TokenVec *tokens, NodeVec *nodes, Vector *cmd_nodes, CVec **output) {
+    if (!tokens || !nodes || !cmd_nodes || !output) return EXIT_FAILURE;
+
+    token_list = tokens;
+    node_list = nodes;
+
+    type_buffer = cvec_create();
+    global_buffer = cvec_create();
+    show_buffer = cvec_create();
+    fn_buffer = cvec_create();
+    main_buffer = cvec_create();
+    type_names = dict_create_small();
+    show_names = dict_create_small();
+    name_list = vector_create();
+    open_loops = vector_create();
+    if (!type_buffer || !global_buffer || !show_buffer || !fn_buffer || !main_buffer || !type_names || !show_names
+        || !name_list || !open_loops)
+        return EXIT_FAILURE;
+
+    code = main_buffer;
+    indent = 1;
+
+    // Command line arguments
+    uint64_t args_index;
+    if (!lookup_declaration(intern_ref((StringRef) {4, "args"}), &args_index)) return EXIT_FAILURE;
+    char *args_type = get_type_name(nodevec_get(node_list, args_index)->field2.node);
+    cvec_append_format(global_buffer, "static %s v_args;\nstatic int64_t v_argnum;\n", args_type);
+    emit("v_args.data = jpl_args(argc, argv, &v_args.d0);");
+    emit("v_argnum = v_args.d0;");
+
+    for (size_t i = 0; i < cmd_nodes->size; ++i)
+        generate_cmd((uint64_t) vector_get(cmd_nodes, i));
+
+    CVec *c_code = cvec_create_cap(type_buffer->size + global_buffer->size + show_buffer->size + fn_buffer->size
+                                    + main_buffer->size + MAXIMUM_BUFFER);
+    if (!c_code) return EXIT_FAILURE;
+
+    cvec_append_format(c_code, "#include <stdio.h>\n#include <stdint.h>\n#include <stdbool.h>\n#include <math.h>\n\n");
+    cvec_append_format(c_code, "#include \"runtime.h\"\n\n");
+    cvec_append_array(c_code, type_buffer->array, type_buffer->size);
+    cvec_append_array_line(c_code, global_buffer->array, global_buffer->size);
+    cvec_append_array(c_code, show_buffer->array, show_buffer->size);
+    cvec_append_array(c_code, fn_buffer->array, fn_buffer->size);
+    cvec_append_format(c_code, "int main(int argc, char **argv) {\n");
+    cvec_append_array(c_code, main_buffer->array, main_buffer->size);
+    cvec_append_format(c_code, "    return 0;\n}\n");
+
+    cvec_destroy(type_buffer);
+    cvec_destroy(global_buffer);
+    cvec_destroy(show_buffer);
+    cvec_destroy(fn_buffer);
+    cvec_destroy(main_buffer);
+    dict_free(type_names);
+    dict_free(show_names);
+    vector_destroy_deep(name_list);
+    vector_destroy(open_loops);
+
+    *output = c_code;
+    return EXIT_SUCCESS;
+}
+
+void generate_cmd(uint32_t cmd_index) {
+    AstNode *cmd = nodevec_get(node_list, cmd_index);
+    if (!cmd) return;
+
+    uint32_t temp, value;
+    char *string;
+    switch (cmd->type.cmd) {
+        case READ_CMD:
+            temp = temp_count++;
+            string = c_string(symbol_name(cmd->symbol));
+            emit("%s _%u;", get_type_name(nodevec_get(node_list, cmd->field1.node)->field2.node), temp);
+            emit("_%u.data = jpl_read_image(%s, &_%u.d0, &_%u.d1);", temp, string, temp, temp);
+            generate_lvalue(cmd->field1.node, temp, 1);
+            free(string);
+            break;
+        case WRITE_CMD:
+            value = generate_expr(cmd->field1.node);
+            string = c_string(symbol_name(cmd->symbol));
+            emit("jpl_write_image(_%u.data, _%u.d0, _%u.d1, %s);", value, value, value, string);
+            free(string);
+            break;
+        case LET_CMD:
+            value = generate_expr(cmd->field3.node);
+            generate_lvalue(cmd->field1.node, value, 1);
+            break;
+        case ASSERT_CMD:
+            value = generate_expr(cmd->field1.node);
+            string = c_string(symbol_name(cmd->symbol));
+            emit("if (!_%u) jpl_fail_assertion(%s);", value, string);
+            free(string);
+            break;
+        case PRINT_CMD:
+            string = c_string(symbol_name(cmd->symbol));
+            emit("jpl_print(%s);", string);
+            free(string);
+            break;
+        case SHOW_CMD:
+            value = generate_expr(cmd->field1.node);
+            emit("%s(_%u);", get_show_name(nodevec_get(node_list, cmd->field1.node)->field4.node), value);
+            emit("putchar('\\n');");
+            break;
+        case TIME_CMD:
+            temp = temp_count++;
+            emit("double _%u = jpl_get_time();", temp);
+            generate_cmd(cmd->field1.node);
+            emit("jpl_print_time(jpl_get_time() - _%u);", temp);
+            break;
+        case FN_CMD:
+            generate_fn_cmd(cmd_index);
+            break;
+        case STRUCT_CMD:
+            get_type_name(cmd->field2.node);
+            break;
+    }
+}
+
+void generate_fn_cmd(uint32_t cmd_index) {
+    AstNode *cmd = nodevec_get(node_list, cmd_index);
+    if (!cmd) return;
+
+    CVec *saved_code = code;
+    uint32_t saved_indent = indent;
+    code = fn_buffer;
+    indent = 0;
+
+    ChildList bind_list = cmd->field1.list;
+    ChildList stmt_list = cmd->field3.list;
+
+    cvec_append_format(code, "static %s f_%.*s(", get_type_name(cmd->field2.node), REF_ARGS(symbol_name(cmd->symbol)));
+    AstNode *bind, *lvalue;
+    for (size_t i = 0; i < childlist_size(bind_list); ++i) {
+        bind = nodevec_get(node_list, childlist_get(bind_list, i));
+        lvalue = nodevec_get(node_list, bind->field1.node);
+        if (i) cvec_append_array(code, ", ", 2);
+        cvec_append_format(code, "%s v_%.*s", get_type_name(bind->field2.node), REF_ARGS(symbol_name(lvalue->symbol)));
+    }
+    if (!childlist_size(bind_list))
+        cvec_append_array(code, "void", 4);
+    cvec_append_array_line(code, ") {", 3);
+
+    indent = 1;
+
+    // Array bindings also bind their dimensions
+    for (size_t i = 0; i < childlist_size(bind_list); ++i) {
+        bind = nodevec_get(node_list, childlist_get(bind_list, i));
+        lvalue = nodevec_get(node_list, bind->field1.node);
+        if (lvalue->type.lvalue != ARRAY_LVALUE) continue;
+
+        ChildList list = lvalue->field1.list;
+        for (size_t j = 0; j < childlist_size(list); ++j) {
+            StringRef dim = symbol_name(nodevec_get(node_list, childlist_get(list, j))->symbol);
+            emit("int64_t v_%.*s = v_%.*s.d%zu;", REF_ARGS(dim), REF_ARGS(symbol_name(lvalue->symbol)), j);
+        }
+    }
+
+    int returns = 0;
+    AstNode *stmt;
+    for (size_t i = 0; i < childlist_size(stmt_list); ++i) {
+        uint64_t stmt_index = childlist_get(stmt_list, i);
+        generate_statement(stmt_index);
+        stmt = nodevec_get(node_list, stmt_index);
+        returns = stmt->type.stmt == RETURN_STMT;
+    }
+    if (!returns && nodevec_get(node_list, cmd->field2.node)->type.type == VOID_TYPE)
+        emit("return (jpl_void) {0};");
+
+    indent = 0;
+    emit("}");
+    emit("");
+
+    code = saved_code;
+    indent = saved_indent;
+}
+
+void generate_statement(uint32_t stmt_index) {
+    AstNode *stmt = nodevec_get(node_list, stmt_index);
+    if (!stmt) return;
+
+    uint32_t value;
+    char *string;
+    switch (stmt->type.stmt) {
+        case LET_STMT:
+            value = generate_expr(stmt->field3.node);
+            generate_lvalue(stmt->field1.node, value, 0);
+            break;
+        case ASSERT_STMT:
+            value = generate_expr(stmt->field1.node);
+            string = c_string(symbol_name(stmt->symbol));
+            emit("if (!_%u) jpl_fail_assertion(%s);", value, string);
+            free(string);
+            break;
+        case RETURN_STMT:
+            value = generate_expr(stmt->field1.node);
+            emit("return _%u;", value);
+            break;
+    }
+}
+
+// Binds the value held in the given temporary to an lvalue. Globals are declared at file scope so that
+// functions defined after them can read them.
+void generate_lvalue(uint32_t lvalue_index, uint32_t value, int is_global) {
+    AstNode *lvalue = nodevec_get(node_list, lvalue_index);
+    if (!lvalue) return;
+
+    char *type = get_type_name(lvalue->field2.node);
+    if (is_global) {
+        cvec_append_format(global_buffer, "static %s v_%.*s;\n", type, REF_ARGS(symbol_name(lvalue->symbol)));
+        emit("v_%.*s = _%u;", REF_ARGS(symbol_name(lvalue->symbol)), value);
+    }
+    else
+        emit("%s v_%.*s = _%u;", type, REF_ARGS(symbol_name(lvalue->symbol)), value);
+
+    if (lvalue->type.lvalue != ARRAY_LVALUE) return;
+
+    ChildList list = lvalue->field1.list;
+    for (size_t i = 0; i < childlist_size(list); ++i) {
+        StringRef dim = symbol_name(nodevec_get(node_list, childlist_get(list, i))->symbol);
+        if (is_global) {
+            cvec_append_format(global_buffer, "static int64_t v_%.*s;\n", REF_ARGS(dim));
+            emit("v_%.*s = v_%.*s.d%zu;", REF_ARGS(dim), REF_ARGS(symbol_name(lvalue->symbol)), i);
+        }
+        else
+            emit("int64_t v_%.*s = v_%.*s.d%zu;", REF_ARGS(dim), REF_ARGS(symbol_name(lvalue->symbol)), i);
+    }
+}
+
+uint32_t generate_expr(uint32_t expr_index) {
+    AstNode *expr = nodevec_get(node_list, expr_index);
+    if (!expr) return 0;
+
+    char *type = get_type_name(expr->field4.node);
+    ChildList list = expr->field1.list;
+    uint32_t temp, value;
+    char buffer[MAXIMUM_BUFFER];
+
+    switch (expr->type.expr) {
+        case INT_EXPR:
+            temp = temp_count++;
+            emit("int64_t _%u = %ld;", temp, (int64_t) expr->field1.int_value);
+            return temp;
+        case FLOAT_EXPR:
+            temp = temp_count++;
+            snprintf(buffer, MAXIMUM_BUFFER, "%.17g", expr->field1.float_value);
+            if (!strpbrk(buffer, ".en"))
+                strcat(buffer, ".0");
+            emit("double _%u = %s;", temp, buffer);
+            return temp;
+        case TRUE_EXPR:
+            temp = temp_count++;
+            emit("bool _%u = true;", temp);
+            return temp;
+        case FALSE_EXPR:
+            temp = temp_count++;
+            emit("bool _%u = false;", temp);
+            return temp;
+        case VOID_EXPR:
+            temp = temp_count++;
+            emit("jpl_void _%u = {0};", temp);
+            return temp;
+        case VAR_EXPR:
+            temp = temp_count++;
+            emit("%s _%u = v_%.*s;", type, temp, REF_ARGS(symbol_name(expr->symbol)));
+            return temp;
+        case ARRAYLITERAL_EXPR: {
+            uint32_t values[childlist_size(list)];
+            for (size_t i = 0; i < childlist_size(list); ++i)
+                values[i] = generate_expr(childlist_get(list, i));
+
+            char *element = get_type_name(nodevec_get(node_list, expr->field4.node)->field2.node);
+            temp = temp_count++;
+            emit("%s _%u;", type, temp);
+            emit("_%u.d0 = %zu;", temp, childlist_size(list));
+            emit("_%u.data = jpl_alloc(sizeof(%s) * %zu);", temp, element, childlist_size(list));
+            for (size_t i = 0; i < childlist_size(list); ++i)
+                emit("_%u.data[%zu] = _%u;", temp, i, values[i]);
+            return temp;
+        }
+        case STRUCTLITERAL_EXPR: {
+            uint32_t values[childlist_size(list)];
+            for (size_t i = 0; i < childlist_size(list); ++i)
+                values[i] = generate_expr(childlist_get(list, i));
+
+            CVec *members = cvec_create(); if (!members) exit(EXIT_FAILURE);
+            for (size_t i = 0; i < childlist_size(list); ++i)
+                cvec_append_format(members, i ? ", _%u" : "_%u", values[i]);
+            cvec_append(members, '\0');
+
+            temp = temp_count++;
+            emit("%s _%u = { %s };", type, temp, childlist_size(list) ? members->array : "0");
+            cvec_destroy(members);
+            return temp;
+        }
+        case DOT_EXPR:
+            value = generate_expr(expr->field1.node);
+            temp = temp_count++;
+            emit("%s _%u = _%u.m_%.*s;", type, temp, value, REF_ARGS(symbol_name(expr->symbol)));
+            return temp;
+        case ARRAYINDEX_EXPR:
+            return generate_arrayindex_expr(expr_index);
+        case CALL_EXPR:
+            return generate_call_expr(expr_index);
+        case UNOP_EXPR:
+            value = generate_expr(expr->field1.node);
+            temp = temp_count++;
+            if (*symbol_name(expr->symbol).string == '-' &&
+                nodevec_get(node_list, expr->field4.node)->type.type == INT_TYPE)
+                emit("%s _%u = -(uint64_t) _%u;", type, temp, value);
+            else
+                emit("%s _%u = %c_%u;", type, temp, *symbol_name(expr->symbol).string, value);
+            return temp;
+        case BINOP_EXPR:
+            return generate_binop_expr(expr_index);
+        case IF_EXPR:
+            return generate_if_expr(expr_index);
+        case ARRAYLOOP_EXPR:
+        case SUMLOOP_EXPR:
+            return generate_loop_expr(expr_index);
+    }
+
+    return 0;
+}
+
+uint32_t generate_arrayindex_expr(uint32_t expr_index) {
+    AstNode *expr = nodevec_get(node_list, expr_index);
+    if (!expr) return 0;
+
+    char *type = get_type_name(expr->field4.node);
+    AstNode *array_expr = nodevec_get(node_list, expr->field1.node);
+    StringRef array_name = symbol_name(array_expr->symbol);
+    uint32_t array = generate_expr(expr->field1.node);
+    ChildList list = expr->field2.list;
+    size_t rank = childlist_size(list);
+
+    char *indices[rank];
+    char *dims[rank];
+    for (size_t i = 0; i < rank; ++i) {
+        uint64_t index_expr = childlist_get(list, i);
+        uint32_t value = generate_expr(index_expr);
+
+        // A loop index stays in bounds for the whole loop if the loop bound does
+        LoopVar *loop = array_expr->type.expr == VAR_EXPR ? find_loop_var(index_expr) : NULL;
+        if (loop) {
+            if (add_loop_check(loop, array_expr->symbol, i))
+                cvec_append_format(loop->checks, "%*sif (_%u > v_%.*s.d%zu) jpl_fail(\"Index out of bounds\");\n",
+                                    loop->indent * INDENT_WIDTH, "", loop->bound, REF_ARGS(array_name), i);
+        }
+        else
+            emit("if (_%u < 0 || _%u >= _%u.d%zu) jpl_fail(\"Index out of bounds\");", value, value, array, i);
+        indices[i] = format_string("_%u", value);
+        dims[i] = format_string("_%u.d%zu", array, i);
+    }
+
+    char *offset = flat_index(rank, indices, dims);
+    uint32_t temp = temp_count++;
+    emit("%s _%u = _%u.data[%s];", type, temp, array, offset);
+
+    free(offset);
+    free_strings(indices, rank);
+    free_strings(dims, rank);
+    return temp;
+}
+
+uint32_t generate_call_expr(uint32_t expr_index) {
+    AstNode *expr = nodevec_get(node_list, expr_index);
+    if (!expr) return 0;
+
+    char *type = get_type_name(expr->field4.node);
+    ChildList list = expr->field1.list;
+
+    CVec *args = cvec_create(); if (!args) exit(EXIT_FAILURE);
+    for (size_t i = 0; i < childlist_size(list); ++i) {
+        uint32_t value = generate_expr(childlist_get(list, i));
+        cvec_append_format(args, i ? ", _%u" : "_%u", value);
+    }
+    cvec_append(args, '\0');
+
+    uint32_t temp = temp_count++;
+    if (!ref_array_cmp(symbol_name(expr->symbol), "to_float"))
+        emit("double _%u = (double) %s;", temp, args->array);
+    else if (!ref_array_cmp(symbol_name(expr->symbol), "to_int"))
+        emit("int64_t _%u = jpl_to_int(%s);", temp, args->array);
+    else if (is_builtin(symbol_name(expr->symbol)))
+        emit("double _%u = %.*s(%s);", temp, REF_ARGS(symbol_name(expr->symbol)), args->array);
+    else
+        emit("%s _%u = f_%.*s(%s);", type, temp, REF_ARGS(symbol_name(expr->symbol)), args->array);
+
+    cvec_destroy(args);
+    return temp;
+}
+
+uint32_t generate_binop_expr(uint32_t expr_index) {
+    AstNode *expr = nodevec_get(node_list, expr_index);
+    if (!expr) return 0;
+
+    char *type = get_type_name(expr->field4.node);
+    StringRef op = symbol_name(expr->symbol);
+    uint32_t temp, lhs, rhs;
+
+    lhs = generate_expr(expr->field1.node);
+
+    // Short-circuiting operators only evaluate their right side when needed
+    if (!ref_array_cmp(op, "&&") || !ref_array_cmp(op, "||")) {
+        temp = temp_count++;
+        emit("bool _%u = _%u;", temp, lhs);
+        emit(*op.string == '&' ? "if (_%u) {" : "if (!_%u) {", temp);
+        ++indent;
+        ++branch_depth;
+        rhs = generate_expr(expr->field2.node);
+        emit("_%u = _%u;", temp, rhs);
+        --branch_depth;
+        --indent;
+        emit("}");
+        return temp;
+    }
+
+    rhs = generate_expr(expr->field2.node);
+    TypeType operand_type = nodevec_get(node_list, nodevec_get(node_list, expr->field1.node)->field4.node)->type.type;
+
+    temp = temp_count++;
+    int int_op = operand_type == INT_TYPE && op.length == 1;
+    if (int_op && (*op.string == '/' || *op.string == '%'))
+        emit("if (_%u == 0) jpl_fail(\"%s by zero\");", rhs, *op.string == '/' ? "Division" : "Modulo");
+    if (operand_type == FLOAT_TYPE && *op.string == '%')
+        emit("%s _%u = fmod(_%u, _%u);", type, temp, lhs, rhs);
+    // Signed overflow is undefined in C, so integers wrap through uint64_t, and INT64_MIN / -1 with them
+    else if (int_op && *op.string == '/')
+        emit("%s _%u = _%u == -1 ? -(uint64_t) _%u : _%u / _%u;", type, temp, rhs, lhs, lhs, rhs);
+    else if (int_op && *op.string == '%')
+        emit("%s _%u = _%u == -1 ? 0 : _%u %% _%u;", type, temp, rhs, lhs, rhs);
+    else if (int_op && strchr("+-*", *op.string))
+        emit("%s _%u = (uint64_t) _%u %c (uint64_t) _%u;", type, temp, lhs, *op.string, rhs);
+    else
+        emit("%s _%u = _%u %.*s _%u;", type, temp, lhs, REF_ARGS(op), rhs);
+
+    return temp;
+}
+
+uint32_t generate_if_expr(uint32_t expr_index) {
+    AstNode *expr = nodevec_get(node_list, expr_index);
+    if (!expr) return 0;
+
+    char *type = get_type_name(expr->field4.node);
+    uint32_t condition = generate_expr(expr->field1.node);
+    uint32_t temp = temp_count++;
+    uint32_t value;
+
+    emit("%s _%u;", type, temp);
+    emit("if (_%u) {", condition);
+    ++indent;
+    ++branch_depth;
+    value = generate_expr(expr->field2.node);
+    emit("_%u = _%u;", temp, value);
+    --indent;
+    emit("}");
+    emit("else {");
+    ++indent;
+    value = generate_expr(expr->field3.node);
+    emit("_%u = _%u;", temp, value);
+    --branch_depth;
+    --indent;
+    emit("}");
+
+    return temp;
+}
+
+// Array and sum comprehensions become one 'for' per bound, innermost last, writing a single contiguous buffer
+// in row-major order.
+uint32_t generate_loop_expr(uint32_t expr_index) {
+    AstNode *expr = nodevec_get(node_list, expr_index);
+    if (!expr) return 0;
+
+    char *type = get_type_name(expr->field4.node);
+    ChildList var_list = expr->field1.list;
+    ChildList bound_list = expr->field2.list;
+    size_t rank = childlist_size(var_list);
+    int is_array = expr->type.expr == ARRAYLOOP_EXPR;
+
+    uint32_t bounds[rank];
+    for (size_t i = 0; i < rank; ++i) {
+        bounds[i] = generate_expr(childlist_get(bound_list, i));
+        emit("if (_%u <= 0) jpl_fail(\"Non-positive loop bound\");", bounds[i]);
+    }
+
+    uint32_t temp = temp_count++;
+    if (is_array) {
+        char *element = get_type_name(nodevec_get(node_list, expr->field4.node)->field2.node);
+        emit("%s _%u;", type, temp);
+        for (size_t i = 0; i < rank; ++i)
+            emit("_%u.d%zu = _%u;", temp, i, bounds[i]);
+
+        CVec *size = cvec_create(); if (!size) exit(EXIT_FAILURE);
+        for (size_t i = 0; i < rank; ++i)
+            cvec_append_format(size, " * _%u", bounds[i]);
+        cvec_append(size, '\0');
+        emit("_%u.data = jpl_alloc(sizeof(%s)%s);", temp, element, size->array);
+        cvec_destroy(size);
+    }
+    else
+        emit("%s _%u = 0;", type, temp);
+
+    // The body is generated first so that the bounds checks it hoists can be placed ahead of the loops
+    CVec *checks = cvec_create();
+    CVec *body = cvec_create();
+    if (!checks || !body) exit(EXIT_FAILURE);
+
+    char *indices[rank];
+    char *dims[rank];
+    LoopVar loops[rank];
+    for (size_t i = 0; i < rank; ++i) {
+        StringRef var = symbol_name(nodevec_get(node_list, childlist_get(var_list, i))->symbol);
+        indices[i] = format_string("v_%.*s", REF_ARGS(var));
+        dims[i] = format_string("_%u", bounds[i]);
+        loops[i] = (LoopVar) { var, intern_ref(var), bounds[i], branch_depth, indent, checks, {0} };
+        vector_append(open_loops, &loops[i]);
+    }
+
+    CVec *saved_code = code;
+    code = body;
+    indent += rank;
+
+    uint32_t value = generate_expr(expr->field3.node);
+    if (is_array) {
+        char *offset = flat_index(rank, indices, dims);
+        emit("_%u.data[%s] = _%u;", temp, offset, value);
+        free(offset);
+    }
+    else if (nodevec_get(node_list, expr->field4.node)->type.type == INT_TYPE)
+        emit("_%u = (uint64_t) _%u + _%u;", temp, temp, value);
+    else
+        emit("_%u += _%u;", temp, value);
+
+    indent -= rank;
+    code = saved_code;
+    open_loops->size -= rank;
+    for (size_t i = 0; i < rank; ++i)
+        u32vec_release(&loops[i].checked);
+
+    cvec_append_array(code, checks->array, checks->size);
+    for (size_t i = 0; i < rank; ++i) {
+        emit("for (int64_t %s = 0; %s < %s; ++%s) {", indices[i], indices[i], dims[i], indices[i]);
+        ++indent;
+    }
+    cvec_append_array(code, body->array, body->size);
+    for (size_t i = 0; i < rank; ++i) {
+        --indent;
+        emit("}");
+    }
+
+    cvec_destroy(checks);
+    cvec_destroy(body);
+    free_strings(indices, rank);
+    free_strings(dims, rank);
+    return temp;
+}
+
+// Returns the C name of a JPL type, emitting its typedef the first time it is used.
+char *get_type_name(uint64_t type_index) {
+    AstNode *type = nodevec_get(node_list, type_index);
+    if (!type) return "jpl_void";
+
+    char buffer[MAXIMUM_BUFFER];
+    char *name;
+    switch (type->type.type) {
+        case INT_TYPE:
+            return "int64_t";
+        case FLOAT_TYPE:
+            return "double";
+        case BOOL_TYPE:
+            return "bool";
+        case VOID_TYPE:
+        case VAR_TYPE:
+            return "jpl_void";
+        case STRUCT_TYPE: {
+            snprintf(buffer, MAXIMUM_BUFFER, "s_%.*s", REF_ARGS(symbol_name(type->symbol)));
+            if (dict_try_array(type_names, buffer, strlen(buffer), (void**) &name)) return name;
+            name = save_name(type_names, buffer);
+
+            uint64_t cmd_index;
+            if (!lookup_declaration(type->symbol, &cmd_index)) return name;
+            ChildList members = nodevec_get(node_list, cmd_index)->field1.list;
+            size_t count = childlist_size(members);
+
+            // Member typedefs must precede this one
+            char *member_types[count + 1];
+            for (size_t i = 0; i < count; ++i)
+                member_types[i] = get_type_name(nodevec_get(node_list, childlist_get(members, i))->field2.node);
+
+            cvec_append_format(type_buffer, "typedef struct {\n");
+            for (size_t i = 0; i < count; ++i) {
+                StringRef member = symbol_name(nodevec_get(node_list, childlist_get(members, i))->symbol);
+                cvec_append_format(type_buffer, "    %s m_%.*s;\n", member_types[i], REF_ARGS(member));
+            }
+            if (!count)
+                cvec_append_format(type_buffer, "    char unused;\n");
+            cvec_append_format(type_buffer, "} %s;\n\n", name);
+            return name;
+        }
+        case ARRAY_TYPE: {
+            char *element = get_type_name(type->field2.node);
+            snprintf(buffer, MAXIMUM_BUFFER, "a%ld_%s", type->field1.int_value, element);
+            if (dict_try_array(type_names, buffer, strlen(buffer), (void**) &name)) return name;
+            name = save_name(type_names, buffer);
+
+            cvec_append_format(type_buffer, "typedef struct {\n");
+            for (uint64_t i = 0; i < type->field1.int_value; ++i)
+                cvec_append_format(type_buffer, "    int64_t d%ld;\n", i);
+            cvec_append_format(type_buffer, "    %s *data;\n} %s;\n\n", element, name);
+            return name;
+        }
+    }
+
+    return "jpl_void";
+}
+
+// Returns the name of the function printing values of a JPL type, emitting it the first time it is used.
+char *get_show_name(uint64_t type_index) {
+    AstNode *type = nodevec_get(node_list, type_index);
+    if (!type) return "jpl_show_void";
+
+    switch (type->type.type) {
+        case INT_TYPE:
+            return "jpl_show_int";
+        case FLOAT_TYPE:
+            return "jpl_show_float";
+        case BOOL_TYPE:
+            return "jpl_show_bool";
+        case VOID_TYPE:
+        case VAR_TYPE:
+            return "jpl_show_void";
+        case STRUCT_TYPE:
+        case ARRAY_TYPE:
+            break;
+    }
+
+    char *type_name = get_type_name(type_index);
+    char buffer[MAXIMUM_BUFFER];
+    char *name;
+    snprintf(buffer, MAXIMUM_BUFFER, "show_%s", type_name);
+    if (dict_try_array(show_names, buffer, strlen(buffer), (void**) &name)) return name;
+
+    // Inner show functions must precede this one
+    ChildList members = 0;
+    size_t count = 1;
+    if (type->type.type == STRUCT_TYPE) {
+        uint64_t cmd_index;
+        if (lookup_declaration(type->symbol, &cmd_index))
+            members = nodevec_get(node_list, cmd_index)->field1.list;
+        count = childlist_size(members);
+    }
+
+    char *inner[count + 1];
+    if (type->type.type == ARRAY_TYPE)
+        inner[0] = get_show_name(type->field2.node);
+    for (size_t i = 0; members && i < count; ++i)
+        inner[i] = get_show_name(nodevec_get(node_list, childlist_get(members, i))->field2.node);
+
+    name = save_name(show_names, buffer);
+
+    CVec *saved_code = code;
+    uint32_t saved_indent = indent;
+    code = show_buffer;
+    indent = 0;
+
+    emit("static void %s(%s value) {", name, type_name);
+    indent = 1;
+    if (type->type.type == STRUCT_TYPE) {
+        emit("fputs(\"%.*s{\", stdout);", REF_ARGS(symbol_name(type->symbol)));
+        for (size_t i = 0; i < count; ++i) {
+            StringRef member = symbol_name(nodevec_get(node_list, childlist_get(members, i))->symbol);
+            if (i) emit("fputs(\", \", stdout);");
+            emit("%s(value.m_%.*s);", inner[i], REF_ARGS(member));
+        }
+        emit("fputs(\"}\", stdout);");
+    }
+    else {
+        uint64_t rank = type->field1.int_value;
+        emit("int64_t index = 0;");
+        for (uint64_t i = 0; i < rank; ++i) {
+            emit("fputs(\"[\", stdout);");
+            emit("for (int64_t i%ld = 0; i%ld < value.d%ld; ++i%ld) {", i, i, i, i);
+            ++indent;
+            emit("if (i%ld) fputs(\", \", stdout);", i);
+        }
+        emit("%s(value.data[index++]);", inner[0]);
+        for (uint64_t i = 0; i < rank; ++i) {
+            --indent;
+            emit("}");
+            emit("fputs(\"]\", stdout);");
+        }
+    }
+    indent = 0;
+    emit("}");
+    emit("");
+
+    code = saved_code;
+    indent = saved_indent;
+    return name;
+}
@@ -0,0 +1,765 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "interpreter.h"
+#include "typecheck.h"
+#include "runtime.h"
+
+#define NO_INSTR UINT32_MAX
+#define GLOBAL_SLOT 0x80000000u
+
+// The type-checked AST is lowered once into a flat array of instructions in which every variable is already
+// resolved to a frame slot, every function to a table index and every operator to a typed opcode. Executing
+// it is then a walk over that array with no name lookups, reusing the runtime the C backend links against.
+
+static TokenVec *token_list;
+static NodeVec *node_list;
+
+static Instr *program;
+static size_t program_size;
+static size_t program_capacity;
+
+static uint32_t *operands;
+static size_t operand_size;
+static size_t operand_capacity;
+
+static Function *functions;
+static size_t function_count;
+
+static Dict *symbols;
+static Dict *function_names;
+
+static uint32_t global_count;
+static uint32_t *slot_count;
+
+static Value *globals;
+
+static char *unary_builtins[] = { "sqrt", "exp", "sin", "cos", "tan", "asin", "acos", "atan", "log" };
+static double (*unary_functions[])(double) = { sqrt, exp, sin, cos, tan, asin, acos, atan, log };
+static char *binary_builtins[] = { "pow", "atan2" };
+static double (*binary_functions[])(double, double) = { pow, atan2 };
+
+static uint32_t emit_instr(Instr instr) {
+    if (program_size == program_capacity)
+        program = array_grow(program, &program_capacity, sizeof(Instr), 256);
+    program[program_size] = instr;
+    return program_size++;
+}
+
+// Copies a list of lowered children into consecutive operands. Children are lowered before this is called, so
+// their own lists never interleave with this one.
+static uint32_t emit_operands(uint32_t *values, size_t count) {
+    while (operand_size + count > operand_capacity)
+        operands = array_grow(operands, &operand_capacity, sizeof(uint32_t), 256);
+    uint32_t start = operand_size;
+    memcpy(operands + operand_size, values, sizeof(uint32_t) * count);
+    operand_size += count;
+    return start;
+}
+
+// Reserves consecutive slots in the frame being lowered. At the top level that frame is the global one.
+static uint32_t allocate_slots(uint32_t count) {
+    uint32_t slot = *slot_count;
+    *slot_count += count;
+    return slot;
+}
+
+static void bind_symbol(StringRef name, uint32_t slot) {
+    if (slot_count == &global_count) slot |= GLOBAL_SLOT;
+    dict_add_ref(symbols, name, (void*) (uint64_t) slot);
+}
+
+static TypeType get_expr_type(uint32_t expr_index) {
+    return nodevec_get(node_list, nodevec_get(node_list, expr_index)->field4.node)->type.type;
+}
+
+// Copies a JPL string token without its quotes.
+static char *unquote(StringRef string) {
+    return array_from_ref((StringRef) { string.length - 2, string.string + 1 });
+}
+
+static int find_builtin(char **names, size_t count, StringRef name) {
+    for (size_t i = 0; i < count; ++i) {
+        if (!ref_array_cmp(name, names[i])) return i;
+    }
+    return -1;
+}
+
+// Returns the position of a member in the declaration of the struct type it belongs to.
+static uint32_t find_member(uint64_t type_index, uint32_t member) {
+    uint64_t cmd_index;
+    if (!lookup_declaration(nodevec_get(node_list, type_index)->symbol, &cmd_index)) return 0;
+
+    ChildList members = nodevec_get(node_list, cmd_index)->field1.list;
+    for (size_t i = 0; i < childlist_size(members); ++i) {
+        if (nodevec_get(node_list, childlist_get(members, i))->symbol == member) return i;
+    }
+    return 0;
+}
+
+// Removes an lvalue, and the dimensions it binds, from scope.
+static void unbind_lvalue(uint32_t lvalue_index) {
+    AstNode *lvalue = nodevec_get(node_list, lvalue_index);
+    if (!lvalue) return;
+
+    dict_remove_ref(symbols, symbol_name(lvalue->symbol));
+    if (lvalue->type.lvalue != ARRAY_LVALUE) return;
+    for (size_t i = 0; i < childlist_size(lvalue->field1.list); ++i)
+        dict_remove_ref(symbols, symbol_name(nodevec_get(node_list, childlist_get(lvalue->field1.list, i))->symbol));
+}
+
+static Array *create_array(int64_t rank, int64_t *dims) {
+    int64_t size = 1;
+    for (int64_t i = 0; i < rank; ++i)
+        size *= dims[i];
+
+    Array *array = jpl_alloc(sizeof(Array) + sizeof(int64_t) * rank + sizeof(Value) * size);
+    array->size = size;
+    array->data = (Value*) (array->dims + rank);
+    memcpy(array->dims, dims, sizeof(int64_t) * rank);
+    return array;
+}
+
+int run_program(TokenVec *tokens, NodeVec *nodes, Vector *cmd_nodes, int argc, char **argv) {
+    if (!tokens || !nodes || !cmd_nodes) return EXIT_FAILURE;
+
+    token_list = tokens;
+    node_list = nodes;
+
+    symbols = dict_create_small();
+    function_names = dict_create_small();
+    if (!symbols || !function_names) return EXIT_FAILURE;
+
+    slot_count = &global_count;
+
+    // Command line arguments
+    bind_symbol((StringRef) {4, "args"}, allocate_slots(2));
+    bind_symbol((StringRef) {6, "argnum"}, 1);
+
+    uint32_t cmds[cmd_nodes->size + 1];
+    for (size_t i = 0; i < cmd_nodes->size; ++i)
+        cmds[i] = lower_cmd((uint64_t) vector_get(cmd_nodes, i));
+
+    dict_free(symbols);
+    dict_free(function_names);
+
+    globals = jpl_alloc(sizeof(Value) * global_count);
+    int64_t argnum;
+    int64_t *args = jpl_args(argc, argv, &argnum);
+    globals[0].array = create_array(1, &argnum);
+    for (int64_t i = 0; i < argnum; ++i)
+        globals[0].array->data[i].int_value = args[i];
+    globals[1].int_value = argnum;
+    free(args);
+
+    Value result;
+    for (size_t i = 0; i < cmd_nodes->size; ++i)
+        execute(cmds[i], globals, &result);
+    fflush(stdout);
+
+    return EXIT_SUCCESS;
+}
+
+uint32_t lower_cmd(uint32_t cmd_index) {
+    AstNode *cmd = nodevec_get(node_list, cmd_index);
+    if (!cmd) return NO_INSTR;
+
+    Instr instr = { .op = OP_NOP };
+    switch (cmd->type.cmd) {
+        case READ_CMD:
+            instr.op = OP_READ;
+            instr.string = unquote(symbol_name(cmd->symbol));
+            instr.a = lower_lvalue(cmd->field1.node);
+            instr.count = 2;
+            break;
+        case WRITE_CMD:
+            instr.op = OP_WRITE;
+            instr.a = lower_expr(cmd->field1.node);
+            instr.string = unquote(symbol_name(cmd->symbol));
+            break;
+        case LET_CMD:
+            instr.op = OP_LET;
+            instr.a = lower_expr(cmd->field3.node);
+            instr.b = lower_lvalue(cmd->field1.node);
+            instr.count = nodevec_get(node_list, cmd->field1.node)->type.lvalue == ARRAY_LVALUE
+                ? childlist_size(nodevec_get(node_list, cmd->field1.node)->field1.list) : 0;
+            break;
+        case ASSERT_CMD:
+            instr.op = OP_ASSERT;
+            instr.a = lower_expr(cmd->field1.node);
+            instr.string = unquote(symbol_name(cmd->symbol));
+            break;
+        case PRINT_CMD:
+            instr.op = OP_PRINT;
+            instr.string = unquote(symbol_name(cmd->symbol));
+            break;
+        case SHOW_CMD:
+            instr.op = OP_SHOW;
+            instr.a = lower_expr(cmd->field1.node);
+            instr.b = nodevec_get(node_list, cmd->field1.node)->field4.node;
+            break;
+        case TIME_CMD:
+            instr.op = OP_TIME;
+            instr.a = lower_cmd(cmd->field1.node);
+            break;
+        case FN_CMD:
+            lower_fn_cmd(cmd_index);
+            break;
+        case STRUCT_CMD:
+            break;
+    }
+
+    return emit_instr(instr);
+}
+
+uint32_t lower_fn_cmd(uint32_t cmd_index) {
+    AstNode *cmd = nodevec_get(node_list, cmd_index);
+    if (!cmd) return NO_INSTR;
+
+    // Registered before the body is lowered so that recursive calls resolve
+    uint32_t id = function_count++;
+    functions = realloc(functions, sizeof(Function) * function_count); if (!functions) exit(EXIT_FAILURE);
+    dict_add_ref(function_names, symbol_name(cmd->symbol), (void*) (uint64_t) id);
+
+    Function function = {0};
+    slot_count = &function.frame_size;
+
+    ChildList bind_list = cmd->field1.list;
+    ChildList stmt_list = cmd->field3.list;
+    size_t param_count = childlist_size(bind_list);
+    size_t stmt_count = childlist_size(stmt_list);
+
+    uint32_t params[2 * param_count + 1];
+    for (size_t i = 0; i < param_count; ++i) {
+        AstNode *bind = nodevec_get(node_list, childlist_get(bind_list, i));
+        AstNode *lvalue = nodevec_get(node_list, bind->field1.node);
+        params[2 * i] = lower_lvalue(bind->field1.node);
+        params[2 * i + 1] = lvalue->type.lvalue == ARRAY_LVALUE ? childlist_size(lvalue->field1.list) : 0;
+    }
+
+    uint32_t body[stmt_count + 1];
+    for (size_t i = 0; i < stmt_count; ++i)
+        body[i] = lower_statement(childlist_get(stmt_list, i));
+
+    // Locals go out of scope with the function
+    for (size_t i = 0; i < param_count; ++i)
+        unbind_lvalue(nodevec_get(node_list, childlist_get(bind_list, i))->field1.node);
+    for (size_t i = 0; i < stmt_count; ++i) {
+        AstNode *stmt = nodevec_get(node_list, childlist_get(stmt_list, i));
+        if (stmt->type.stmt == LET_STMT)
+            unbind_lvalue(stmt->field1.node);
+    }
+
+    function.params = emit_operands(params, 2 * param_count);
+    function.param_count = param_count;
+    function.body = emit_operands(body, stmt_count);
+    function.body_count = stmt_count;
+    functions[id] = function;
+
+    slot_count = &global_count;
+    return id;
+}
+
+uint32_t lower_statement(uint32_t stmt_index) {
+    AstNode *stmt = nodevec_get(node_list, stmt_index);
+    if (!stmt) return NO_INSTR;
+
+    Instr instr = { .op = OP_NOP };
+    switch (stmt->type.stmt) {
+        case LET_STMT:
+            instr.op = OP_LET;
+            instr.a = lower_expr(stmt->field3.node);
+            instr.b = lower_lvalue(stmt->field1.node);
+            instr.count = nodevec_get(node_list, stmt->field1.node)->type.lvalue == ARRAY_LVALUE
+                ? childlist_size(nodevec_get(node_list, stmt->field1.node)->field1.list) : 0;
+            break;
+        case ASSERT_STMT:
+            instr.op = OP_ASSERT;
+            instr.a = lower_expr(stmt->field1.node);
+            instr.string = unquote(symbol_name(stmt->symbol));
+            break;
+        case RETURN_STMT:
+            instr.op = OP_RETURN;
+            instr.a = lower_expr(stmt->field1.node);
+            break;
+    }
+
+    return emit_instr(instr);
+}
+
+// Binds an lvalue to a fresh slot, followed by one slot per bound dimension. Returns the first slot.
+uint32_t lower_lvalue(uint32_t lvalue_index) {
+    AstNode *lvalue = nodevec_get(node_list, lvalue_index);
+    if (!lvalue) return 0;
+
+    size_t rank = lvalue->type.lvalue == ARRAY_LVALUE ? childlist_size(lvalue->field1.list) : 0;
+    uint32_t slot = allocate_slots(1 + rank);
+    bind_symbol(symbol_name(lvalue->symbol), slot);
+
+    for (size_t i = 0; i < rank; ++i)
+        bind_symbol(symbol_name(nodevec_get(node_list, childlist_get(lvalue->field1.list, i))->symbol), slot + 1 + i);
+
+    return slot;
+}
+
+uint32_t lower_expr(uint32_t expr_index) {
+    AstNode *expr = nodevec_get(node_list, expr_index);
+    if (!expr) return NO_INSTR;
+
+    ChildList list = expr->field1.list;
+    Instr instr = { .op = OP_CONST };
+    void *slot;
+
+    switch (expr->type.expr) {
+        case INT_EXPR:
+            instr.value.int_value = expr->field1.int_value;
+            break;
+        case FLOAT_EXPR:
+            instr.value.float_value = expr->field1.float_value;
+            break;
+        case TRUE_EXPR:
+            instr.value.int_value = 1;
+            break;
+        case FALSE_EXPR:
+        case VOID_EXPR:
+            break;
+        case VAR_EXPR:
+            if (!dict_try_ref(symbols, symbol_name(expr->symbol), &slot)) break;
+            instr.op = (uint64_t) slot & GLOBAL_SLOT ? OP_GLOBAL : OP_LOCAL;
+            instr.a = (uint64_t) slot & ~GLOBAL_SLOT;
+            break;
+        case ARRAYLITERAL_EXPR:
+        case STRUCTLITERAL_EXPR: {
+            uint32_t values[childlist_size(list) + 1];
+            for (size_t i = 0; i < childlist_size(list); ++i)
+                values[i] = lower_expr(childlist_get(list, i));
+
+            instr.op = expr->type.expr == ARRAYLITERAL_EXPR ? OP_ARRAY_LITERAL : OP_STRUCT_LITERAL;
+            instr.list = emit_operands(values, childlist_size(list));
+            instr.count = childlist_size(list);
+            break;
+        }
+        case DOT_EXPR:
+            instr.op = OP_DOT;
+            instr.a = lower_expr(expr->field1.node);
+            instr.b = find_member(nodevec_get(node_list, expr->field1.node)->field4.node, expr->symbol);
+            break;
+        case ARRAYINDEX_EXPR: {
+            ChildList indices = expr->field2.list;
+            uint32_t values[childlist_size(indices) + 1];
+            instr.op = OP_INDEX;
+            instr.a = lower_expr(expr->field1.node);
+            for (size_t i = 0; i < childlist_size(indices); ++i)
+                values[i] = lower_expr(childlist_get(indices, i));
+            instr.list = emit_operands(values, childlist_size(indices));
+            instr.count = childlist_size(indices);
+            break;
+        }
+        case CALL_EXPR:
+            return lower_call_expr(expr_index);
+        case UNOP_EXPR:
+            instr.a = lower_expr(expr->field1.node);
+            if (*symbol_name(expr->symbol).string == '!')
+                instr.op = OP_NOT;
+            else
+                instr.op = get_expr_type(expr_index) == INT_TYPE ? OP_NEG_INT : OP_NEG_FLOAT;
+            break;
+        case BINOP_EXPR:
+            return lower_binop_expr(expr_index);
+        case IF_EXPR:
+            instr.op = OP_IF;
+            instr.a = lower_expr(expr->field1.node);
+            instr.b = lower_expr(expr->field2.node);
+            instr.c = lower_expr(expr->field3.node);
+            break;
+        case ARRAYLOOP_EXPR:
+        case SUMLOOP_EXPR:
+            return lower_loop_expr(expr_index);
+    }
+
+    return emit_instr(instr);
+}
+
+uint32_t lower_call_expr(uint32_t expr_index) {
+    AstNode *expr = nodevec_get(node_list, expr_index);
+    if (!expr) return NO_INSTR;
+
+    ChildList list = expr->field1.list;
+    uint32_t values[childlist_size(list) + 1];
+    for (size_t i = 0; i < childlist_size(list); ++i)
+        values[i] = lower_expr(childlist_get(list, i));
+
+    Instr instr = { .op = OP_CALL };
+    StringRef name = symbol_name(expr->symbol);
+    void *id;
+    int builtin;
+
+    if (dict_try_ref(function_names, name, &id)) {
+        instr.a = (uint64_t) id;
+        instr.list = emit_operands(values, childlist_size(list));
+        instr.count = childlist_size(list);
+    }
+    else if (!ref_array_cmp(name, "to_float"))
+        instr = (Instr) { .op = OP_TO_FLOAT, .a = values[0] };
+    else if (!ref_array_cmp(name, "to_int"))
+        instr = (Instr) { .op = OP_TO_INT, .a = values[0] };
+    else if ((builtin = find_builtin(unary_builtins, sizeof(unary_builtins) / sizeof(char*), name)) >= 0)
+        instr = (Instr) { .op = OP_BUILTIN, .a = values[0], .c = builtin };
+    else {
+        builtin = find_builtin(binary_builtins, sizeof(binary_builtins) / sizeof(char*), name);
+        instr = (Instr) { .op = OP_BUILTIN2, .a = values[0], .b = values[1] };
+        instr.c = builtin < 0 ? 0 : builtin;
+    }
+
+    return emit_instr(instr);
+}
+
+uint32_t lower_binop_expr(uint32_t expr_index) {
+    AstNode *expr = nodevec_get(node_list, expr_index);
+    if (!expr) return NO_INSTR;
+
+    StringRef op = symbol_name(expr->symbol);
+    Instr instr = { .a = lower_expr(expr->field1.node), .b = lower_expr(expr->field2.node) };
+    int is_float = get_expr_type(expr->field1.node) == FLOAT_TYPE;
+
+    // Integer opcodes are each immediately followed by their float counterpart
+    switch (*op.string) {
+        case '+': instr.op = OP_ADD_INT; break;
+        case '-': instr.op = OP_SUB_INT; break;
+        case '*': instr.op = OP_MUL_INT; break;
+        case '/': instr.op = OP_DIV_INT; break;
+        case '%': instr.op = OP_MOD_INT; break;
+        case '<': instr.op = op.length == 1 ? OP_LT_INT : OP_LE_INT; break;
+        case '>': instr.op = op.length == 1 ? OP_GT_INT : OP_GE_INT; break;
+        case '=': instr.op = OP_EQ_INT; break;
+        case '!': instr.op = OP_NE_INT; break;
+        case '&': instr.op = OP_AND; is_float = 0; break;
+        case '|': instr.op = OP_OR; is_float = 0; break;
+    }
+
+    if (is_float)
+        instr.op += instr.op >= OP_LT_INT ? OP_LT_FLOAT - OP_LT_INT : OP_ADD_FLOAT - OP_ADD_INT;
+
+    return emit_instr(instr);
+}
+
+// Loop variables take consecutive slots, outermost first, so the loop can step them like an odometer.
+uint32_t lower_loop_expr(uint32_t expr_index) {
+    AstNode *expr = nodevec_get(node_list, expr_index);
+    if (!expr) return NO_INSTR;
+
+    ChildList var_list = expr->field1.list;
+    ChildList bound_list = expr->field2.list;
+    size_t rank = childlist_size(var_list);
+
+    uint32_t bounds[rank + 1];
+    for (size_t i = 0; i < rank; ++i)
+        bounds[i] = lower_expr(childlist_get(bound_list, i));
+
+    Instr instr = { .op = OP_ARRAY_LOOP, .a = allocate_slots(rank), .count = rank };
+    if (expr->type.expr == SUMLOOP_EXPR)
+        instr.op = get_expr_type(expr_index) == INT_TYPE ? OP_SUM_INT : OP_SUM_FLOAT;
+
+    for (size_t i = 0; i < rank; ++i)
+        bind_symbol(symbol_name(nodevec_get(node_list, childlist_get(var_list, i))->symbol), instr.a + i);
+
+    instr.b = lower_expr(expr->field3.node);
+    instr.list = emit_operands(bounds, rank);
+
+    for (size_t i = 0; i < rank; ++i)
+        dict_remove_ref(symbols, symbol_name(nodevec_get(node_list, childlist_get(var_list, i))->symbol));
+
+    return emit_instr(instr);
+}
+
+// Evaluates the bounds of a loop instruction and sets its index variables to zero. Returns the iteration count.
+static int64_t start_loop(Instr *instr, Value *frame, int64_t *dims) {
+    int64_t size = 1;
+    for (uint32_t i = 0; i < instr->count; ++i) {
+        dims[i] = evaluate(operands[instr->list + i], frame).int_value;
+        if (dims[i] <= 0) jpl_fail("Non-positive loop bound");
+        size *= dims[i];
+    }
+    for (uint32_t i = 0; i < instr->count; ++i)
+        frame[instr->a + i].int_value = 0;
+    return size;
+}
+
+// Advances the index variables to the next position in row-major order.
+static inline void step_loop(Instr *instr, Value *frame, int64_t *dims) {
+    for (uint32_t i = instr->count; i-- > 0;) {
+        if (++frame[instr->a + i].int_value < dims[i]) return;
+        frame[instr->a + i].int_value = 0;
+    }
+}
+
+Value evaluate(uint32_t index, Value *frame) {
+    Instr *instr = &program[index];
+    Value result = {0};
+    Value left, right;
+
+    switch (instr->op) {
+        case OP_CONST:
+            return instr->value;
+        case OP_LOCAL:
+            return frame[instr->a];
+        case OP_GLOBAL:
+            return globals[instr->a];
+        case OP_ARRAY_LITERAL: {
+            int64_t size = instr->count;
+            result.array = create_array(1, &size);
+            for (uint32_t i = 0; i < instr->count; ++i)
+                result.array->data[i] = evaluate(operands[instr->list + i], frame);
+            return result;
+        }
+        case OP_STRUCT_LITERAL:
+            result.fields = jpl_alloc(sizeof(Value) * instr->count);
+            for (uint32_t i = 0; i < instr->count; ++i)
+                result.fields[i] = evaluate(operands[instr->list + i], frame);
+            return result;
+        case OP_DOT:
+            return evaluate(instr->a, frame).fields[instr->b];
+        case OP_INDEX: {
+            Array *array = evaluate(instr->a, frame).array;
+            int64_t offset = 0;
+            for (uint32_t i = 0; i < instr->count; ++i) {
+                int64_t value = evaluate(operands[instr->list + i], frame).int_value;
+                if (value < 0 || value >= array->dims[i]) jpl_fail("Index out of bounds");
+                offset = offset * array->dims[i] + value;
+            }
+            return array->data[offset];
+        }
+        case OP_CALL: {
+            Function *function = &functions[instr->a];
+            Value locals[function->frame_size + 1];
+            for (uint32_t i = 0; i < instr->count; ++i) {
+                Value arg = evaluate(operands[instr->list + i], frame);
+                uint32_t slot = operands[function->params + 2 * i];
+                uint32_t rank = operands[function->params + 2 * i + 1];
+                locals[slot] = arg;
+                for (uint32_t j = 0; j < rank; ++j)
+                    locals[slot + 1 + j].int_value = arg.array->dims[j];
+            }
+            for (uint32_t i = 0; i < function->body_count; ++i) {
+                if (execute(operands[function->body + i], locals, &result)) break;
+            }
+            return result;
+        }
+        case OP_BUILTIN:
+            result.float_value = unary_functions[instr->c](evaluate(instr->a, frame).float_value);
+            return result;
+        case OP_BUILTIN2:
+            left = evaluate(instr->a, frame);
+            right = evaluate(instr->b, frame);
+            result.float_value = binary_functions[instr->c](left.float_value, right.float_value);
+            return result;
+        case OP_TO_INT:
+            result.int_value = jpl_to_int(evaluate(instr->a, frame).float_value);
+            return result;
+        case OP_TO_FLOAT:
+            result.float_value = (double) evaluate(instr->a, frame).int_value;
+            return result;
+        case OP_NEG_INT:
+            result.int_value = -(uint64_t) evaluate(instr->a, frame).int_value;
+            return result;
+        case OP_NEG_FLOAT:
+            result.float_value = -evaluate(instr->a, frame).float_value;
+            return result;
+        case OP_NOT:
+            result.int_value = !evaluate(instr->a, frame).int_value;
+            return result;
+        case OP_AND:
+            result.int_value = evaluate(instr->a, frame).int_value && evaluate(instr->b, frame).int_value;
+            return result;
+        case OP_OR:
+            result.int_value = evaluate(instr->a, frame).int_value || evaluate(instr->b, frame).int_value;
+            return result;
+        case OP_IF:
+            return evaluate(evaluate(instr->a, frame).int_value ? instr->b : instr->c, frame);
+        case OP_ARRAY_LOOP: {
+            int64_t dims[instr->count];
+            int64_t size = start_loop(instr, frame, dims);
+            result.array = create_array(instr->count, dims);
+            for (int64_t i = 0; i < size; ++i) {
+                result.array->data[i] = evaluate(instr->b, frame);
+                step_loop(instr, frame, dims);
+            }
+            return result;
+        }
+        case OP_SUM_INT: {
+            int64_t dims[instr->count];
+            int64_t size = start_loop(instr, frame, dims);
+            for (int64_t i = 0; i < size; ++i) {
+                result.int_value = (uint64_t) result.int_value + evaluate(instr->b, frame).int_value;
+                step_loop(instr, frame, dims);
+            }
+            return result;
+        }
+        case OP_SUM_FLOAT: {
+            int64_t dims[instr->count];
+            int64_t size = start_loop(instr, frame, dims);
+            for (int64_t i = 0; i < size; ++i) {
+                result.float_value += evaluate(instr->b, frame).float_value;
+                step_loop(instr, frame, dims);
+            }
+            return result;
+        }
+        default:
+            break;
+    }
+
+    // Arithmetic and comparisons
+    left = evaluate(instr->a, frame);
+    right = evaluate(instr->b, frame);
+    switch (instr->op) {
+        case OP_ADD_INT: result.int_value = (uint64_t) left.int_value + right.int_value; break;
+        case OP_SUB_INT: result.int_value = (uint64_t) left.int_value - right.int_value; break;
+        case OP_MUL_INT: result.int_value = (uint64_t) left.int_value * right.int_value; break;
+        case OP_DIV_INT:
+            if (!right.int_value) jpl_fail("Division by zero");
+            // INT64_MIN / -1 traps, so -1 negates and wraps like the other operators
+            if (right.int_value == -1) result.int_value = -(uint64_t) left.int_value;
+            else result.int_value = left.int_value / right.int_value;
+            break;
+        case OP_MOD_INT:
+            if (!right.int_value) jpl_fail("Modulo by zero");
+            result.int_value = right.int_value == -1 ? 0 : left.int_value % right.int_value;
+            break;
+        case OP_ADD_FLOAT: result.float_value = left.float_value + right.float_value; break;
+        case OP_SUB_FLOAT: result.float_value = left.float_value - right.float_value; break;
+        case OP_MUL_FLOAT: result.float_value = left.float_value * right.float_value; break;
+        case OP_DIV_FLOAT: result.float_value = left.float_value / right.float_value; break;
+        case OP_MOD_FLOAT: result.float_value = fmod(left.float_value, right.float_value); break;
+        case OP_LT_INT: result.int_value = left.int_value < right.int_value; break;
+        case OP_LE_INT: result.int_value = left.int_value <= right.int_value; break;
+        case OP_GT_INT: result.int_value = left.int_value > right.int_value; break;
+        case OP_GE_INT: result.int_value = left.int_value >= right.int_value; break;
+        case OP_EQ_INT: result.int_value = left.int_value == right.int_value; break;
+        case OP_NE_INT: result.int_value = left.int_value != right.int_value; break;
+        case OP_LT_FLOAT: result.int_value = left.float_value < right.float_value; break;
+        case OP_LE_FLOAT: result.int_value = left.float_value <= right.float_value; break;
+        case OP_GT_FLOAT: result.int_value = left.float_value > right.float_value; break;
+        case OP_GE_FLOAT: result.int_value = left.float_value >= right.float_value; break;
+        case OP_EQ_FLOAT: result.int_value = left.float_value == right.float_value; break;
+        case OP_NE_FLOAT: result.int_value = left.float_value != right.float_value; break;
+        default: break;
+    }
+
+    return result;
+}
+
+// Executes a command or statement. Returns 1 once a return statement has stored its value in result.
+int execute(uint32_t index, Value *frame, Value *result) {
+    Instr *instr = &program[index];
+    Value value;
+
+    switch (instr->op) {
+        case OP_LET:
+            value = evaluate(instr->a, frame);
+            frame[instr->b] = value;
+            for (uint32_t i = 0; i < instr->count; ++i)
+                frame[instr->b + 1 + i].int_value = value.array->dims[i];
+            return 0;
+        case OP_ASSERT:
+            if (!evaluate(instr->a, frame).int_value) jpl_fail_assertion(instr->string);
+            return 0;
+        case OP_RETURN:
+            *result = evaluate(instr->a, frame);
+            return 1;
+        case OP_READ: {
+            int64_t dims[2];
+            double *pixels = jpl_read_image(instr->string, &dims[0], &dims[1]);
+            Array *array = create_array(2, dims);
+            Value *channels = jpl_alloc(sizeof(Value) * 4 * array->size);
+            for (int64_t i = 0; i < 4 * array->size; ++i)
+                channels[i].float_value = pixels[i];
+            for (int64_t i = 0; i < array->size; ++i)
+                array->data[i].fields = channels + 4 * i;
+            free(pixels);
+
+            frame[instr->a].array = array;
+            frame[instr->a + 1].int_value = dims[0];
+            frame[instr->a + 2].int_value = dims[1];
+            return 0;
+        }
+        case OP_WRITE: {
+            Array *array = evaluate(instr->a, frame).array;
+            double *pixels = jpl_alloc(sizeof(double) * 4 * array->size);
+            for (int64_t i = 0; i < array->size; ++i) {
+                for (int j = 0; j < 4; ++j)
+                    pixels[4 * i + j] = array->data[i].fields[j].float_value;
+            }
+            jpl_write_image(pixels, array->dims[0], array->dims[1], instr->string);
+            free(pixels);
+            return 0;
+        }
+        case OP_PRINT:
+            jpl_print(instr->string);
+            return 0;
+        case OP_SHOW:
+            show_value(evaluate(instr->a, frame), instr->b);
+            putchar('\n');
+            return 0;
+        case OP_TIME: {
+            double start = jpl_get_time();
+            execute(instr->a, frame, result);
+            jpl_print_time(jpl_get_time() - start);
+            return 0;
+        }
+        default:
+            return 0;
+    }
+}
+
+static void show_elements(Array *array, uint64_t rank, uint64_t dim, int64_t *index, uint64_t element) {
+    fputs("[", stdout);
+    for (int64_t i = 0; i < array->dims[dim]; ++i) {
+        if (i) fputs(", ", stdout);
+        if (dim + 1 < rank)
+            show_elements(array, rank, dim + 1, index, element);
+        else
+            show_value(array->data[(*index)++], element);
+    }
+    fputs("]", stdout);
+}
+
+// Prints a value in the same format as the show functions of the C backend.
+void show_value(Value value, uint64_t type_index) {
+    AstNode *type = nodevec_get(node_list, type_index);
+    if (!type) return;
+
+    switch (type->type.type) {
+        case INT_TYPE:
+            jpl_show_int(value.int_value);
+            break;
+        case FLOAT_TYPE:
+            jpl_show_float(value.float_value);
+            break;
+        case BOOL_TYPE:
+            jpl_show_bool(value.int_value);
+            break;
+        case VOID_TYPE:
+        case VAR_TYPE:
+            jpl_show_void((jpl_void) {0});
+            break;
+        case STRUCT_TYPE: {
+            uint64_t cmd_index;
+            ChildList members = 0;
+            if (lookup_declaration(type->symbol, &cmd_index))
+                members = nodevec_get(node_list, cmd_index)->field1.list;
+
+            printf("%.*s{", (int) symbol_name(type->symbol).length, symbol_name(type->symbol).string);
+            for (size_t i = 0; i < childlist_size(members); ++i) {
+                if (i) fputs(", ", stdout);
+                show_value(value.fields[i], nodevec_get(node_list, childlist_get(members, i))->field2.node);
+            }
+            fputs("}", stdout);
+            break;
+        }
+        case ARRAY_TYPE: {
+            int64_t index = 0;
+            show_elements(value.array, type->field1.int_value, 0, &index, type->field2.node);
+            break;
+        }
+    }
+}
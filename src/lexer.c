@@ -1,42 +1,111 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "lexer.h"
+#include "scan.h"
 
-static char* keywords[] = { "array", "assert", "bool", "else", "false", "float", "fn", "if", "image", "int", "let", "print",
-                                "read", "return", "show", "struct", "sum", "then", "time", "to", "true", "void", "write" };
+// Keywords are matched by first character, then by length and content
+#define KEYWORD(word, kind) \
+    if (len == sizeof(word) - 1 && !memcmp(string, word, len)) { \
+        *out = create_token(kind, loc, len, string); \
+        return 1; \
+    }
 
-static TokenType keyword_types[] = { ARRAY, ASSERT, BOOL, ELSE, FALSE, FLOAT, FN, IF, IMAGE, INT, LET, PRINT, READ,
-                                RETURN, SHOW, STRUCT, SUM, THEN, TIME, TO, TRUE, VOID, WRITE };
+static _Thread_local int lex_fail_status = EXIT_SUCCESS;
+static int lex_threads = 1;
+
+// The input need not be NUL-terminated. Reads at or past its end see '\0', which every scan treats as a stop.
+// Each thread lexes its own input, so helper threads copy the bounds of the input they were handed.
+static _Thread_local char *input_start;
+static _Thread_local char *input_end;
+
+// Streamed tokens pass from the lexing thread to the parser through a bounded ring. Head and tail count tokens
+// taken and added, so the ring is full when they differ by TOKEN_RING.
+static Token token_ring[TOKEN_RING];
+static Token token_stage[TOKEN_RING];
+static size_t stage_next;
+static size_t stage_size;
+static size_t ring_head;
+static size_t ring_tail;
+static int stream_ended;
+static char *stream_start;
+static char *stream_end;
+static pthread_t stream_thread;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_cond = PTHREAD_COND_INITIALIZER;
+
+static inline char peek_char(char *c_ptr) {
+    return c_ptr < input_end ? *c_ptr : '\0';
+}
 
-static int lex_fail_status = EXIT_SUCCESS;
-static Dict *keyword_dictionary;
-static TokenVec *token_vector;
+void lex_set_threads(int threads) {
+    lex_threads = threads > 1 ? threads : 1;
+}
+
+// Sets the input that lex_range reads, with a clean status
+void lex_setup(char *string, size_t size) {
+    input_start = string;
+    input_end = string + size;
+    lex_fail_status = EXIT_SUCCESS;
+}
+
+// Reports the invalid tokens from 'first' up to 'end'. Returns the status of the input lexed since lex_setup.
+int lex_report(TokenVec *token_vector, size_t first, size_t end) {
+    Token token;
+    for (size_t i = first; i < end && i < tokenvec_size(token_vector); ++i) {
+        TokenType type = tokenvec_kind(token_vector, i);
+        if (type == INVALID)
+            lex_error(INVALID_LEX, tokenvec_get(token_vector, i, &token));
+        else if (type == ILLEGAL)
+            lex_error(ILLEGAL_LEX, tokenvec_get(token_vector, i, &token));
+        else if (type == UNCLOSED)
+            lex_error(UNCLOSED_STRING, tokenvec_get(token_vector, i, &token));
+    }
+    return lex_fail_status;
+}
 
 int lex_string(char* string, size_t size, TokenVec **vector) {
-    uint32_t byte = 0;
-    uint32_t count = 0;
-    Token new_token;
+    TokenVec *token_vector;
+    char *end;
 
-    keyword_dictionary = create_keyword_dictionary();
-    if (!keyword_dictionary) {
-        fprintf(stderr, "keyword dictionary failure\n");
-        return EXIT_FAILURE;
+    lex_setup(string, size);
+
+    if (lex_threads > 1 && size >= 2 * LEX_CHUNK_MIN) {
+        token_vector = lex_parallel(string, &end);
+    }
+    else {
+        token_vector = tokenvec_create_cap(string, TOKEN_ESTIMATE(size));
+        if (token_vector) end = lex_range(string, input_end, token_vector);
     }
 
-    token_vector = tokenvec_create_cap(size);
     if (!token_vector) {
         fprintf(stderr, "tokenvec malloc failure\n");
         return EXIT_FAILURE;
     }
 
-    while (*string) {
-        while (*string == SPACE) {
-            ++string;
-            ++byte;
-        }
+    lex_report(token_vector, 0, tokenvec_size(token_vector));
+    tokenvec_append(token_vector, create_token(END_OF_FILE, end - input_start, 1, end));
+    tokenvec_shrink(token_vector);
+    *vector = token_vector;
+    
+    return lex_fail_status;
+}
+
+// Lexes tokens into 'vector' until one ends at or past 'stop'. Returns the position after the last token, which
+// is past 'stop' only when a token or comment runs over it.
+char *lex_range(char *string, char *stop, TokenVec *token_vector) {
+    uint32_t byte = string - input_start;
+    uint32_t count = 0;
+    Token new_token;
+
+    while (string < stop) {
+        char *next = scan_spaces(string, input_end);
+        byte += next - string;
+        string = next;
 
-        if (*string == '\0') break;
+        if (string >= input_end) break;
 
         switch (*string) {
             // Variables and keywords
@@ -102,7 +171,7 @@ int lex_string(char* string, size_t size, TokenVec **vector) {
 
             // Newlines
             case NEWLINE_M:
-                if (!tokenvec_is_empty(token_vector) && ((Token*) tokenvec_peek_last(token_vector))->type == NEWLINE) {
+                if (tokenvec_last_kind(token_vector) == NEWLINE) {
                     ++string;
                     ++byte;
                     continue;
@@ -113,9 +182,9 @@ int lex_string(char* string, size_t size, TokenVec **vector) {
 
             // Only escapes newlines
             case ESCAPE:
-                if (*(++string) == NEWLINE_M) {
+                if (peek_char(string + 1) == NEWLINE_M) {
                     byte += 2;
-                    ++string;
+                    string += 2;
                     continue;
                 }
                 else {
@@ -132,46 +201,227 @@ int lex_string(char* string, size_t size, TokenVec **vector) {
 
         tokenvec_append(token_vector, new_token);
 
-        if (new_token.type == INVALID)
-            lex_error(INVALID_LEX, tokenvec_peek_last(token_vector));
-        else if (new_token.type == ILLEGAL)
-            lex_error(ILLEGAL_LEX, tokenvec_peek_last(token_vector));
-        else if (new_token.type == UNCLOSED)
-            lex_error(UNCLOSED_STRING, tokenvec_peek_last(token_vector));
-
-
         string += count;
         byte += count;
     }
 
-    new_token = create_token(END_OF_FILE, byte, 1, string);
-    tokenvec_append(token_vector, new_token);
-    *vector = token_vector;
-    dict_free(keyword_dictionary);
-    
-    return lex_fail_status;
+    return string;
 }
 
-uint32_t lex_var_token(char *string, uint32_t loc, Token *out) {
-    uint32_t count = 1;
-    char *c_ptr = string + 1;
-    
-    int is_valid_char = 1;
-    while (is_valid_char) {
-        switch (*c_ptr) {
-            case LOWERCASE:
-            case UPPERCASE:
-            case DIGIT:
-            case SCORE:
-                ++c_ptr;
-                ++count;
+// Splits the input after newlines that lie outside comments and strings, lexes each chunk on its own thread and
+// stitches the results. A chunk whose predecessor ran past its start was lexed from the wrong state, so the
+// stretch it covers is lexed again serially from where the predecessor really ended.
+TokenVec *lex_parallel(char *string, char **end) {
+    size_t size = input_end - string;
+    size_t count = size / LEX_CHUNK_MIN < (size_t) lex_threads ? size / LEX_CHUNK_MIN : (size_t) lex_threads;
+
+    LexChunk *chunks = calloc(count, sizeof(LexChunk));
+    pthread_t *threads = calloc(count, sizeof(pthread_t));
+    int *started = calloc(count, sizeof(int));
+    if (!chunks || !threads || !started) return free_chunks(chunks, count, threads, started);
+
+    char *start = string;
+    for (size_t i = 0; i < count; ++i) {
+        char *stop = i == count - 1 ? input_end : next_split(start, string + size / count * (i + 1));
+        chunks[i] = (LexChunk) { start, stop, start, input_end, tokenvec_create_cap(string, TOKEN_ESTIMATE(stop - start)) };
+        if (!chunks[i].vector) return free_chunks(chunks, count, threads, started);
+
+        start = stop;
+    }
+
+    for (size_t i = 1; i < count; ++i)
+        started[i] = !pthread_create(&threads[i], NULL, lex_chunk, &chunks[i]);
+    lex_chunk(&chunks[0]);
+    for (size_t i = 1; i < count; ++i) {
+        if (started[i]) pthread_join(threads[i], NULL);
+        else lex_chunk(&chunks[i]);
+    }
+
+    size_t total = 1;
+    for (size_t i = 0; i < count; ++i)
+        total += tokenvec_size(chunks[i].vector);
+
+    TokenVec *token_vector = tokenvec_create_cap(string, total);
+    if (!token_vector) return free_chunks(chunks, count, threads, started);
+
+    char *position = string;
+    for (size_t i = 0; i < count; ++i) {
+        LexChunk *chunk = &chunks[i];
+
+        if (position == chunk->start) {
+            // The serial lexer drops a newline that follows another
+            int skip = tokenvec_kind(chunk->vector, 0) == NEWLINE && tokenvec_last_kind(token_vector) == NEWLINE;
+            tokenvec_extend(token_vector, chunk->vector, skip);
+            position = chunk->end;
+        }
+        else if (position < chunk->stop) {
+            position = lex_range(position, chunk->stop, token_vector);
+        }
+
+        tokenvec_destroy(chunk->vector);
+        chunk->vector = NULL;
+    }
+
+    free_chunks(chunks, count, threads, started);
+    *end = position;
+    return token_vector;
+}
+
+// Releases the chunks of a parallel lex along with their tokens. Returns NULL for the failure paths to pass on.
+TokenVec *free_chunks(LexChunk *chunks, size_t count, pthread_t *threads, int *started) {
+    for (size_t i = 0; chunks && i < count; ++i)
+        tokenvec_destroy(chunks[i].vector);
+    free(chunks);
+    free(threads);
+    free(started);
+    return NULL;
+}
+
+void *lex_chunk(void *arg) {
+    LexChunk *chunk = arg;
+    input_start = chunk->vector->source;
+    input_end = chunk->limit;
+    chunk->end = lex_range(chunk->start, chunk->stop, chunk->vector);
+    return NULL;
+}
+
+// Returns the position after the first newline at or past 'target' that the lexer would reach between tokens,
+// starting from a point between tokens. Mirrors how the lexer consumes strings, comments and escapes.
+char *next_split(char *string, char *target) {
+    while (string < input_end) {
+        switch (*string) {
+            case NEWLINE_M:
+                ++string;
+                if (string >= target) return string;
                 break;
-            default:
-                is_valid_char = 0;
+            case QUOTE:
+                ++string;
+                while (string < input_end && *string != NEWLINE_M && *string++ != QUOTE);
+                break;
+            case SLASH:
+                if (peek_char(string + 1) == SLASH) {
+                    string = scan_illegal(string + 2, input_end);
+                }
+                else if (peek_char(string + 1) == TIMES) {
+                    string += 2;
+                    while ((string = scan_comment(string, input_end)) < input_end) {
+                        if (*string++ == TIMES && peek_char(string) == SLASH) {
+                            ++string;
+                            break;
+                        }
+                    }
+                }
+                else {
+                    ++string;
+                }
                 break;
+            case ESCAPE:
+                string += 2;
+                break;
+            default:
+                ++string;
         }
     }
 
+    return input_end;
+}
+
+int lex_stream_start(char *string, size_t size) {
+    lex_setup(string, size);
+    ring_head = 0;
+    ring_tail = 0;
+    stage_next = 0;
+    stage_size = 0;
+    stream_ended = 0;
+    stream_start = string;
+    stream_end = string + size;
+
+    if (pthread_create(&stream_thread, NULL, lex_stream, NULL)) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+// Appends the tokens of the next command, up to and including its NEWLINE, to 'token_vector'. Returns 0 once
+// END_OF_FILE has been delivered. Tokens are taken from the ring a whole ring at a time to keep locking rare.
+int lex_stream_pull(TokenVec *token_vector) {
+    if (stream_ended) return 0;
+
+    while (1) {
+        if (stage_next == stage_size) {
+            pthread_mutex_lock(&ring_lock);
+            while (ring_head == ring_tail)
+                pthread_cond_wait(&ring_cond, &ring_lock);
+
+            for (stage_next = 0, stage_size = 0; ring_head != ring_tail; ++ring_head)
+                token_stage[stage_size++] = token_ring[ring_head % TOKEN_RING];
+            pthread_cond_signal(&ring_cond);
+            pthread_mutex_unlock(&ring_lock);
+        }
+
+        Token token = token_stage[stage_next++];
+
+        // Batches are lexed separately, so one may start with a newline that the serial lexer would drop
+        if (token.type == NEWLINE && tokenvec_last_kind(token_vector) == NEWLINE)
+            continue;
+
+        tokenvec_append(token_vector, token);
+        if (token.type == INVALID)
+            lex_error(INVALID_LEX, &token);
+        else if (token.type == ILLEGAL)
+            lex_error(ILLEGAL_LEX, &token);
+        else if (token.type == UNCLOSED)
+            lex_error(UNCLOSED_STRING, &token);
+
+        if (token.type == NEWLINE) return 1;
+        if (token.type == END_OF_FILE) break;
+    }
+
+    stream_ended = 1;
+    pthread_join(stream_thread, NULL);
+    return 1;
+}
+
+// Lexes the input in batches that end after a newline and pushes each batch into the ring
+void *lex_stream(void *arg) {
+    (void) arg;
+    input_start = stream_start;
+    input_end = stream_end;
+
+    TokenVec *batch = tokenvec_create(input_start);
+    if (!batch) exit(EXIT_FAILURE);
+
+    char *string = input_start;
+    while (string < input_end) {
+        tokenvec_clear(batch);
+        string = lex_range(string, next_split(string, string + LEX_BATCH), batch);
+        stream_push(batch);
+    }
+
+    tokenvec_clear(batch);
+    tokenvec_append(batch, create_token(END_OF_FILE, string - input_start, 1, string));
+    stream_push(batch);
+
+    tokenvec_destroy(batch);
+    return NULL;
+}
+
+void stream_push(TokenVec *batch) {
+    size_t i = 0;
+
+    pthread_mutex_lock(&ring_lock);
+    while (i < tokenvec_size(batch)) {
+        while (ring_tail - ring_head == TOKEN_RING)
+            pthread_cond_wait(&ring_cond, &ring_lock);
+
+        while (ring_tail - ring_head < TOKEN_RING && i < tokenvec_size(batch))
+            tokenvec_get(batch, i++, &token_ring[ring_tail++ % TOKEN_RING]);
+        pthread_cond_signal(&ring_cond);
+    }
+    pthread_mutex_unlock(&ring_lock);
+}
+
+uint32_t lex_var_token(char *string, uint32_t loc, Token *out) {
+    uint32_t count = scan_identifier(string + 1, input_end) - string;
+
     if (!is_keyword_match(string, loc, count, out))
         *out = create_token(VARIABLE, loc, count, string);
 
@@ -181,19 +431,19 @@ uint32_t lex_num_token(char *string, uint32_t loc, Token *out) {
     uint32_t count = 1;
     TokenType type = INTVAL;
     char *c_ptr = string + 1;
-    char c = *c_ptr;
+    char c = peek_char(c_ptr);
 
     while (IS_DIGIT(c)) {
         ++count;
-        c = *(++c_ptr);
+        c = peek_char(++c_ptr);
     }
 
     if (c == DOT_M) {
-        c = *(++c_ptr);
+        c = peek_char(++c_ptr);
         ++count;
         while (IS_DIGIT(c)) {
             ++count;
-            c = *(++c_ptr);
+            c = peek_char(++c_ptr);
         }
 
         type = FLOATVAL;
@@ -208,12 +458,12 @@ uint32_t lex_dot_token(char *string, uint32_t loc, Token *out) {
     uint32_t count = 1;
     TokenType type = INTVAL;
     char *c_ptr = string + 1;
-    char c = *c_ptr;
+    char c = peek_char(c_ptr);
 
     if (IS_DIGIT(c)) {
         while (IS_DIGIT(c)) {
             ++count;
-            c = *(++c_ptr);
+            c = peek_char(++c_ptr);
         }
 
         type = FLOATVAL;
@@ -264,7 +514,7 @@ uint32_t lex_punct_token(char *string, uint32_t loc, Token *out) {
 uint32_t lex_slash_token(char *string, uint32_t loc, Token *out) {
     uint32_t count = 1;
     char *c_ptr = string + 1;
-    char c = *c_ptr;
+    char c = peek_char(c_ptr);
 
     switch (c) {
         case SLASH:
@@ -277,44 +527,35 @@ uint32_t lex_slash_token(char *string, uint32_t loc, Token *out) {
     }
 }
 uint32_t lex_line_comment(char *string, uint32_t loc, Token *out) {
-    uint32_t count = 2;
-    TokenType type = COMMENT;
-    char *c_ptr = string + 2;
-    char c = *c_ptr;
-
-    while (c != NEWLINE_M) {
-        if (IS_ILLEGAL(c)) {
-            type = INVALID;
-            break;
-        }
-
-        ++count;
-        c = *(++c_ptr);
-    }
+    char *c_ptr = scan_illegal(string + 2, input_end);
+    TokenType type = (c_ptr < input_end && *c_ptr == NEWLINE_M) ? COMMENT : INVALID;
+    uint32_t count = c_ptr - string;
 
     // Dummy token
     *out = create_token(type, loc, count, string);
     return count;
 }
 uint32_t lex_multiline_comment(char *string, uint32_t loc, Token *out) {
-    uint32_t count = 2;
     TokenType type = COMMENT;
     char *c_ptr = string + 2;
-    char c = *c_ptr;
 
     while (1) {
-        if (c != NEWLINE_M && IS_ILLEGAL(c)) {
-            type = ILLEGAL;
+        c_ptr = scan_comment(c_ptr, input_end);
+        if (c_ptr >= input_end) {
+            type = INVALID;
+            break;
         }
-        else if (c == TIMES && *(c_ptr + 1) == SLASH) {
-            count += 2;
-
+        else if (*c_ptr == TIMES && peek_char(c_ptr + 1) == SLASH) {
+            c_ptr += 2;
             break;
         }
+        else if (*c_ptr != TIMES && *c_ptr != NEWLINE_M) {
+            type = ILLEGAL;
+        }
 
-        ++count;
-        c = *(++c_ptr);
+        ++c_ptr;
     }
+    uint32_t count = c_ptr - string;
 
     // Dummy token
     *out = create_token(type, loc, count, string);
@@ -324,7 +565,7 @@ uint32_t lex_string_token(char *string, uint32_t loc, Token *out) {
     uint32_t count = 1;
     TokenType type = STRING;
     char *c_ptr = string + 1;
-    char c = *c_ptr;
+    char c = peek_char(c_ptr);
 
     while (1) {
         if (c == NEWLINE_M || c == '\0') {
@@ -340,7 +581,7 @@ uint32_t lex_string_token(char *string, uint32_t loc, Token *out) {
         }
 
         ++count;
-        c = *(++c_ptr);
+        c = peek_char(++c_ptr);
     }
 
     *out = create_token(type, loc, count, string);
@@ -351,7 +592,7 @@ uint32_t lex_bool_token(char *string, uint32_t loc, Token *out) {
     uint32_t count = 1;
     TokenType type = OP;
     char *c_ptr = string + 1;
-    char c = *c_ptr;
+    char c = peek_char(c_ptr);
 
     switch (*string) {
         case EQUAL_M:
@@ -380,29 +621,59 @@ int is_keyword_match(char *string, uint32_t loc, uint32_t len, Token *out) {
     if (!string || !out) return 0;
     if (len < 2 || len > 6) return 0;
 
-    TokenType *type;
-    if (dict_try_array(keyword_dictionary, string, len, (void**) &type)) {
-        *out = create_token(*type, loc, len, string);
-        return 1;
+    switch (*string) {
+        case 'a':
+            KEYWORD("array", ARRAY)
+            KEYWORD("assert", ASSERT)
+            break;
+        case 'b':
+            KEYWORD("bool", BOOL)
+            break;
+        case 'e':
+            KEYWORD("else", ELSE)
+            break;
+        case 'f':
+            KEYWORD("fn", FN)
+            KEYWORD("false", FALSE)
+            KEYWORD("float", FLOAT)
+            break;
+        case 'i':
+            KEYWORD("if", IF)
+            KEYWORD("int", INT)
+            KEYWORD("image", IMAGE)
+            break;
+        case 'l':
+            KEYWORD("let", LET)
+            break;
+        case 'p':
+            KEYWORD("print", PRINT)
+            break;
+        case 'r':
+            KEYWORD("read", READ)
+            KEYWORD("return", RETURN)
+            break;
+        case 's':
+            KEYWORD("sum", SUM)
+            KEYWORD("show", SHOW)
+            KEYWORD("struct", STRUCT)
+            break;
+        case 't':
+            KEYWORD("to", TO)
+            KEYWORD("then", THEN)
+            KEYWORD("time", TIME)
+            KEYWORD("true", TRUE)
+            break;
+        case 'v':
+            KEYWORD("void", VOID)
+            break;
+        case 'w':
+            KEYWORD("write", WRITE)
+            break;
     }
 
     return 0;
 }
 
-Dict *create_keyword_dictionary() {
-    Dict *dict = dict_create_small();
-    if (!dict) return NULL;
-
-    char *word;
-    size_t len = sizeof(keywords) / sizeof(size_t);
-    for (size_t i = 0; i < len; ++i) {
-        word = keywords[i];
-        dict_add_array(dict, word, strlen(word), (void**) &keyword_types[i]);
-    }
-
-    return dict;
-}
-
 void lex_error(LexErrorType type, Token *token) {
     add_lex_error(type, token);
     lex_fail_status = EXIT_FAILURE;
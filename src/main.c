@@ -2,6 +2,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 #include "main.h"
 #include "lexer.h"
@@ -12,15 +20,30 @@
 #include "error.h"
 #include "parser.h"
 #include "typecheck.h"
+#include "generator.h"
+#include "assembly.h"
+#include "interpreter.h"
+#include "cache.h"
+#include "astfile.h"
 
 static RunMode run_mode = RUN_MODE;
 static PrintMode print_mode = STANDARD_PRINT;
 static char *file_name;
-static char *file_string;
-static size_t file_size;
-static TokenVec *token_vector;
-static NodeVec *node_vector;
-static Vector *cmd_vector;
+static int pipeline = 0;
+static int program_argc;
+static char **program_argv;
+static char *server_path;
+static int jobs = 0;
+static int cache_stats = 0;
+static char *save_ast;
+static int load_ast = 0;
+
+// Batch jobs are claimed in order by whichever worker is free next
+static BatchJob *batch_jobs;
+static size_t batch_count;
+static size_t batch_next;
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t batch_cond = PTHREAD_COND_INITIALIZER;
 
 int main(int argc, char *argv[]) {
     if (parse_input_args(argc, argv) != EXIT_SUCCESS)
@@ -28,24 +51,100 @@ int main(int argc, char *argv[]) {
 
     if (run_mode == HELP_MODE)
         return run_help();
-    
-    if (open_file() == EXIT_FAILURE)
-        return EXIT_FAILURE;
 
-    if (run_compilation() == EXIT_FAILURE) {
-        print_fail();
+    if (server_path)
+        return run_server();
+
+    if (cache_stats && !cache_enabled())
+        cache_setup(CACHE_DIR);
+
+    // A saved program has been checked already, so only the stages after type-checking can start from one
+    if ((load_ast || save_ast) && run_mode < TYPE_MODE) {
+        printf("--load-ast and --save-ast need -t, -c, -s or -r.\n");
+        return EXIT_FAILURE;
+    }
+    if (save_ast && jobs) {
+        printf("--save-ast takes a single file.\n");
         return EXIT_FAILURE;
     }
-    else if (print_mode != NO_PRINT) {
-        print_success();
+
+    int exit_status;
+    if (jobs) {
+        exit_status = run_batch();
     }
-    
-    return EXIT_SUCCESS;
+    else {
+        Compilation unit = { .file_name = file_name, .save_path = save_ast, .load_program = load_ast };
+        if (open_file(&unit) == EXIT_FAILURE)
+            return EXIT_FAILURE;
+
+        exit_status = compile_cached(&unit);
+    }
+
+    if (cache_stats)
+        cache_print_stats();
+    return exit_status;
+}
+
+int compile_and_report(Compilation *unit) {
+    int exit_status = run_compilation(unit);
+    print_errors();
+    if (exit_status == EXIT_FAILURE)
+        print_fail();
+    else if (print_mode != NO_PRINT)
+        print_success(unit);
+
+    release_compilation(unit);
+    return exit_status == EXIT_FAILURE ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Replays the output of an identical earlier compilation when the cache holds one, skipping every stage.
+// The key covers the mode and flags that change the output, including whether the file is read as a saved
+// program, and the file name that diagnostics print. A compilation asked to save its program always runs, since
+// a hit would skip writing the file.
+int compile_cached(Compilation *unit) {
+    if (!cache_enabled() || unit->save_path)
+        return compile_and_report(unit);
+
+    char *saved = unit->save_path ? unit->save_path : "";
+    int context_size = snprintf(NULL, 0, "%d %d %d %zu %d %s %s", run_mode, print_mode, pipeline,
+                                get_max_errors(), unit->load_program, saved, unit->file_name);
+    char context[context_size + 1];
+    snprintf(context, sizeof(context), "%d %d %d %zu %d %s %s", run_mode, print_mode, pipeline, get_max_errors(),
+             unit->load_program, saved, unit->file_name);
+    CacheKey key = cache_key(unit->file_string, unit->file_size, context, context_size);
+    if (run_mode == RUN_MODE)
+        return run_cached(unit, &key);
+
+    char *output;
+    size_t output_size;
+    int exit_status;
+    FILE *destination = get_output();
+    if (cache_load(&key, &output, &output_size, &exit_status)) {
+        fwrite(output, 1, output_size, destination);
+        free(output);
+        return exit_status;
+    }
+
+    FILE *stream = open_memstream(&output, &output_size);
+    if (!stream) return compile_and_report(unit);
+
+    set_output(stream);
+    exit_status = compile_and_report(unit);
+    set_output(destination);
+    fclose(stream);
+
+    fwrite(output, 1, output_size, destination);
+    cache_store(&key, output, output_size, exit_status);
+    free(output);
+    return exit_status;
 }
 
 int parse_input_args(int argc, char *argv[]) {
     int mode_set = 0;
     int file_set = 0;
+
+    // Arguments after the filename are passed to the program in run mode, with the filename as argv[0]
+    program_argv = malloc(sizeof(char*) * argc); if (!program_argv) return EXIT_FAILURE;
     for (int i = 1; i < argc; ++i) {
         char c;
 
@@ -56,10 +155,14 @@ int parse_input_args(int argc, char *argv[]) {
         else if (!file_set) {
             file_name = argv[i];
             file_set = 1;
+            program_argv[program_argc++] = argv[i];
+            continue;
+        }
+        // Program argument
+        else {
+            program_argv[program_argc++] = argv[i];
             continue;
         }
-        // Redundant filename
-        else continue;
 
         switch (c) {
             case 'h':
@@ -89,6 +192,12 @@ int parse_input_args(int argc, char *argv[]) {
                     mode_set = 1;
                 }
                 break;
+            case 's':
+                if (!mode_set) {
+                    run_mode = ASM_MODE;
+                    mode_set = 1;
+                }
+                break;
             case 'r':
                 if (!mode_set) {
                     run_mode = RUN_MODE;
@@ -101,12 +210,49 @@ int parse_input_args(int argc, char *argv[]) {
                     print_mode = NO_PRINT;
                 } else if (!strcmp(argv[i], "standard-print")) {
                     print_mode = STANDARD_PRINT;
+                } else if (!strcmp(argv[i], "pipeline")) {
+                    pipeline = 1;
+                } else if (!strncmp(argv[i], "server", 6) && (argv[i][6] == '\0' || argv[i][6] == '=')) {
+                    server_path = argv[i][6] ? argv[i] + 7 : SERVER_PATH;
+                } else if (!strncmp(argv[i], "cache", 5) && (argv[i][5] == '\0' || argv[i][5] == '=')) {
+                    cache_setup(argv[i][5] ? argv[i] + 6 : CACHE_DIR);
+                } else if (!strncmp(argv[i], "save-ast=", 9)) {
+                    save_ast = argv[i] + 9;
+                } else if (!strcmp(argv[i], "load-ast")) {
+                    load_ast = 1;
+                } else if (!strcmp(argv[i], "cache-stats")) {
+                    cache_stats = 1;
+                } else if (!strncmp(argv[i], "jobs", 4) && (argv[i][4] == '\0' || argv[i][4] == '=')) {
+                    // Accepts both '--jobs N' and '--jobs=N'
+                    char *count = argv[i][4] ? argv[i] + 5 : (i + 1 < argc ? argv[++i] : "");
+                    jobs = atoi(count);
+                    if (jobs < 1) {
+                        invalid_args(count);
+                        return EXIT_FAILURE;
+                    }
+                } else if (!strncmp(argv[i], "max-errors", 10) && (argv[i][10] == '\0' || argv[i][10] == '=')) {
+                    // Accepts both '--max-errors N' and '--max-errors=N'. Zero prints every error.
+                    char *count = argv[i][10] ? argv[i] + 11 : (i + 1 < argc ? argv[++i] : "");
+                    char *end;
+                    long limit = strtol(count, &end, 10);
+                    if (!*count || *end || limit < 0) {
+                        invalid_args(count);
+                        return EXIT_FAILURE;
+                    }
+                    set_max_errors(limit);
+                } else if (!strncmp(argv[i], "lex-threads", 11) && (argv[i][11] == '\0' || argv[i][11] == '=')) {
+                    // Without a count, lex on every online core
+                    lex_set_threads(argv[i][11] ? atoi(argv[i] + 12) : sysconf(_SC_NPROCESSORS_ONLN));
                 } else if (!strcmp(argv[i], "tabbed-print")) {
                     // TODO
                 } else if (!strcmp(argv[i], "pp-print")) {
                     // TODO 
                 } else if (!strcmp(argv[i], "xml-print")) {
                     // TODO
+                } else if (!strcmp(argv[i], "json-print")) {
+                    print_mode = JSON_PRINT;
+                } else if (!strcmp(argv[i], "binary-print")) {
+                    print_mode = BINARY_PRINT;
                 }
                 else {
                     invalid_args(argv[i]);
@@ -119,6 +265,9 @@ int parse_input_args(int argc, char *argv[]) {
         }
     }
 
+    // The server takes the mode and source from each request
+    if (server_path) return EXIT_SUCCESS;
+
     if (!file_set) {
         missing_filename();
         return EXIT_FAILURE;
@@ -148,82 +297,157 @@ void missing_runmode() {
 }
 
 int run_help() {
-    file_name = "HELP.md";
-    FILE *f_ptr = fopen(file_name, "r");
+    FILE *f_ptr = fopen("HELP.md", "r");
     if (!f_ptr) {
         printf("Failed to open file 'HELP.md': %s\n", strerror(errno));
         return EXIT_FAILURE;
     }
 
     if (fseek(f_ptr, 0, SEEK_END) != 0) return EXIT_FAILURE;
-    file_size = ftell(f_ptr);
+    size_t size = ftell(f_ptr);
     if (fseek(f_ptr, 0, SEEK_SET) != 0) return EXIT_FAILURE;
 
-    file_string = malloc(file_size); if (!file_string) return EXIT_FAILURE;
-    if (!(fread(file_string, 1, file_size, f_ptr))) return EXIT_FAILURE;
-    if (fputs(file_string, stdout) == -1) {
+    char *help = malloc(size + 1); if (!help) return EXIT_FAILURE;
+    if (!(fread(help, 1, size, f_ptr))) return EXIT_FAILURE;
+    help[size] = '\0';
+    if (fputs(help, stdout) == -1) {
         printf("Failed to write: %s\n", strerror(errno));
         return EXIT_FAILURE;
     }
 
     fclose(f_ptr);
-    tokenvec_destroy(token_vector);
-    free(node_vector);
+    free(help);
 
     return EXIT_SUCCESS;
 }
 
-int open_file() {
-    if (!file_name) return EXIT_FAILURE;
+// Regular files are mapped read-only and lexed in place. Tokens point straight into the mapped pages, so the
+// source is never copied and needs no trailing '\0'. Pipes and other streams are read into memory instead.
+int open_file(Compilation *unit) {
+    if (!unit->file_name) return EXIT_FAILURE;
 
-    FILE *f_ptr = fopen(file_name, "r");
-    if (!f_ptr) {
-        printf("Failed to open file %s: %s\n", file_name, strerror(errno));
+    int fd = open(unit->file_name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(get_output(), "Failed to open file %s: %s\n", unit->file_name, strerror(errno));
         return EXIT_FAILURE;
     }
 
-    if (fseek(f_ptr, 0, SEEK_END) != 0) return EXIT_FAILURE;
-    file_size = ftell(f_ptr);
-    if (fseek(f_ptr, 0, SEEK_SET) != 0) return EXIT_FAILURE;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return EXIT_FAILURE;
+    }
 
-    file_string = malloc(file_size + 1); if (!file_string) return EXIT_FAILURE;
-    file_string[file_size] = '\0';
+    if (!S_ISREG(info.st_mode)) {
+        int status = read_stream(unit, fd);
+        close(fd);
+        return status;
+    }
 
-    if (fread(file_string, 1, file_size, f_ptr) != file_size)
-        if (ferror(f_ptr)) {
-            printf("Error occurred while reading file %s\n", file_name);
+    if (!unit->load_program && (uint64_t) info.st_size > MAX_SOURCE_SIZE) {
+        close(fd);
+        print_too_large(unit);
+        return EXIT_FAILURE;
+    }
+
+    unit->file_size = info.st_size;
+    if (!unit->file_size) {
+        close(fd);
+        unit->file_string = "";
+        return EXIT_SUCCESS;
+    }
+
+    unit->file_string = mmap(NULL, unit->file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (unit->file_string == MAP_FAILED) {
+        unit->file_string = NULL;
+        fprintf(get_output(), "Error occurred while reading file %s\n", unit->file_name);
+        return EXIT_FAILURE;
+    }
+    unit->mapped = 1;
+    madvise(unit->file_string, unit->file_size, MADV_SEQUENTIAL);
+
+    return EXIT_SUCCESS;
+}
+
+int read_stream(Compilation *unit, int fd) {
+    size_t capacity = BUFSIZ;
+    unit->buffer = malloc(capacity); if (!unit->buffer) return EXIT_FAILURE;
+    unit->file_size = 0;
+
+    ssize_t count;
+    while ((count = read(fd, unit->buffer + unit->file_size, capacity - unit->file_size)) != 0) {
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            fprintf(get_output(), "Error occurred while reading file %s\n", unit->file_name);
             return EXIT_FAILURE;
         }
+        unit->file_size += count;
+        if (!unit->load_program && unit->file_size > MAX_SOURCE_SIZE) {
+            print_too_large(unit);
+            return EXIT_FAILURE;
+        }
+        if (unit->file_size == capacity) {
+            capacity *= 2;
+            char *temp = realloc(unit->buffer, capacity); if (!temp) return EXIT_FAILURE;
+            unit->buffer = temp;
+        }
+    }
 
+    unit->file_string = unit->buffer;
     return EXIT_SUCCESS;
 }
 
-int run_compilation() {
+// Token offsets are 32 bits, which bounds the sources jplc can compile
+void print_too_large(Compilation *unit) {
+    fprintf(get_output(), "File %s is too large: jplc compiles sources of up to %u bytes\n", unit->file_name,
+            MAX_SOURCE_SIZE);
+}
+
+// Unmaps or frees the source once nothing points into it
+void close_file(Compilation *unit) {
+    if (unit->mapped)
+        munmap(unit->file_string, unit->file_size);
+    free(unit->buffer);
+
+    unit->file_string = NULL;
+    unit->buffer = NULL;
+    unit->mapped = 0;
+}
+
+int run_compilation(Compilation *unit) {
     int exit_status = EXIT_SUCCESS;
-    error_setup(file_name, file_string);
+    error_setup(unit->file_name, unit->file_string, unit->file_size);
 
     switch (run_mode) {
         case LEX_MODE:
-            exit_status = lex_string(file_string, file_size, &token_vector);
+            exit_status = lex_string(unit->file_string, unit->file_size, &unit->token_vector);
             break;
         case PARSE_MODE:
-            lex_string(file_string, file_size, &token_vector);
-            exit_status = parse_tokens(token_vector, &node_vector, &cmd_vector);
+            exit_status = lex_and_parse(unit);
             break;
         case TYPE_MODE:
-            lex_string(file_string, file_size, &token_vector);
-            if (parse_tokens(token_vector, &node_vector, &cmd_vector) == EXIT_FAILURE)
-                exit_status = EXIT_FAILURE;
-                
-            token_list_setup(token_vector);
-            if (type_check(token_vector, node_vector, cmd_vector) == EXIT_FAILURE)
-                exit_status = EXIT_FAILURE;
+            exit_status = check_program(unit, 1);
             break;
         case C_MODE:
-            // Fall
+            if (check_program(unit, 0) == EXIT_FAILURE)
+                return EXIT_FAILURE;
+
+            exit_status = generate_c(unit->token_vector, unit->node_vector, unit->cmd_vector, &unit->c_code);
+            break;
+        case ASM_MODE:
+            if (check_program(unit, 0) == EXIT_FAILURE)
+                return EXIT_FAILURE;
+
+            exit_status = generate_asm(unit->token_vector, unit->node_vector, unit->cmd_vector, &unit->asm_code);
+            break;
         case RUN_MODE:
-            printf("Not implemented.\n");
-            return EXIT_FAILURE;
+            if (check_program(unit, 0) == EXIT_FAILURE)
+                return EXIT_FAILURE;
+
+            exit_status = run_program(unit->token_vector, unit->node_vector, unit->cmd_vector, program_argc,
+                                      program_argv);
+            break;
         default:
             return EXIT_FAILURE;
     }
@@ -231,29 +455,338 @@ int run_compilation() {
     return exit_status;
 }
 
+// Run mode caches the checked program rather than its output, since what the program does depends on more than
+// its source. A hit runs the saved program without lexing, parsing or type-checking it.
+int run_cached(Compilation *unit, CacheKey *key) {
+    char path[CACHE_PATH];
+    if (unit->load_program || !cache_path(key, ".ast", path))
+        return compile_and_report(unit);
+
+    Compilation saved = { .file_name = path, .load_program = 1 };
+    if (!access(path, R_OK) && open_file(&saved) == EXIT_SUCCESS && ast_valid(saved.file_string, saved.file_size)) {
+        cache_count(1);
+        saved.file_name = unit->file_name;
+        int exit_status = compile_and_report(&saved);
+        close_file(&saved);
+        return exit_status;
+    }
+    close_file(&saved);
+
+    cache_count(0);
+    unit->save_path = path;
+    int exit_status = compile_and_report(unit);
+    unit->save_path = NULL;
+    return exit_status;
+}
+
+// Lexes, parses and type-checks the source, or loads a program saved by an earlier compilation in its place.
+// Type mode checks even a program that failed to parse, to report as many errors as it can.
+int check_program(Compilation *unit, int always_check) {
+    if (unit->load_program) {
+        Dict *declarations = NULL;
+        int exit_status = ast_load(unit->file_string, unit->file_size, &unit->token_vector, &unit->node_vector,
+                                   &unit->cmd_vector, &declarations);
+        set_declarations(declarations);
+        if (exit_status == EXIT_FAILURE) {
+            if (ast_source_size(unit->file_string, unit->file_size) > MAX_SOURCE_SIZE)
+                print_too_large(unit);
+            else
+                fprintf(get_output(), "%s is not a program saved by this version of jplc\n", unit->file_name);
+            return EXIT_FAILURE;
+        }
+
+        size_t source_size;
+        char *source = ast_source(unit->file_string, &source_size);
+        error_setup(unit->file_name, source, source_size);
+        token_list_setup(unit->token_vector);
+        return EXIT_SUCCESS;
+    }
+
+    int exit_status = lex_and_parse(unit);
+    if (exit_status == EXIT_FAILURE && !always_check)
+        return EXIT_FAILURE;
+
+    token_list_setup(unit->token_vector);
+    if (type_check(unit->token_vector, unit->node_vector, unit->cmd_vector) == EXIT_FAILURE)
+        return EXIT_FAILURE;
+
+    if (exit_status == EXIT_SUCCESS && unit->save_path)
+        ast_save(unit->save_path, unit->file_size, unit->token_vector, unit->node_vector, unit->cmd_vector,
+                 get_declarations());
+    return exit_status;
+}
+
+// Parses while lexing in pipeline mode, otherwise lexes the whole file first
+int lex_and_parse(Compilation *unit) {
+    if (pipeline && lex_stream_start(unit->file_string, unit->file_size) == EXIT_SUCCESS) {
+        unit->token_vector = tokenvec_create(unit->file_string); if (!unit->token_vector) return EXIT_FAILURE;
+        return parse_stream(unit->token_vector, &unit->node_vector, &unit->cmd_vector);
+    }
+
+    lex_string(unit->file_string, unit->file_size, &unit->token_vector);
+    return parse_tokens(unit->token_vector, &unit->node_vector, &unit->cmd_vector);
+}
+
+// Everything the compilation allocated from the arena or the child pool goes at once
+void release_compilation(Compilation *unit) {
+    arena_reset(compile_arena());
+    intern_reset();
+    childlist_reset();
+    parse_cleanup();
+    clear_errors();
+    type_check_cleanup();
+    tokenvec_destroy(unit->token_vector);
+    nodevec_destroy(unit->node_vector);
+    unit->token_vector = NULL;
+    unit->node_vector = NULL;
+    unit->cmd_vector = NULL;
+    set_type_check(0);
+}
+
+// Compiles every file named on the command line on 'jobs' threads. Each file's output is buffered and printed
+// in command line order once every file before it is done, so the result matches compiling them one by one.
+int run_batch() {
+    if (run_mode != LEX_MODE && run_mode != PARSE_MODE && run_mode != TYPE_MODE) {
+        printf("--jobs supports -l, -p and -t only.\n");
+        return EXIT_FAILURE;
+    }
+
+    // The pipelined lexer hands tokens over through a single process-wide ring
+    pipeline = 0;
+    init_predefs();
+
+    batch_count = program_argc;
+    batch_jobs = calloc(batch_count, sizeof(BatchJob)); if (!batch_jobs) return EXIT_FAILURE;
+    for (size_t i = 0; i < batch_count; ++i) {
+        batch_jobs[i].unit.file_name = program_argv[i];
+        batch_jobs[i].unit.load_program = load_ast;
+    }
+
+    size_t count = (size_t) jobs < batch_count ? (size_t) jobs : batch_count;
+    pthread_t threads[count];
+    int started[count];
+    size_t running = 0;
+    for (size_t i = 0; i < count; ++i) {
+        started[i] = !pthread_create(&threads[i], NULL, batch_worker, NULL);
+        running += started[i];
+    }
+    if (!running) batch_worker(NULL);
+
+    int exit_status = EXIT_SUCCESS;
+    for (size_t i = 0; i < batch_count; ++i) {
+        BatchJob *job = &batch_jobs[i];
+
+        pthread_mutex_lock(&batch_lock);
+        while (!job->done)
+            pthread_cond_wait(&batch_cond, &batch_lock);
+        pthread_mutex_unlock(&batch_lock);
+
+        fwrite(job->output, 1, job->output_size, stdout);
+        free(job->output);
+        if (job->status == EXIT_FAILURE)
+            exit_status = EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+        if (started[i]) pthread_join(threads[i], NULL);
+    free(batch_jobs);
+
+    return exit_status;
+}
+
+// Claims files until none are left. A worker busy with a large file never holds up the others.
+void *batch_worker(void *arg) {
+    (void) arg;
+
+    size_t i;
+    while ((i = __atomic_fetch_add(&batch_next, 1, __ATOMIC_RELAXED)) < batch_count) {
+        BatchJob *job = &batch_jobs[i];
+
+        FILE *stream = open_memstream(&job->output, &job->output_size);
+        if (!stream) exit(EXIT_FAILURE);
+        set_output(stream);
+
+        job->status = open_file(&job->unit) == EXIT_FAILURE ? EXIT_FAILURE : compile_cached(&job->unit);
+        close_file(&job->unit);
+
+        set_output(NULL);
+        fclose(stream);
+
+        pthread_mutex_lock(&batch_lock);
+        job->done = 1;
+        pthread_cond_broadcast(&batch_cond);
+        pthread_mutex_unlock(&batch_lock);
+    }
+
+    compile_arena_cleanup();
+    return NULL;
+}
+
+// Compiles one source per connection until killed. The predefined environment is built before the first request.
+int run_server() {
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (strlen(server_path) >= sizeof(address.sun_path)) {
+        printf("Socket path is too long: %s\n", server_path);
+        return EXIT_FAILURE;
+    }
+    strcpy(address.sun_path, server_path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        printf("Failed to create socket: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    unlink(server_path);
+    if (bind(listener, (struct sockaddr *) &address, sizeof(address)) < 0 || listen(listener, SERVER_BACKLOG) < 0) {
+        printf("Failed to listen on %s: %s\n", server_path, strerror(errno));
+        close(listener);
+        return EXIT_FAILURE;
+    }
+
+    // A client that hangs up early must not take the server down with it
+    signal(SIGPIPE, SIG_IGN);
+    init_predefs();
+    printf("Listening on %s\n", server_path);
+    fflush(stdout);
+
+    while (1) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        serve_request(client);
+        close(client);
+    }
+
+    close(listener);
+    unlink(server_path);
+    return EXIT_FAILURE;
+}
+
+// A request is a header line holding a mode flag (-l, -p or -t) and an optional file name for diagnostics,
+// followed by the source until the client shuts down its end. The reply is what jplc would have printed.
+// Editors keep one document open instead: -o NAME opens the source that follows as a document, and
+// -e OFFSET REMOVED replaces REMOVED bytes at OFFSET of it with the text that follows. Their replies hold the
+// errors found and whether the document compiles. Any other request closes the document.
+int serve_request(int fd) {
+    static Document document;
+    Compilation unit = {0};
+    if (read_stream(&unit, fd) == EXIT_FAILURE) {
+        free(unit.buffer);
+        return EXIT_FAILURE;
+    }
+    char *request = unit.buffer;
+    size_t request_size = unit.file_size;
+
+    char *header_end = memchr(request, '\n', request_size);
+    int status = EXIT_FAILURE;
+    if (header_end && header_end - request >= 2 && request[0] == '-') {
+        *header_end = '\0';
+        unit.file_name = request[2] == ' ' ? request + 3 : "<request>";
+        unit.file_string = header_end + 1;
+        unit.file_size = request_size - (unit.file_string - request);
+
+        switch (request[1]) {
+            case 'l': run_mode = LEX_MODE; break;
+            case 'p': run_mode = PARSE_MODE; break;
+            case 't': run_mode = TYPE_MODE; break;
+            case 'o': case 'e': run_mode = TYPE_MODE; break;
+            default: run_mode = HELP_MODE; break;
+        }
+        if (request[1] != 'e' && document.source)
+            document_close(&document);
+
+        fflush(stdout);
+        int saved = dup(STDOUT_FILENO);
+        dup2(fd, STDOUT_FILENO);
+        if (run_mode == HELP_MODE)
+            printf("Unsupported request mode '%c'. Use -l, -p, -t, -o or -e.\n", request[1]);
+        else if (request[1] == 'o' || request[1] == 'e')
+            status = serve_document(&document, request, &unit);
+        else
+            status = compile_and_report(&unit);
+        fflush(stdout);
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+
+    close_file(&unit);
+    return status;
+}
+
+// Opens or edits the server's document as the request header asks
+int serve_document(Document *document, char *header, Compilation *unit) {
+    int status;
+    size_t offset, removed;
+    if (header[1] == 'o') {
+        status = document_open(document, unit->file_name, unit->file_string, unit->file_size);
+    }
+    else if (!document->source) {
+        printf("No document is open\n");
+        return EXIT_FAILURE;
+    }
+    else if (sscanf(header + 2, "%zu %zu", &offset, &removed) != 2) {
+        printf("An edit needs an offset and a byte count\n");
+        return EXIT_FAILURE;
+    }
+    else if (offset > document->size || removed > document->size - offset) {
+        printf("The edit is outside the document\n");
+        return EXIT_FAILURE;
+    }
+    else if (document->size - removed + unit->file_size > MAX_SOURCE_SIZE) {
+        print_too_large(unit);
+        return EXIT_FAILURE;
+    }
+    else {
+        status = document_edit(document, offset, removed, unit->file_string, unit->file_size);
+    }
+
+    if (status == EXIT_SUCCESS) printf("Compilation succeeded\n");
+    else print_fail();
+    return status;
+}
+
 void print_fail() {
-    printf("Compilation failed\n");
+    fprintf(get_output(), "Compilation failed\n");
 }
 
-void print_success() {
+void print_success(Compilation *unit) {
+    // Dumps for tools hold nothing but the dump
+    if ((print_mode == JSON_PRINT || print_mode == BINARY_PRINT) && run_mode <= TYPE_MODE) {
+        set_type_check(run_mode == TYPE_MODE);
+        Vector *commands = run_mode == LEX_MODE ? NULL : unit->cmd_vector;
+        if (print_mode == JSON_PRINT) print_json(unit->token_vector, unit->node_vector, commands);
+        else print_binary(unit->token_vector, unit->node_vector, commands);
+        return;
+    }
+
     switch (run_mode) {
         case LEX_MODE:
-            print_tokens(token_vector);
+            print_tokens(unit->token_vector);
             break;
         case PARSE_MODE:
-            print_nodes(node_vector, cmd_vector, token_vector);
+            print_nodes(unit->node_vector, unit->cmd_vector, unit->token_vector);
             break;
         case TYPE_MODE:
             set_type_check(1);
-            print_nodes(node_vector, cmd_vector, token_vector);
+            print_nodes(unit->node_vector, unit->cmd_vector, unit->token_vector);
             break;
         case C_MODE:
+            cvec_write(unit->c_code, get_output());
+            return;
+        case ASM_MODE:
+            cvec_write(unit->asm_code, get_output());
+            return;
         case RUN_MODE:
         default:
             return;
     }
 
-    printf("Compilation succeeded\n");
+    fprintf(get_output(), "Compilation succeeded\n");
 }
 
 void gen_defines();
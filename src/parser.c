@@ -6,87 +6,175 @@
 #include "parser.h"
 #include "stringops.h"
 #include "typecheck.h"
+#include "lexer.h"
 
 #define NO_PRECEDENCE -1
 #define MIN_PRECEDENCE 0
 
 #define CHECK(type, index, output) (if (!expect_token(type, index, output)) return EXIT_FAILURE)
 
-static int parse_exit_status = EXIT_SUCCESS;
-static TokenVec *token_vector;
-static NodeVec *node_vector;
-static Vector *cmd_list;
+static _Thread_local int parse_exit_status = EXIT_SUCCESS;
+static _Thread_local int streaming = 0;
+static _Thread_local TokenVec *token_vector;
+static _Thread_local NodeVec *node_vector;
+static _Thread_local Vector *cmd_list;
+
+// Children are gathered on a stack and copied into the child pool once their list is complete.
+// A nested list is always sealed before its parent's next child is pushed.
+static _Thread_local U32Vec child_stack;
+static _Thread_local U32Vec loop_var_stack;
 
 extern char *token_names[];
 
+// Tokens point into the source, which need not be NUL-terminated, so numbers are converted from a copy.
+static char *number_string(StringRef ref, char *buffer) {
+    if (ref.length >= MAXIMUM_BUFFER) return array_from_ref_arena(compile_arena(), ref);
+    memcpy(buffer, ref.string, ref.length);
+    buffer[ref.length] = '\0';
+    return buffer;
+}
+
+// Moves everything pushed since 'base' into the child pool
+static ChildList list_seal(U32Vec *stack, size_t base) {
+    ChildList list = childlist_create(stack->array + base, stack->size - base);
+    stack->size = base;
+    return list;
+}
+
+// Frees the list stacks, which otherwise keep their memory between compilations
+void parse_cleanup() {
+    u32vec_release(&child_stack);
+    u32vec_release(&loop_var_stack);
+}
+
+// Parses tokens while the lexer is still producing them, pulling one command's tokens at a time
+int parse_stream(TokenVec *tokens, NodeVec **output_nodes, Vector **output_cmds) {
+    streaming = 1;
+    int status = parse_tokens(tokens, output_nodes, output_cmds);
+    while (lex_stream_pull(tokens));
+    tokenvec_shrink(tokens);
+    streaming = 0;
+
+    return status;
+}
+
 int parse_tokens(TokenVec *tokens, NodeVec **output_nodes, Vector **output_cmds) {
     if (!tokens || !output_cmds || !output_nodes) return EXIT_FAILURE;
 
-    token_vector = tokens;
-    node_vector = nodevec_create_cap(token_vector->size << 1);
-    cmd_list = vector_create_cap(token_vector->size >> 1);
+    // Parsing makes about one node per token and one command per ten. Streamed input has no count to go by yet.
+    parse_setup(tokens, streaming ? nodevec_create() : nodevec_create_cap(tokens->size + 16));
+    cmd_list = vector_create_arena(compile_arena(), streaming ? 16 : (token_vector->size >> 3) + 1);
     if (!node_vector || !cmd_list) return EXIT_FAILURE;
 
     uint32_t index = 0;
-    uint64_t cmd_index = 0;
+    uint32_t cmd_index = 0;
     if (peek_token_type(index) == NEWLINE) ++index;
 
     while (peek_token_type(index) != END_OF_FILE) {
-        if (parse_command(&index, &cmd_index)) {
-            vector_append(cmd_list, (void*) cmd_index);
-            expect_token(NEWLINE, index++, NULL);
-        }
-        else {
-            TokenType type;
-            while (1) {
-                type = peek_token_type(index);
-                if (type == NEWLINE) {
-                    ++index;
-                    break;
-                } 
-                else if (type == END_OF_FILE) break;
-                else if (index >= token_vector->size) break;
-                ++index;
-            }
-        }
+        if (parse_next(&index, &cmd_index))
+            vector_append(cmd_list, (void*) (uint64_t) cmd_index);
 
-        if (index >= token_vector->size) break;
+        if (!has_token(index)) break;
     }
 
+    nodevec_shrink(node_vector);
     *output_nodes = node_vector;
     *output_cmds = cmd_list;
     return parse_exit_status;
 }
 
+// Parses from 'tokens' into 'nodes', with a clean status
+void parse_setup(TokenVec *tokens, NodeVec *nodes) {
+    token_vector = tokens;
+    node_vector = nodes;
+    parse_exit_status = EXIT_SUCCESS;
+}
+
+// Parses the command at 'p_index' and the NEWLINE after it, or skips to the next NEWLINE when there is no
+// command to keep. Returns 1 with the command in 'output_index' when there is one.
+int parse_next(uint32_t *p_index, uint32_t *output_index) {
+    uint32_t index = *p_index;
+    if (parse_command(&index, output_index)) {
+        expect_token(NEWLINE, index++, NULL);
+        *p_index = index;
+        return 1;
+    }
+
+    TokenType type;
+    while (1) {
+        type = peek_token_type(index);
+        if (type == NEWLINE) {
+            ++index;
+            break;
+        }
+        else if (type == END_OF_FILE) break;
+        else if (!has_token(index)) break;
+        ++index;
+    }
+
+    *p_index = index;
+    return 0;
+}
+
+// The status of everything parsed since parse_setup
+int parse_status() {
+    return parse_exit_status;
+}
+
 int expect_token(TokenType expected_type, uint32_t index, StringRef *output) {
     if (peek_token_type(index) != expected_type) {
-        Token *expected = malloc(sizeof(Token)); if (!expected) exit(EXIT_FAILURE);
-        *expected = (Token) {expected_type, 0, {strlen(token_names[expected_type]), token_names[expected_type]}};
+        Token expected = (Token) {expected_type, 0, {strlen(token_names[expected_type]), token_names[expected_type]}};
 
-        add_parse_error(UNEXPECTED_TOKEN, tokenvec_get(token_vector, index), expected);
-        free(expected);
+        Token found;
+        add_parse_error(UNEXPECTED_TOKEN, tokenvec_get(token_vector, index, &found), &expected);
         parse_exit_status = EXIT_FAILURE;
         return 0;
     }
 
     if (output != NULL) {
-        *output = ((Token *) tokenvec_get(token_vector, index))->strref;
+        *output = tokenvec_string(token_vector, index);
     }
     return 1;
 }
 
+// Expects a token of the given type, giving the node its text as a symbol
+static int expect_text(TokenType expected_type, uint32_t index, AstNode *node) {
+    StringRef text;
+    if (!expect_token(expected_type, index, &text)) return 0;
+    node->symbol = intern_ref(text);
+    return 1;
+}
+
+// Expects an identifier, giving the node its text and symbol
+static int expect_name(uint32_t index, AstNode *node) {
+    return expect_text(VARIABLE, index, node);
+}
+
 TokenType peek_token_type(uint32_t index) {
-    Token *token = tokenvec_get(token_vector, index);
-    if (!token) return INVALID;
-    return token->type;
+    if (!has_token(index)) return INVALID;
+    return token_vector->kinds[index];
+}
+
+// Pulls streamed tokens until 'index' is available. Returns 0 if the input has no such token.
+int has_token(uint32_t index) {
+    while (index >= token_vector->size)
+        if (!streaming || !lex_stream_pull(token_vector)) return 0;
+    return 1;
 }
 
 void parse_error(ParseErrorType type, uint32_t first_index) {
+    Token first;
     if (first_index < token_vector->size)
-        add_parse_error(type, tokenvec_get(token_vector, first_index), NULL);
+        add_parse_error(type, tokenvec_get(token_vector, first_index, &first), NULL);
     parse_exit_status = EXIT_FAILURE;   
 }
 
+void paren_error(uint32_t last_index, uint32_t paren_index) {
+    Token last, paren;
+    add_parse_error(UNCLOSED_PAREN, tokenvec_get(token_vector, last_index, &last),
+                        tokenvec_get(token_vector, paren_index, &paren));
+}
+
 int try_find_next(uint32_t *p_index, TokenType intermediate_token, TokenType end_token) {
     uint32_t index = *p_index;
     TokenType type;
@@ -99,7 +187,7 @@ int try_find_next(uint32_t *p_index, TokenType intermediate_token, TokenType end
             *p_index = index;
             return 0;
         }
-        else if (index > token_vector->size)
+        else if (!has_token(index))
             return 0;
         else
             ++index;
@@ -109,18 +197,19 @@ int try_find_next(uint32_t *p_index, TokenType intermediate_token, TokenType end
     return 1;
 }
 
-int parse_command(uint32_t *p_index, uint64_t *output_index) {
+int parse_command(uint32_t *p_index, uint32_t *output_index) {
     uint32_t index = *p_index;
-    uint64_t output = 0;
+    uint32_t output = 0;
     AstNode cmd = get_empty_node();
 
     uint32_t paren_index;
+    size_t list_base;
     switch (peek_token_type(index)) {
         case READ:
             cmd.type.cmd = READ_CMD;
             expect_token(READ, index++, NULL);
             expect_token(IMAGE, index++, NULL);
-            expect_token(STRING, index++, &cmd.string);
+            expect_text(STRING, index++, &cmd);
             expect_token(TO, index++, NULL);
             parse_lvalue(&index, &cmd.field1.node);
             break;
@@ -130,7 +219,7 @@ int parse_command(uint32_t *p_index, uint64_t *output_index) {
             expect_token(IMAGE, index++, NULL);
             parse_expression(&index, &cmd.field1.node, MIN_PRECEDENCE);
             expect_token(TO, index++, NULL);
-            expect_token(STRING, index++, &cmd.string);
+            expect_text(STRING, index++, &cmd);
             break;
         case LET:
             cmd.type.cmd = LET_CMD;
@@ -144,12 +233,12 @@ int parse_command(uint32_t *p_index, uint64_t *output_index) {
             expect_token(ASSERT, index++, NULL);
             parse_expression(&index, &cmd.field1.node, MIN_PRECEDENCE);
             expect_token(COMMA, index++, NULL);
-            expect_token(STRING, index++, &cmd.string);
+            expect_text(STRING, index++, &cmd);
             break;
         case PRINT:
             cmd.type.cmd = PRINT_CMD;
             expect_token(PRINT, index++, NULL);
-            expect_token(STRING, index++, &cmd.string);
+            expect_text(STRING, index++, &cmd);
             break;
         case SHOW:
             cmd.type.cmd = SHOW_CMD;
@@ -164,24 +253,25 @@ int parse_command(uint32_t *p_index, uint64_t *output_index) {
         case FN:
             cmd.type.cmd = FN_CMD;
             expect_token(FN, index++, NULL);
-            expect_token(VARIABLE, index++, &cmd.string);
+            expect_name(index++, &cmd);
             expect_token(LPAREN, index++, NULL);
             paren_index = index-1;
 
-            cmd.field1.list = vector_create(); if (!cmd.field1.list) return 0;
+            list_base = child_stack.size;
 
             while(1) {
                 if (peek_token_type(index) == RPAREN) break;
                 if (parse_binding(&index, &output))
-                    vector_append(cmd.field1.list, (void*) output);
+                    u32vec_append(&child_stack, output);
                 else if (!try_find_next(&index, COMMA, RPAREN))
                     break;
                 if (peek_token_type(index) == RPAREN) break;
                 else if (!expect_token(COMMA, index++, NULL)) break;
             }
 
+            cmd.field1.list = list_seal(&child_stack, list_base);
             if (!expect_token(RPAREN, index++, NULL))
-                add_parse_error(UNCLOSED_PAREN, tokenvec_get(token_vector, index-1), tokenvec_get(token_vector, paren_index));
+                paren_error(index - 1, paren_index);
 
             expect_token(COLON, index++, NULL);
             parse_type(&index, &cmd.field2.node);
@@ -192,54 +282,56 @@ int parse_command(uint32_t *p_index, uint64_t *output_index) {
             if (peek_token_type(index) == RCURLY) break;
             expect_token(NEWLINE, index++, NULL);
 
-            cmd.field3.list = vector_create(); if (!cmd.field3.list) return 0;
+            list_base = child_stack.size;
             while (1) {
                 if (peek_token_type(index) == RCURLY)
                     break;
                 
                 if (parse_statement(&index, &output))
-                    vector_append(cmd.field3.list, (void*) output);
+                    u32vec_append(&child_stack, output);
                 else if (!try_find_next(&index, NEWLINE, RCURLY))
                     break;
 
                 if (!expect_token(NEWLINE, index++, NULL))
                     break;
             }
+            cmd.field3.list = list_seal(&child_stack, list_base);
             if (!expect_token(RCURLY, index++, NULL))
-                add_parse_error(UNCLOSED_PAREN, tokenvec_get(token_vector, index-1), tokenvec_get(token_vector, paren_index));
+                paren_error(index - 1, paren_index);
 
             break;
         case STRUCT:
             cmd.type.cmd = STRUCT_CMD;
             expect_token(STRUCT, index++, NULL);
-            expect_token(VARIABLE, index++, &cmd.string);
+            expect_name(index++, &cmd);
             expect_token(LCURLY, index++, NULL);
             paren_index = index-1;
 
             if (peek_token_type(index) == RCURLY) break;
             expect_token(NEWLINE, index++, NULL);
 
-            cmd.field1.list = vector_create(); if (!cmd.field1.list) return 0;
+            list_base = child_stack.size;
             AstNode member;
             while (1) {
                 if (peek_token_type(index) == RCURLY) break;
                 member = get_empty_node();
                 member.token_index = index;
 
-                expect_token(VARIABLE, index++, &member.string);
+                expect_name(index++, &member);
                 expect_token(COLON, index++, NULL);
                 if (!parse_type(&index, &member.field2.node))
                     try_find_next(&index, NEWLINE, RCURLY);
 
-                vector_append(cmd.field1.list, (void*) nodevec_append(node_vector, member));
+                u32vec_append(&child_stack, nodevec_append(node_vector, member));
                 
                 if (!expect_token(NEWLINE, index++, NULL))
                     break;
             }
+            cmd.field1.list = list_seal(&child_stack, list_base);
             if (!expect_token(RCURLY, index++, NULL))
-                add_parse_error(UNCLOSED_PAREN, tokenvec_get(token_vector, index-1), tokenvec_get(token_vector, paren_index));
+                paren_error(index - 1, paren_index);
             
-            cmd.field2.node = nodevec_append(node_vector, (AstNode) {*p_index+1, {.type=STRUCT_TYPE}, {0}, {0}, {0}, {0}, cmd.string});
+            cmd.field2.node = nodevec_append(node_vector, (AstNode) {*p_index+1, {.type=STRUCT_TYPE}, {0}, {0}, {0}, {0}, cmd.symbol});
             break;
         default:
             parse_error(BAD_CMD, index);
@@ -252,27 +344,27 @@ int parse_command(uint32_t *p_index, uint64_t *output_index) {
     return 1;
 }
 
-int parse_lvalue(uint32_t *p_index, uint64_t *output_index) {
+int parse_lvalue(uint32_t *p_index, uint32_t *output_index) {
     uint32_t index = *p_index;
     AstNode lvalue = get_empty_node();
 
     switch (peek_token_type(index)) {
         case VARIABLE:
             lvalue.type.lvalue = VAR_LVALUE;
-            expect_token(VARIABLE, index++, &lvalue.string);
+            expect_name(index++, &lvalue);
 
             if (peek_token_type(index) == LSQUARE) {
                 lvalue.type.lvalue = ARRAY_LVALUE;
-                lvalue.field1.list = vector_create(); if (!lvalue.field1.list) return 0;
+                size_t list_base = child_stack.size;
                 expect_token(LSQUARE, index++, NULL);
                 uint32_t paren_index = index-1;
 
-                AstNode inner_value = (AstNode) {0, {.type=INT_TYPE}, {0}, {0}, {0}, {0}, {0, NULL}};
+                AstNode inner_value = (AstNode) {0, {.type=INT_TYPE}, {0}, {0}, {0}, {0}, 0};
                 while(1) {
                     if (peek_token_type(index) == RSQUARE) break;
-                    if (expect_token(VARIABLE, index, &inner_value.string)) {
+                    if (expect_name(index, &inner_value)) {
                         inner_value.token_index = index;
-                        vector_append(lvalue.field1.list, (void*) nodevec_append(node_vector, inner_value));
+                        u32vec_append(&child_stack, nodevec_append(node_vector, inner_value));
                     }
                     else if (!try_find_next(&index, COMMA, RSQUARE))
                         break;
@@ -283,8 +375,9 @@ int parse_lvalue(uint32_t *p_index, uint64_t *output_index) {
                     else if (!expect_token(COMMA, index++, NULL)) break;
                 }
 
+                lvalue.field1.list = list_seal(&child_stack, list_base);
                 if (!expect_token(RSQUARE, index++, NULL))
-                    add_parse_error(UNCLOSED_PAREN, tokenvec_get(token_vector, index-1), tokenvec_get(token_vector, paren_index));
+                    paren_error(index - 1, paren_index);
             }
             break;
         default:
@@ -298,9 +391,9 @@ int parse_lvalue(uint32_t *p_index, uint64_t *output_index) {
     return 1;
 }
 
-int parse_expression(uint32_t *p_index, uint64_t *output_index, int min_precedence) {
+int parse_expression(uint32_t *p_index, uint32_t *output_index, int min_precedence) {
     uint32_t index = *p_index;
-    uint64_t expr_index;
+    uint32_t expr_index = UINT32_MAX;
     int precedence = NO_PRECEDENCE;
 
     parse_expression_literal(&index, &expr_index);
@@ -309,7 +402,7 @@ int parse_expression(uint32_t *p_index, uint64_t *output_index, int min_preceden
         if (!is_binary_operator(index))
             parse_error(BAD_BINARY, index);
         
-        precedence = get_operator_precedence(tokenvec_get(token_vector, index)->strref);
+        precedence = get_operator_precedence(tokenvec_string(token_vector, index));
     }
 
     while (precedence >= min_precedence) {
@@ -317,13 +410,13 @@ int parse_expression(uint32_t *p_index, uint64_t *output_index, int min_preceden
         expr.type.expr = BINOP_EXPR;
         // LHS
         expr.field1.node = expr_index;
-        expect_token(OP, index++, &expr.string);
+        expect_text(OP, index++, &expr);
         expr.token_index = index-1;
         // RHS
         parse_expression(&index, &expr.field2.node, precedence + 1);
 
         if (peek_token_type(index) == OP && is_binary_operator(index))
-            precedence = get_operator_precedence(tokenvec_get(token_vector, index)->strref);
+            precedence = get_operator_precedence(tokenvec_string(token_vector, index));
         else
             precedence = NO_PRECEDENCE;
 
@@ -337,25 +430,34 @@ int parse_expression(uint32_t *p_index, uint64_t *output_index, int min_preceden
     return 1;
 }
 
-int parse_expression_literal(uint32_t *p_index, uint64_t *output_index) {
+int parse_expression_literal(uint32_t *p_index, uint32_t *output_index) {
     uint32_t index = *p_index;
     AstNode expr = get_empty_node();
 
-    uint64_t output;
-    StringRef var;
+    uint32_t output;
+    AstNode var = (AstNode) {0, {.type=INT_TYPE}, {0}, {0}, {0}, {0}, 0};
     uint32_t paren_index = 0;
+    size_t list_base, var_base;
+    char buffer[MAXIMUM_BUFFER];
+    char *number;
+    StringRef text;
     switch(peek_token_type(index)) {
         case OP:
             expr.type.expr = UNOP_EXPR;
-            expect_token(OP, index++, &expr.string);
-            if (expr.string.length != 1 || (*expr.string.string != '-' && *expr.string.string != '!'))
+            expect_text(OP, index++, &expr);
+            text = symbol_name(expr.symbol);
+            if (text.length != 1 || (*text.string != '-' && *text.string != '!'))
                 parse_error(BAD_UNARY, index);
             parse_expression_literal(&index, &expr.field1.node);
             break;
         case INTVAL:
             expr.type.expr = INT_EXPR;
-            expect_token(INTVAL, index, &expr.string);
-            uint64_t val = strtol(expr.string.string, NULL, 10);
+            expect_token(INTVAL, index, NULL);
+            expr.symbol = NUMBER_SYMBOL;
+            expr.field2.node = index;
+            number = number_string(tokenvec_string(token_vector, index), buffer);
+            errno = 0;
+            uint64_t val = strtol(number, NULL, 10);
             if (errno == ERANGE)
                 parse_error(INT_RANGE, index);
             
@@ -364,8 +466,12 @@ int parse_expression_literal(uint32_t *p_index, uint64_t *output_index) {
             break;
         case FLOATVAL:
             expr.type.expr = FLOAT_EXPR;
-            expect_token(FLOATVAL, index, &expr.string);
-            double fval = strtod(expr.string.string, NULL);
+            expect_token(FLOATVAL, index, NULL);
+            expr.symbol = NUMBER_SYMBOL;
+            expr.field2.node = index;
+            number = number_string(tokenvec_string(token_vector, index), buffer);
+            errno = 0;
+            double fval = strtod(number, NULL);
             if (errno == ERANGE)
                 parse_error(FLOAT_RANGE, index);
             
@@ -374,11 +480,11 @@ int parse_expression_literal(uint32_t *p_index, uint64_t *output_index) {
             break;
         case TRUE:
             expr.type.expr = TRUE_EXPR;
-            expect_token(TRUE, index++, &expr.string);
+            expect_text(TRUE, index++, &expr);
             break;
         case FALSE:
             expr.type.expr = FALSE_EXPR;
-            expect_token(FALSE, index++, &expr.string);
+            expect_text(FALSE, index++, &expr);
             break;
         case VOID:
             expr.type.expr = VOID_EXPR;
@@ -389,71 +495,74 @@ int parse_expression_literal(uint32_t *p_index, uint64_t *output_index) {
             paren_index = index-1;
             parse_expression(&index, &expr.field1.node, MIN_PRECEDENCE);
             if (!expect_token(RPAREN, index++, NULL))
-                add_parse_error(UNCLOSED_PAREN, tokenvec_get(token_vector, index-1), tokenvec_get(token_vector, paren_index));
+                paren_error(index - 1, paren_index);
             if (!nodevec_remove(node_vector, expr.field1.node, &expr))
                 return 0;
             break;
         case VARIABLE:
             expr.type.expr = VAR_EXPR;
-            expect_token(VARIABLE, index++, &expr.string);
+            expect_name(index++, &expr);
             
             if (peek_token_type(index) == LCURLY) {
                 expr.type.expr = STRUCTLITERAL_EXPR;
                 expect_token(LCURLY, index++, NULL);
                 paren_index = index-1;
 
-                expr.field1.list = vector_create(); if (!expr.field1.list) return 0;
+                list_base = child_stack.size;
                 while (1) {
                     if (peek_token_type(index) == RCURLY) break;
 
                     if (parse_expression(&index, &output, MIN_PRECEDENCE))
-                        vector_append(expr.field1.list, (void*) output);
+                        u32vec_append(&child_stack, output);
                     else if (!try_find_next(&index, COMMA, RCURLY))
                         break;
                     
                     if (peek_token_type(index) == RCURLY) break;
                     else if (!expect_token(COMMA, index++, NULL)) break;
                 }
+                expr.field1.list = list_seal(&child_stack, list_base);
                 if (!expect_token(RCURLY, index++, NULL))
-                    add_parse_error(UNCLOSED_PAREN, tokenvec_get(token_vector, index-1), tokenvec_get(token_vector, paren_index));
+                    paren_error(index - 1, paren_index);
             }
             else if (peek_token_type(index) == LPAREN) {
                 expr.type.expr = CALL_EXPR;
                 expect_token(LPAREN, index++, NULL);
                 paren_index = index-1;
 
-                expr.field1.list = vector_create(); if (!expr.field1.list) return 0;
+                list_base = child_stack.size;
                 while (1) {
                     if (peek_token_type(index) == RPAREN) break;
                     if (parse_expression(&index, &output, MIN_PRECEDENCE))
-                        vector_append(expr.field1.list, (void*) output);
+                        u32vec_append(&child_stack, output);
                     else if (!try_find_next(&index, COMMA, RPAREN))
                         break;
                     if (peek_token_type(index) == RPAREN) break;
                     else if (!expect_token(COMMA, index++, NULL)) break;
                 }
+                expr.field1.list = list_seal(&child_stack, list_base);
                 if (!expect_token(RPAREN, index++, NULL))
-                    add_parse_error(UNCLOSED_PAREN, tokenvec_get(token_vector, index-1), tokenvec_get(token_vector, paren_index));
+                    paren_error(index - 1, paren_index);
             }
             break;
         case LSQUARE:
             expr.type.expr = ARRAYLITERAL_EXPR;
-            expect_token(LSQUARE, index++, &expr.string);
+            expect_text(LSQUARE, index++, &expr);
             paren_index = index-1;
 
-            expr.field1.list = vector_create(); if (!expr.field1.list) return 0;
+            list_base = child_stack.size;
             while (1) {
                 if (peek_token_type(index) == RSQUARE) break;
                 if (parse_expression(&index, &output, MIN_PRECEDENCE))
-                    vector_append(expr.field1.list, (void*) output);
+                    u32vec_append(&child_stack, output);
                 else if (!try_find_next(&index, COMMA, RSQUARE))
                     break;
 
                 if (peek_token_type(index) == RSQUARE) break;
                 else if (!expect_token(COMMA, index++, NULL)) break;
             }
+            expr.field1.list = list_seal(&child_stack, list_base);
             if (!expect_token(RSQUARE, index++, NULL))
-                add_parse_error(UNCLOSED_PAREN, tokenvec_get(token_vector, index-1), tokenvec_get(token_vector, paren_index));
+                paren_error(index - 1, paren_index);
 
             break;
         case ARRAY:
@@ -462,29 +571,32 @@ int parse_expression_literal(uint32_t *p_index, uint64_t *output_index) {
             expect_token(LSQUARE, index++, NULL);
             paren_index = index-1;
 
-            expr.field1.list = vector_create();
-            expr.field2.list = vector_create();
-            if (!expr.field1.list || !expr.field2.list) return 0;
+            var_base = loop_var_stack.size;
+            list_base = child_stack.size;
 
             while (1) {
                 if (peek_token_type(index) == RSQUARE) break;
-                if (expect_token(VARIABLE, index, &var))
-                    vector_append(expr.field1.list, (void*) (uint64_t) index);
+                if (expect_name(index, &var)) {
+                    var.token_index = index;
+                    u32vec_append(&loop_var_stack, nodevec_append(node_vector, var));
+                }
                 else if (!try_find_next(&index, COLON, RSQUARE))
                     break;
                 ++index;
 
                 expect_token(COLON, index++, NULL);
                 if (parse_expression(&index, &output, MIN_PRECEDENCE))
-                    vector_append(expr.field2.list, (void*) output);
+                    u32vec_append(&child_stack, output);
                 else if (!try_find_next(&index, COMMA, RSQUARE))
                     break;
 
                 if (peek_token_type(index) == RSQUARE) break;
                 else if (!expect_token(COMMA, index++, NULL)) break;
             }
+            expr.field1.list = list_seal(&loop_var_stack, var_base);
+            expr.field2.list = list_seal(&child_stack, list_base);
             if (!expect_token(RSQUARE, index++, NULL))
-                add_parse_error(UNCLOSED_PAREN, tokenvec_get(token_vector, index-1), tokenvec_get(token_vector, paren_index));
+                paren_error(index - 1, paren_index);
 
             parse_expression(&index, &expr.field3.node, MIN_PRECEDENCE);
             break;
@@ -494,29 +606,32 @@ int parse_expression_literal(uint32_t *p_index, uint64_t *output_index) {
             expect_token(LSQUARE, index++, NULL);
             paren_index = index-1;
 
-            expr.field1.list = vector_create();
-            expr.field2.list = vector_create();
-            if (!expr.field1.list || !expr.field2.list) return 0;
+            var_base = loop_var_stack.size;
+            list_base = child_stack.size;
 
             while (1) {
                 if (peek_token_type(index) == RSQUARE) break;
-                if (expect_token(VARIABLE, index, &var))
-                    vector_append(expr.field1.list, (void*) (uint64_t) index);
+                if (expect_name(index, &var)) {
+                    var.token_index = index;
+                    u32vec_append(&loop_var_stack, nodevec_append(node_vector, var));
+                }
                 else if (!try_find_next(&index, COLON, RSQUARE))
                     break;
                 ++index;
 
                 expect_token(COLON, index++, NULL);
                 if (parse_expression(&index, &output, MIN_PRECEDENCE))
-                    vector_append(expr.field2.list, (void*) output);
+                    u32vec_append(&child_stack, output);
                 else if (!try_find_next(&index, COLON, RSQUARE))
                     break;
 
                 if (peek_token_type(index) == RSQUARE) break;
                 else if (!expect_token(COMMA, index++, NULL)) break;
             }
+            expr.field1.list = list_seal(&loop_var_stack, var_base);
+            expr.field2.list = list_seal(&child_stack, list_base);
             if (!expect_token(RSQUARE, index++, NULL))
-                add_parse_error(UNCLOSED_PAREN, tokenvec_get(token_vector, index-1), tokenvec_get(token_vector, paren_index));
+                paren_error(index - 1, paren_index);
 
             parse_expression(&index, &expr.field3.node, MIN_PRECEDENCE);
             break;
@@ -544,25 +659,26 @@ int parse_expression_literal(uint32_t *p_index, uint64_t *output_index) {
         if (type == DOT) {
             superexpr.type.expr = DOT_EXPR;
             expect_token(DOT, index++, NULL);
-            expect_token(VARIABLE, index++, &superexpr.string);
+            expect_name(index++, &superexpr);
         }
         else if (type == LSQUARE) {
             superexpr.type.expr = ARRAYINDEX_EXPR;
             expect_token(LSQUARE, index++, NULL);
             paren_index = index-1;
 
-            superexpr.field2.list = vector_create(); if (!superexpr.field2.list) return 0;
+            list_base = child_stack.size;
             while (1) {
                 if (peek_token_type(index) == RSQUARE) break;
                 if (parse_expression(&index, &output, MIN_PRECEDENCE))
-                    vector_append(superexpr.field2.list, (void*) output);
+                    u32vec_append(&child_stack, output);
                 else if (!try_find_next(&index, COMMA, RSQUARE))
                     break;
                 if (peek_token_type(index) == RSQUARE) break;
                 else if (!expect_token(COMMA, index++, NULL)) break;
             }
+            superexpr.field2.list = list_seal(&child_stack, list_base);
             if (!expect_token(RSQUARE, index++, NULL))
-                add_parse_error(UNCLOSED_PAREN, tokenvec_get(token_vector, index-1), tokenvec_get(token_vector, paren_index));
+                paren_error(index - 1, paren_index);
         }
 
         expr = superexpr;
@@ -576,7 +692,7 @@ int parse_expression_literal(uint32_t *p_index, uint64_t *output_index) {
     return 1;
 }
 
-int parse_binding(uint32_t *p_index, uint64_t *output_index) {
+int parse_binding(uint32_t *p_index, uint32_t *output_index) {
     uint32_t index = *p_index;
     AstNode bind = get_empty_node();
 
@@ -590,7 +706,7 @@ int parse_binding(uint32_t *p_index, uint64_t *output_index) {
     return 1;
 }
 
-int parse_type(uint32_t *p_index, uint64_t *output_index) {
+int parse_type(uint32_t *p_index, uint32_t *output_index) {
     uint32_t index = *p_index;
     AstNode type = get_empty_node();
     
@@ -612,7 +728,7 @@ int parse_type(uint32_t *p_index, uint64_t *output_index) {
             ++index;
             break;
         case VARIABLE:
-            expect_token(VARIABLE, index++, &type.string);
+            expect_name(index++, &type);
             type.type.type = STRUCT_TYPE;
             break;
         default:
@@ -636,7 +752,7 @@ int parse_type(uint32_t *p_index, uint64_t *output_index) {
             supertype.field1.int_value += 1;
         }
         if (!expect_token(RSQUARE, index++, NULL))
-            add_parse_error(UNCLOSED_PAREN, tokenvec_get(token_vector, index-1), tokenvec_get(token_vector, paren_index));
+            paren_error(index - 1, paren_index);
 
         type = supertype;
     }
@@ -647,7 +763,7 @@ int parse_type(uint32_t *p_index, uint64_t *output_index) {
     return 1;
 }
 
-int parse_statement(uint32_t *p_index, uint64_t *output_index) {
+int parse_statement(uint32_t *p_index, uint32_t *output_index) {
     uint32_t index = *p_index;
     AstNode stmt = get_empty_node();
 
@@ -664,7 +780,7 @@ int parse_statement(uint32_t *p_index, uint64_t *output_index) {
             expect_token(ASSERT, index++, NULL);
             parse_expression(&index, &stmt.field1.node, MIN_PRECEDENCE);
             expect_token(COMMA, index++, NULL);
-            expect_token(STRING, index++, &stmt.string);
+            expect_text(STRING, index++, &stmt);
             break;
         case RETURN:
             stmt.type.stmt = RETURN_STMT;
@@ -683,11 +799,9 @@ int parse_statement(uint32_t *p_index, uint64_t *output_index) {
 }
 
 int is_binary_operator(uint32_t token_index) {
-    Token *token = tokenvec_get(token_vector, token_index);
-    if (!token) return 0;
-    if (token->type != OP) return 0;
+    if (peek_token_type(token_index) != OP) return 0;
 
-    StringRef string = token->strref;
+    StringRef string = tokenvec_string(token_vector, token_index);
     switch (*string.string) {
         case '!':
             if (string.length != 2 || *(string.string+1) != '=') return 0;
@@ -772,7 +886,7 @@ int get_primitive_expr_type(uint32_t expr_index) {
             return 1;
         case BINOP_EXPR:
             newtype.token_index = expr->token_index;
-            if (is_boolean_operator(expr->string))
+            if (is_boolean_operator(symbol_name(expr->symbol)))
                 newtype.type.type = BOOL_TYPE;
             else
                 newtype.type.type = VAR_TYPE;
@@ -780,7 +894,7 @@ int get_primitive_expr_type(uint32_t expr_index) {
         case IF_EXPR:
             return 1;
         case ARRAYLITERAL_EXPR:
-            if (expr->field1.list->size == 0) return 0;
+            if (childlist_size(expr->field1.list) == 0) return 0;
             newtype.type.type = ARRAY_TYPE;
             newtype.token_index = expr->token_index;
             newtype.field1.int_value = 1;
@@ -788,18 +902,20 @@ int get_primitive_expr_type(uint32_t expr_index) {
         case ARRAYINDEX_EXPR:
             return 1;
         case SUMLOOP_EXPR:
-            if (expr->field1.list->size == 0) return 0;
+            if (childlist_size(expr->field1.list) == 0) return 0;
             break;
         case ARRAYLOOP_EXPR:
-            if (expr->field1.list->size == 0) return 0;
+            if (childlist_size(expr->field1.list) == 0) return 0;
             newtype.type.type = ARRAY_TYPE;
             newtype.token_index = expr->token_index;
-            newtype.field1.int_value = expr->field1.list->size;
+            newtype.field1.int_value = childlist_size(expr->field1.list);
             break;
         default:
             return 0;
     }
 
-    expr->field4.node = nodevec_append(node_vector, newtype);
+    // Appending may move the node array
+    uint64_t type_index = nodevec_append(node_vector, newtype);
+    nodevec_get(node_vector, expr_index)->field4.node = type_index;
     return 1;
 }
@@ -1,12 +1,20 @@
 #include <stdio.h>
+#include <math.h>
 
 #include "printer.h"
+#include "error.h"
 #include "token.h"
+#include "astfile.h"
 
-#define ADD_SPACE cvec_append(print_buffer, ' ')
-#define ADD_NEWLINE cvec_append(print_buffer, '\n');
-#define ADD_LPAREN cvec_append(print_buffer, '(');
-#define ADD_RPAREN cvec_append(print_buffer, ')');
+#define ADD_SPACE put_char(' ')
+#define ADD_NEWLINE put_char('\n');
+#define ADD_LPAREN put_char('(');
+#define ADD_RPAREN put_char(')');
+
+// Output goes through a buffer of this many bytes, written out whenever it fills
+#define PRINT_BUFFER_SIZE (1 << 16)
+
+extern char *token_names[];
 
 char *token_output[] = { "ARRAY '", "ASSERT '", "BOOL '", "COLON '", "COMMA '", "DOT '", "ELSE '", "END_OF_FILE",
                         "EQUALS '", "FALSE '", "FLOAT '", "FLOATVAL '", "FN '", "IF '", "IMAGE '", "INT '", "INTVAL '",
@@ -30,20 +38,43 @@ int stmt_lengths[] = { 8, 11, 11 };
 char *type_output[] = { "(IntType", "(BoolType", "(FloatType", "(ArrayType", "(StructType", "(VoidType", "(VarType" };
 int type_lengths[] = { 8, 9, 10, 10, 11, 9, 8 };
 
-static CVec *print_buffer;
-static NodeVec *node_list;
-static TokenVec *token_list;
-static int type_mode;
+static _Thread_local CVec *print_buffer;
+static _Thread_local NodeVec *node_list;
+static _Thread_local TokenVec *token_list;
+static _Thread_local int type_mode;
+
+static inline void put_array(const char *string, size_t length) {
+    if (!string) return;
+    if (print_buffer->size + length > print_buffer->capacity) {
+        cvec_flush(print_buffer, get_output());
+        if (length > print_buffer->capacity) {
+            fwrite(string, 1, length, get_output());
+            return;
+        }
+    }
+    memcpy(print_buffer->array + print_buffer->size, string, length);
+    print_buffer->size += length;
+}
+
+static inline void put_ref(StringRef string) {
+    put_array(string.string, string.length);
+}
+
+static inline void put_char(char c) {
+    if (print_buffer->size == print_buffer->capacity) cvec_flush(print_buffer, get_output());
+    print_buffer->array[print_buffer->size++] = c;
+}
 
 void print_tokens(TokenVec *vector) {
     if (!vector) return;
+    Token value;
     Token *token;
     size_t num_tokens = sizeof(token_output)/sizeof(char*);
-    print_buffer = cvec_create_cap(vector->size << 8); if (!print_buffer) return;
+    print_buffer = cvec_create_cap(PRINT_BUFFER_SIZE); if (!print_buffer) return;
     
     char *token_string;
     for (size_t i = 0; i < vector->size; ++i) {
-        token = tokenvec_get(vector, i);
+        token = tokenvec_get(vector, i, &value);
         if (token->type >= num_tokens) {
             fprintf(stderr, "Token string index out of bounds.\n");
             exit(EXIT_FAILURE);
@@ -53,25 +84,27 @@ void print_tokens(TokenVec *vector) {
         switch (token->type) {
             case NEWLINE:
             case END_OF_FILE:
-                cvec_append_array_line(print_buffer, token_string, strlen(token_string));
+                put_array(token_string, strlen(token_string));
+                ADD_NEWLINE;
                 break;
             default:
-                cvec_append_array(print_buffer, token_string, strlen(token_string));
-                cvec_append_ref(print_buffer, token->strref);
-                cvec_append_array(print_buffer, "\'\n", 2);
+                put_array(token_string, strlen(token_string));
+                put_ref(token->strref);
+                put_array("\'\n", 2);
         }
     }
-    cvec_print(print_buffer);
+    cvec_flush(print_buffer, get_output());
     cvec_destroy(print_buffer);
 }
 
+// A program without nodes prints nothing, not even the closing newline
 void print_nodes(NodeVec *nodes, Vector *commands, TokenVec *tokens) {
-    if (!nodes || !commands) return;
+    if (!nodes || !commands || !nodes->size) return;
 
     node_list = nodes;
     token_list = tokens;
 
-    print_buffer = cvec_create_cap(nodes->size << 8); if (!print_buffer) return;
+    print_buffer = cvec_create_cap(PRINT_BUFFER_SIZE); if (!print_buffer) return;
 
     for (size_t i = 0; i < commands->size; ++i) {
         uint64_t command_index = (uint64_t) vector_get(commands, i);
@@ -79,8 +112,8 @@ void print_nodes(NodeVec *nodes, Vector *commands, TokenVec *tokens) {
         ADD_NEWLINE;
     }
 
-    cvec_append(print_buffer, '\n');
-    cvec_print(print_buffer);
+    ADD_NEWLINE;
+    cvec_flush(print_buffer, get_output());
     cvec_destroy(print_buffer);
 }
 
@@ -91,20 +124,20 @@ void set_type_check(int value) {
 void print_command(AstNode *cmd) {
     char *header = cmd_output[cmd->type.cmd];
 
-    cvec_append_array(print_buffer, header, cmd_lengths[cmd->type.cmd]);
+    put_array(header, cmd_lengths[cmd->type.cmd]);
     ADD_SPACE;
-    Vector *list;
+    ChildList list;
 
     switch (cmd->type.cmd) {
         case READ_CMD:
-            cvec_append_ref(print_buffer, cmd->string);
+            put_ref(symbol_name(cmd->symbol));
             ADD_SPACE;
             print_lvalue(nodevec_get(node_list, cmd->field1.node));
             break;
         case WRITE_CMD:
             print_expression(nodevec_get(node_list, cmd->field1.node));
             ADD_SPACE;
-            cvec_append_ref(print_buffer, cmd->string);
+            put_ref(symbol_name(cmd->symbol));
             break;
         case LET_CMD:
             print_lvalue(nodevec_get(node_list, cmd->field1.node));
@@ -114,50 +147,47 @@ void print_command(AstNode *cmd) {
         case ASSERT_CMD:
             print_expression(nodevec_get(node_list, cmd->field1.node));
             ADD_SPACE;
-            cvec_append_ref(print_buffer, cmd->string);
+            put_ref(symbol_name(cmd->symbol));
             break;
         case SHOW_CMD:
             print_expression(nodevec_get(node_list, cmd->field1.node));
             break;
         case PRINT_CMD:
-            cvec_append_ref(print_buffer, cmd->string);
+            put_ref(symbol_name(cmd->symbol));
             break;
         case TIME_CMD:
             print_command(nodevec_get(node_list, cmd->field1.node));
             break;
         case FN_CMD:
-            cvec_append_ref(print_buffer, cmd->string);
+            put_ref(symbol_name(cmd->symbol));
             ADD_SPACE;
             ADD_LPAREN;
             ADD_LPAREN;
             list = cmd->field1.list;
-            for (size_t i = 0; i < list->size; ++i) { 
+            for (size_t i = 0; i < childlist_size(list); ++i) { 
                 if (i) ADD_SPACE;
-                print_binding(nodevec_get(node_list, (uint64_t) vector_get(list, i)));
+                print_binding(nodevec_get(node_list, childlist_get(list, i)));
             }
-            vector_destroy(list);
             ADD_RPAREN;
             ADD_RPAREN;
             ADD_SPACE;
             print_type(nodevec_get(node_list, cmd->field2.node));
             list = cmd->field3.list;
-            for (size_t i = 0; i < list->size; ++i) {
+            for (size_t i = 0; i < childlist_size(list); ++i) {
                 ADD_SPACE;
-                print_statement(nodevec_get(node_list, (uint64_t) vector_get(list, i)));
+                print_statement(nodevec_get(node_list, childlist_get(list, i)));
             }
-            vector_destroy(list);
             break;
         case STRUCT_CMD:
-            cvec_append_ref(print_buffer, cmd->string);
+            put_ref(symbol_name(cmd->symbol));
             list = cmd->field1.list;
-            for (size_t i = 0; i < list->size; ++i) {
+            for (size_t i = 0; i < childlist_size(list); ++i) {
                 ADD_SPACE;
-                AstNode *member = nodevec_get(node_list, (uint64_t) vector_get(list, i));
-                cvec_append_ref(print_buffer, member->string);
+                AstNode *member = nodevec_get(node_list, childlist_get(list, i));
+                put_ref(symbol_name(member->symbol));
                 ADD_SPACE;
                 print_type(nodevec_get(node_list, member->field2.node));
             }
-            vector_destroy(list);
             break;
         default:
             return;
@@ -168,21 +198,20 @@ void print_command(AstNode *cmd) {
 
 void print_lvalue(AstNode *lvalue) {
     char *header = lvalue_output[lvalue->type.lvalue];
-    cvec_append_array(print_buffer, header, lvalue_lengths[lvalue->type.lvalue]);
+    put_array(header, lvalue_lengths[lvalue->type.lvalue]);
     ADD_SPACE;
 
     switch (lvalue->type.lvalue) {
         case VAR_LVALUE:
-            cvec_append_ref(print_buffer, lvalue->string);
+            put_ref(symbol_name(lvalue->symbol));
             break;
         case ARRAY_LVALUE:
-            cvec_append_ref(print_buffer, lvalue->string);
-            Vector *list = lvalue->field1.list;
-            for (size_t i = 0; i < list->size; ++i) {
+            put_ref(symbol_name(lvalue->symbol));
+            ChildList list = lvalue->field1.list;
+            for (size_t i = 0; i < childlist_size(list); ++i) {
                 ADD_SPACE;
-                cvec_append_ref(print_buffer, nodevec_get(node_list, (uint64_t) vector_get(list, i))->string);
+                put_ref(symbol_name(nodevec_get(node_list, childlist_get(list, i))->symbol));
             }
-            vector_destroy(list);
             break;
         default:
             return;
@@ -193,7 +222,7 @@ void print_lvalue(AstNode *lvalue) {
 
 void print_expression(AstNode *expr) {
     char *header = expr_output[expr->type.expr];
-    cvec_append_array(print_buffer, header, expr_lengths[expr->type.expr]);
+    put_array(header, expr_lengths[expr->type.expr]);
 
     if (type_mode) {
         ADD_SPACE;
@@ -201,20 +230,20 @@ void print_expression(AstNode *expr) {
     }
 
     char buffer[30];
-    Vector *list;
-    Vector *list2;
+    ChildList list;
+    ChildList list2;
     switch (expr->type.expr) {
         case INT_EXPR:
             ADD_SPACE;
             if (sprintf(buffer, "%ld", expr->field1.int_value) < 0)
                 return;
-            cvec_append_array(print_buffer, buffer, strlen(buffer));
+            put_array(buffer, strlen(buffer));
             break;
         case FLOAT_EXPR:
             ADD_SPACE;
             if (sprintf(buffer, "%ld", (uint64_t) expr->field1.float_value) < 0)
                 return;
-            cvec_append_array(print_buffer, buffer, strlen(buffer));
+            put_array(buffer, strlen(buffer));
             break;
         case TRUE_EXPR:
         case FALSE_EXPR:
@@ -222,55 +251,51 @@ void print_expression(AstNode *expr) {
             break;
         case VAR_EXPR:
             ADD_SPACE;
-            cvec_append_ref(print_buffer, expr->string);
+            put_ref(symbol_name(expr->symbol));
             break;
         case ARRAYLITERAL_EXPR:
             list = expr->field1.list;
-            for (size_t i = 0; i < list->size; ++i) {
+            for (size_t i = 0; i < childlist_size(list); ++i) {
                 ADD_SPACE;
-                print_expression(nodevec_get(node_list, (size_t) vector_get(list, i)));
+                print_expression(nodevec_get(node_list, childlist_get(list, i)));
             }
-            vector_destroy(list);
             break;
         case STRUCTLITERAL_EXPR:
             ADD_SPACE;
-            cvec_append_ref(print_buffer, expr->string);
+            put_ref(symbol_name(expr->symbol));
             list = expr->field1.list;
-            for (size_t i = 0; i < list->size; ++i) {
+            for (size_t i = 0; i < childlist_size(list); ++i) {
                 ADD_SPACE;
-                print_expression(nodevec_get(node_list, (size_t) vector_get(list, i)));
+                print_expression(nodevec_get(node_list, childlist_get(list, i)));
             }
-            vector_destroy(list);
             break;
         case DOT_EXPR:
             ADD_SPACE;
             print_expression(nodevec_get(node_list, expr->field1.node));
             ADD_SPACE;
-            cvec_append_ref(print_buffer, expr->string);
+            put_ref(symbol_name(expr->symbol));
             break;
         case ARRAYINDEX_EXPR:
             ADD_SPACE;
             print_expression(nodevec_get(node_list, expr->field1.node));
             list = expr->field2.list;
-            for (size_t i = 0; i < list->size; ++i) {
+            for (size_t i = 0; i < childlist_size(list); ++i) {
                 ADD_SPACE;
-                print_expression(nodevec_get(node_list, (size_t) vector_get(list, i)));
+                print_expression(nodevec_get(node_list, childlist_get(list, i)));
             }
-            vector_destroy(list);
             break;
         case CALL_EXPR:
             ADD_SPACE;
-            cvec_append_ref(print_buffer, expr->string);
+            put_ref(symbol_name(expr->symbol));
             list = expr->field1.list;
-            for (size_t i = 0; i < list->size; ++i) {
+            for (size_t i = 0; i < childlist_size(list); ++i) {
                 ADD_SPACE;
-                print_expression(nodevec_get(node_list, (size_t) vector_get(list, i)));
+                print_expression(nodevec_get(node_list, childlist_get(list, i)));
             }
-            vector_destroy(list);
             break;
         case UNOP_EXPR:
             ADD_SPACE;
-            cvec_append_ref(print_buffer, expr->string);
+            put_ref(symbol_name(expr->symbol));
             ADD_SPACE;
             print_expression(nodevec_get(node_list, expr->field1.node));
             break;
@@ -278,7 +303,7 @@ void print_expression(AstNode *expr) {
             ADD_SPACE;
             print_expression(nodevec_get(node_list, expr->field1.node));
             ADD_SPACE;
-            cvec_append_ref(print_buffer, expr->string);
+            put_ref(symbol_name(expr->symbol));
             ADD_SPACE;
             print_expression(nodevec_get(node_list, expr->field2.node));
             break;
@@ -295,16 +320,14 @@ void print_expression(AstNode *expr) {
         case SUMLOOP_EXPR:
             list = expr->field1.list;
             list2 = expr->field2.list;
-            for (size_t i = 0; i < list->size; ++i) {
+            for (size_t i = 0; i < childlist_size(list); ++i) {
                 ADD_SPACE;
-                cvec_append_ref(print_buffer, tokenvec_get(token_list, (uint64_t) vector_get(list, i))->strref);
+                put_ref(symbol_name(nodevec_get(node_list, childlist_get(list, i))->symbol));
                 ADD_SPACE;
-                print_expression(nodevec_get(node_list, (size_t) vector_get(list2, i)));
+                print_expression(nodevec_get(node_list, childlist_get(list2, i)));
             }
             ADD_SPACE;
             print_expression(nodevec_get(node_list, expr->field3.node));
-            vector_destroy(list);
-            vector_destroy(list2);
             break;
         default:
             return;
@@ -315,7 +338,7 @@ void print_expression(AstNode *expr) {
 
 void print_type(AstNode *type) {
     char *header = type_output[type->type.type];
-    cvec_append_array(print_buffer, header, type_lengths[type->type.type]);
+    put_array(header, type_lengths[type->type.type]);
 
     char buffer[20];
     switch (type->type.type) {
@@ -330,15 +353,15 @@ void print_type(AstNode *type) {
             ADD_SPACE;
             if (sprintf(buffer, "%ld", type->field1.int_value) < 0)
                 return;
-            cvec_append_array(print_buffer, buffer, strlen(buffer));
+            put_array(buffer, strlen(buffer));
             break;
         case STRUCT_TYPE:
             ADD_SPACE;
-            cvec_append_ref(print_buffer, type->string);
+            put_ref(symbol_name(type->symbol));
             break;
         case VAR_TYPE:
             ADD_SPACE;
-            cvec_append_array(print_buffer, "VARIABLE TYPE NOT RESOLVED", 26);
+            put_array("VARIABLE TYPE NOT RESOLVED", 26);
             break;
         default:
             return;
@@ -349,7 +372,7 @@ void print_type(AstNode *type) {
 
 void print_statement(AstNode *stmt) {
     char *header = stmt_output[stmt->type.stmt];
-    cvec_append_array(print_buffer, header, stmt_lengths[stmt->type.stmt]);
+    put_array(header, stmt_lengths[stmt->type.stmt]);
     ADD_SPACE;
 
     switch (stmt->type.stmt) {
@@ -361,7 +384,7 @@ void print_statement(AstNode *stmt) {
         case ASSERT_STMT:
             print_expression(nodevec_get(node_list, stmt->field1.node));
             ADD_SPACE;
-            cvec_append_ref(print_buffer, stmt->string);
+            put_ref(symbol_name(stmt->symbol));
             break;
         case RETURN_STMT:
             print_expression(nodevec_get(node_list, stmt->field1.node));
@@ -378,3 +401,343 @@ void print_binding(AstNode *bind) {
     ADD_SPACE;
     print_type(nodevec_get(node_list, bind->field2.node));
 }
+
+// A node waiting to be visited takes two items on the stack, its index and then its category
+static void visit_push(U32Vec *stack, uint32_t node, uint8_t category) {
+    u32vec_append(stack, node);
+    u32vec_append(stack, category);
+}
+
+static void visit_list(U32Vec *stack, ChildList list, uint8_t category) {
+    for (size_t i = 0; i < childlist_size(list); ++i)
+        visit_push(stack, childlist_get(list, i), category);
+}
+
+// Labels every node the commands reach with its category, following the fields the s-expression printer
+// follows. Types are followed from expressions only once the program is type-checked.
+static uint8_t *node_categories(NodeVec *nodes, Vector *commands) {
+    uint8_t *categories = calloc(nodes->size ? nodes->size : 1, 1);
+    if (!categories) exit(EXIT_FAILURE);
+
+    U32Vec stack = {0};
+    for (size_t i = commands->size; i > 0; --i)
+        visit_push(&stack, (uint64_t) vector_get(commands, i - 1), COMMAND_NODE);
+
+    while (stack.size) {
+        uint8_t category = u32vec_pop_last(&stack);
+        uint32_t index = u32vec_pop_last(&stack);
+        if (index >= nodes->size || categories[index]) continue;
+        categories[index] = category;
+
+        AstNode *node = &nodes->array[index];
+        switch (category) {
+            case COMMAND_NODE:
+                switch (node->type.cmd) {
+                    case READ_CMD:
+                        visit_push(&stack, node->field1.node, LVALUE_NODE);
+                        break;
+                    case LET_CMD:
+                        visit_push(&stack, node->field3.node, EXPRESSION_NODE);
+                        visit_push(&stack, node->field1.node, LVALUE_NODE);
+                        break;
+                    case WRITE_CMD:
+                    case ASSERT_CMD:
+                    case SHOW_CMD:
+                        visit_push(&stack, node->field1.node, EXPRESSION_NODE);
+                        break;
+                    case TIME_CMD:
+                        visit_push(&stack, node->field1.node, COMMAND_NODE);
+                        break;
+                    case FN_CMD:
+                        visit_list(&stack, node->field3.list, STATEMENT_NODE);
+                        visit_push(&stack, node->field2.node, TYPE_NODE);
+                        visit_list(&stack, node->field1.list, BINDING_NODE);
+                        break;
+                    case STRUCT_CMD:
+                        visit_push(&stack, node->field2.node, TYPE_NODE);
+                        visit_list(&stack, node->field1.list, MEMBER_NODE);
+                        break;
+                    default:
+                        break;
+                }
+                break;
+            case EXPRESSION_NODE:
+                if (type_mode) visit_push(&stack, node->field4.node, TYPE_NODE);
+                switch (node->type.expr) {
+                    case ARRAYLITERAL_EXPR:
+                    case STRUCTLITERAL_EXPR:
+                    case CALL_EXPR:
+                        visit_list(&stack, node->field1.list, EXPRESSION_NODE);
+                        break;
+                    case ARRAYINDEX_EXPR:
+                        visit_list(&stack, node->field2.list, EXPRESSION_NODE);
+                        visit_push(&stack, node->field1.node, EXPRESSION_NODE);
+                        break;
+                    case IF_EXPR:
+                        visit_push(&stack, node->field3.node, EXPRESSION_NODE);
+                        visit_push(&stack, node->field2.node, EXPRESSION_NODE);
+                        visit_push(&stack, node->field1.node, EXPRESSION_NODE);
+                        break;
+                    case BINOP_EXPR:
+                        visit_push(&stack, node->field2.node, EXPRESSION_NODE);
+                        visit_push(&stack, node->field1.node, EXPRESSION_NODE);
+                        break;
+                    case DOT_EXPR:
+                    case UNOP_EXPR:
+                        visit_push(&stack, node->field1.node, EXPRESSION_NODE);
+                        break;
+                    case ARRAYLOOP_EXPR:
+                    case SUMLOOP_EXPR:
+                        visit_push(&stack, node->field3.node, EXPRESSION_NODE);
+                        visit_list(&stack, node->field2.list, EXPRESSION_NODE);
+                        visit_list(&stack, node->field1.list, LVALUE_NODE);
+                        break;
+                    default:
+                        break;
+                }
+                break;
+            case LVALUE_NODE:
+                if (node->type.lvalue == ARRAY_LVALUE) visit_list(&stack, node->field1.list, LVALUE_NODE);
+                break;
+            case STATEMENT_NODE:
+                if (node->type.stmt == LET_STMT) {
+                    visit_push(&stack, node->field3.node, EXPRESSION_NODE);
+                    visit_push(&stack, node->field1.node, LVALUE_NODE);
+                }
+                else visit_push(&stack, node->field1.node, EXPRESSION_NODE);
+                break;
+            case TYPE_NODE:
+                if (node->type.type == ARRAY_TYPE) visit_push(&stack, node->field2.node, TYPE_NODE);
+                break;
+            case BINDING_NODE:
+                visit_push(&stack, node->field2.node, TYPE_NODE);
+                visit_push(&stack, node->field1.node, LVALUE_NODE);
+                break;
+            case MEMBER_NODE:
+                visit_push(&stack, node->field2.node, TYPE_NODE);
+                break;
+        }
+    }
+
+    u32vec_release(&stack);
+    return categories;
+}
+
+static void put_uint(uint64_t value) {
+    char digits[20];
+    size_t count = 0;
+    do {
+        digits[sizeof(digits) - ++count] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    put_array(digits + sizeof(digits) - count, count);
+}
+
+static void put_int(int64_t value) {
+    if (value < 0) {
+        put_char('-');
+        put_uint(-(uint64_t) value);
+    }
+    else put_uint(value);
+}
+
+static void put_json_string(StringRef string) {
+    static const char hex[] = "0123456789abcdef";
+    put_char('"');
+    for (size_t i = 0; i < string.length; ++i) {
+        unsigned char c = string.string[i];
+        if (c == '"' || c == '\\') {
+            put_char('\\');
+            put_char(c);
+        }
+        else if (c < 0x20 || c >= 0x7f) {
+            char escape[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+            put_array(escape, sizeof(escape));
+        }
+        else put_char(c);
+    }
+    put_char('"');
+}
+
+static void put_json_names(char *key, char **names, int *lengths, size_t count, size_t skip) {
+    put_char('"');
+    put_array(key, strlen(key));
+    put_array("\":[", 3);
+    for (size_t i = 0; i < count; ++i) {
+        if (i) put_char(',');
+        char *name = names[i] + skip;
+        put_json_string((StringRef) {lengths ? lengths[i] - skip : strlen(name), name});
+    }
+    put_char(']');
+}
+
+// Writes one field of every node as a JSON array
+#define PUT_NODE_COLUMN(key, value) \
+    put_array(key, sizeof(key) - 1); \
+    for (size_t i = 0; i < nodes->size; ++i) { \
+        AstNode *node = &nodes->array[i]; \
+        if (i) put_char(','); \
+        value; \
+    } \
+    put_char(']');
+
+static void put_u32_array(char *key, size_t key_length, uint32_t *items, size_t count) {
+    put_array(key, key_length);
+    for (size_t i = 0; i < count; ++i) {
+        if (i) put_char(',');
+        put_uint(items[i]);
+    }
+    put_char(']');
+}
+
+// Dumps the tokens and, after parsing, the nodes, commands and child pool as one JSON object
+void print_json(TokenVec *tokens, NodeVec *nodes, Vector *commands) {
+    if (!tokens) return;
+
+    print_buffer = cvec_create_cap(PRINT_BUFFER_SIZE); if (!print_buffer) return;
+
+    put_array("{\"version\":", 11);
+    put_uint(DUMP_VERSION);
+    put_array(",\"typed\":", 9);
+    put_array(type_mode ? "true" : "false", type_mode ? 4 : 5);
+
+    char *categories[] = { "none", "command", "expression", "lvalue", "statement", "type", "binding", "member" };
+    char *bindings[] = { "Binding" };
+    char *members[] = { "Member" };
+    put_array(",\"names\":{", 10);
+    put_json_names("token", token_names, NULL, sizeof(token_output) / sizeof(char*), 0);
+    put_char(',');
+    put_json_names("category", categories, NULL, sizeof(categories) / sizeof(char*), 0);
+    put_char(',');
+    put_json_names("command", cmd_output, cmd_lengths, sizeof(cmd_lengths) / sizeof(int), 1);
+    put_char(',');
+    put_json_names("expression", expr_output, expr_lengths, sizeof(expr_lengths) / sizeof(int), 1);
+    put_char(',');
+    put_json_names("lvalue", lvalue_output, lvalue_lengths, sizeof(lvalue_lengths) / sizeof(int), 1);
+    put_char(',');
+    put_json_names("statement", stmt_output, stmt_lengths, sizeof(stmt_lengths) / sizeof(int), 1);
+    put_char(',');
+    put_json_names("type", type_output, type_lengths, sizeof(type_lengths) / sizeof(int), 1);
+    put_char(',');
+    put_json_names("binding", bindings, NULL, 1, 0);
+    put_char(',');
+    put_json_names("member", members, NULL, 1, 0);
+
+    put_array("},\"tokens\":{\"kind\":[", 20);
+    for (size_t i = 0; i < tokens->size; ++i) {
+        if (i) put_char(',');
+        put_uint(tokens->kinds[i]);
+    }
+    put_array("],", 2);
+    put_u32_array("\"offset\":[", 10, tokens->offsets, tokens->size);
+    put_char(',');
+    put_u32_array("\"length\":[", 10, tokens->lengths, tokens->size);
+    put_char('}');
+
+    if (nodes && commands) {
+        uint8_t *category = node_categories(nodes, commands);
+        char number[32];
+
+        put_array(",\"nodes\":{", 10);
+        PUT_NODE_COLUMN("\"token\":[", put_uint(node->token_index))
+        put_array(",\"category\":[", 13);
+        for (size_t i = 0; i < nodes->size; ++i) {
+            if (i) put_char(',');
+            put_uint(category[i]);
+        }
+        put_char(']');
+        PUT_NODE_COLUMN(",\"kind\":[", put_uint(node->type.cmd))
+        PUT_NODE_COLUMN(",\"field1\":[",
+            if (category[i] != EXPRESSION_NODE || node->type.expr != FLOAT_EXPR) put_int(node->field1.int_value);
+            else if (!isfinite(node->field1.float_value)) put_array("null", 4);
+            else put_array(number, snprintf(number, sizeof(number), "%.17g", node->field1.float_value)))
+        PUT_NODE_COLUMN(",\"field2\":[", put_uint(node->field2.node))
+        PUT_NODE_COLUMN(",\"field3\":[", put_uint(node->field3.node))
+        PUT_NODE_COLUMN(",\"field4\":[", put_uint(node->field4.node))
+        PUT_NODE_COLUMN(",\"text\":[",
+            if (node->symbol) put_json_string(tokenvec_text(tokens, node));
+            else put_array("null", 4))
+        put_char('}');
+        free(category);
+
+        put_array(",\"commands\":[", 13);
+        for (size_t i = 0; i < commands->size; ++i) {
+            if (i) put_char(',');
+            put_uint((uint64_t) vector_get(commands, i));
+        }
+        put_char(']');
+
+        size_t pool_size;
+        uint32_t *pool = childlist_pool(&pool_size);
+        put_u32_array(",\"pool\":[", 9, pool, pool_size);
+    }
+
+    put_array("}\n", 2);
+    cvec_flush(print_buffer, get_output());
+    cvec_destroy(print_buffer);
+}
+
+static void put_section(DumpTag tag, uint32_t item_size, uint64_t count) {
+    DumpSection section = { tag, item_size, count };
+    put_array((char*) &section, sizeof(section));
+}
+
+// Dumps the same arrays as print_json in the binary layout described in printer.h
+void print_binary(TokenVec *tokens, NodeVec *nodes, Vector *commands) {
+    if (!tokens) return;
+
+    print_buffer = cvec_create_cap(PRINT_BUFFER_SIZE); if (!print_buffer) return;
+    CVec *extras = cvec_create(); if (!extras) exit(EXIT_FAILURE);
+
+    // Lexing ends with END_OF_FILE at the end of the source
+    char *source = tokens->source;
+    size_t source_size = tokens->size ? tokens->offsets[tokens->size - 1] : 0;
+
+    DumpHeader header = { DUMP_MAGIC, DUMP_VERSION, type_mode };
+    put_array((char*) &header, sizeof(header));
+    put_section(DUMP_TOKEN_KINDS, sizeof(uint8_t), tokens->size);
+    put_array((char*) tokens->kinds, tokens->size);
+    put_section(DUMP_TOKEN_OFFSETS, sizeof(uint32_t), tokens->size);
+    put_array((char*) tokens->offsets, sizeof(uint32_t) * tokens->size);
+    put_section(DUMP_TOKEN_LENGTHS, sizeof(uint32_t), tokens->size);
+    put_array((char*) tokens->lengths, sizeof(uint32_t) * tokens->size);
+
+    if (nodes && commands) {
+        // A node's text is its symbol's, laid out the way a saved program lays it out
+        uint64_t *offsets = symbol_offsets(tokens, source_size, extras);
+        uint8_t *category = node_categories(nodes, commands);
+        put_section(DUMP_NODES, sizeof(DumpNode), nodes->size);
+        for (size_t i = 0; i < nodes->size; ++i) {
+            AstNode *node = &nodes->array[i];
+            StringRef text = tokenvec_text(tokens, node);
+            uint64_t offset = DUMP_NO_TEXT;
+            if (node->symbol == NUMBER_SYMBOL && text.string) offset = tokens->offsets[node->field2.node];
+            else if (text.string) offset = offsets[node->symbol];
+
+            DumpNode saved = { node->token_index, category[i], node->type.cmd, 0, node->field1.int_value,
+                               node->field2.node, node->field3.node, node->field4.node, text.length, offset };
+            put_array((char*) &saved, sizeof(saved));
+        }
+        free(category);
+        free(offsets);
+
+        put_section(DUMP_COMMANDS, sizeof(uint32_t), commands->size);
+        for (size_t i = 0; i < commands->size; ++i) {
+            uint32_t command = (uint64_t) vector_get(commands, i);
+            put_array((char*) &command, sizeof(command));
+        }
+
+        size_t pool_size;
+        uint32_t *pool = childlist_pool(&pool_size);
+        put_section(DUMP_POOL, sizeof(uint32_t), pool_size);
+        put_array((char*) pool, sizeof(uint32_t) * pool_size);
+    }
+
+    put_section(DUMP_STRINGS, sizeof(char), source_size + cvec_size(extras));
+    put_array(source, source_size);
+    put_array(extras->array, cvec_size(extras));
+
+    cvec_flush(print_buffer, get_output());
+    cvec_destroy(print_buffer);
+    cvec_destroy(extras);
+}
@@ -2,133 +2,471 @@
 
 #include "typecheck.h"
 
-static TokenVec *token_list;
-static NodeVec *node_list;
-static Dict *type_dict;
+static _Thread_local TokenVec *token_list;
+static _Thread_local NodeVec *node_list;
+static _Thread_local SymbolTable *scopes;
+static _Thread_local Dict *declarations;
+
+// Records of the last check, in command order, their items and the slot of each command node's record plus one.
+// Symbols are logged while a command is checked; a symbol whose meaning changed during an update marks its
+// bit in dirty_names. Symbols stay the same while a document is open, since its names stay interned.
+static _Thread_local CheckRecord *check_records;
+static _Thread_local size_t record_count;
+static _Thread_local U32Vec record_items;
+static _Thread_local uint32_t *record_slots;
+static _Thread_local size_t slot_capacity;
+static _Thread_local U32Vec read_log;
+static _Thread_local U32Vec decl_log;
+static _Thread_local uint8_t *dirty_names;
+static _Thread_local size_t dirty_size;
+static _Thread_local SymbolTable *member_names;
+
+// The predefined environment is generated once, as if from index 0, and copied after the parsed nodes of
+// every compilation. Links between predefined nodes are shifted by where the copy starts. The template keeps
+// its child lists in predef_items rather than the child pool, so that every thread can read it.
+static NodeVec *predef_nodes;
+static uint8_t predef_links[PREDEF_NODES];
+static StringRef predef_texts[PREDEF_NODES];
+static uint32_t predef_items[PREDEF_ITEMS];
+static uint32_t predef_indices[PREDEF_MAX];
+static size_t predef_count;
+static uint64_t predef_types[PREDEF_TYPES];
+static _Thread_local uint32_t predef_base;
+
+_Thread_local uint64_t float_index;
+_Thread_local uint64_t int_index;
+_Thread_local uint64_t bool_index;
+_Thread_local uint64_t void_index;
+_Thread_local uint64_t rgba_index;
+_Thread_local uint64_t intarray_index;
+_Thread_local uint64_t rgba_matrix_index;
+
+_Thread_local int type_exit_status = EXIT_SUCCESS;
 
-uint64_t float_index;
-uint64_t int_index;
-uint64_t bool_index;
-uint64_t void_index;
-uint64_t rgba_index;
-uint64_t intarray_index;
-uint64_t rgba_matrix_index;
+static char *type_names[] = { "INT", "BOOLEAN", "FLOAT", "ARRAY", "STRUCT", "VOID", "VARIABLE" };
 
-int type_exit_status = EXIT_SUCCESS;
+static uint32_t predef_append(NodeVec *nodes, AstNode node, uint8_t links, StringRef text) {
+    if (nodes->size == PREDEF_NODES) exit(EXIT_FAILURE);
 
-static char *type_names[] = { "INT", "BOOLEAN", "FLOAT", "ARRAY", "STRUCT", "VOID", "VARIABLE" };
+    predef_links[nodes->size] = links;
+    predef_texts[nodes->size] = text;
+    return nodevec_append(nodes, node);
+}
+
+static void add_predef(uint32_t index) {
+    if (predef_count == PREDEF_MAX) exit(EXIT_FAILURE);
+
+    predef_indices[predef_count++] = index;
+}
 
 void generate_predefs(NodeVec *nodes) {
     if (!nodes) return;
     AstNode node;
     
-    node = (AstNode) {0, {.type=FLOAT_TYPE}, {0}, {0}, {0}, {0}, {0, 0}};
-    float_index = nodevec_append(nodes, node);
-    node = (AstNode) {0, {.type=INT_TYPE}, {0}, {0}, {0}, {0}, {0, 0}};
-    int_index = nodevec_append(nodes, node);
-    node = (AstNode) {0, {.type=BOOL_TYPE}, {0}, {0}, {0}, {0}, {0, 0}};
-    bool_index = nodevec_append(nodes, node);
-    node = (AstNode) {0, {.type=VOID_TYPE}, {0}, {0}, {0}, {0}, {0, 0}};
-    void_index = nodevec_append(nodes, node);
-    node = (AstNode) {0, {.type=ARRAY_TYPE}, {1}, {int_index}, {0}, {0}, {0, 0}};
-    intarray_index = nodevec_append(nodes, node);
+    node = (AstNode) {0, {.type=FLOAT_TYPE}, {0}, {0}, {0}, {0}, 0};
+    float_index = predef_append(nodes, node, 0, (StringRef) {0, NULL});
+    node = (AstNode) {0, {.type=INT_TYPE}, {0}, {0}, {0}, {0}, 0};
+    int_index = predef_append(nodes, node, 0, (StringRef) {0, NULL});
+    node = (AstNode) {0, {.type=BOOL_TYPE}, {0}, {0}, {0}, {0}, 0};
+    bool_index = predef_append(nodes, node, 0, (StringRef) {0, NULL});
+    node = (AstNode) {0, {.type=VOID_TYPE}, {0}, {0}, {0}, {0}, 0};
+    void_index = predef_append(nodes, node, 0, (StringRef) {0, NULL});
+    node = (AstNode) {0, {.type=ARRAY_TYPE}, {1}, {int_index}, {0}, {0}, 0};
+    intarray_index = predef_append(nodes, node, LINK_TYPE, (StringRef) {0, NULL});
 
     // RGBA struct
-    Vector *bind_list = vector_create_cap(4);
-    node = (AstNode) {0, {0}, {0}, {float_index}, {0}, {0}, {1, "r"}};
-    vector_append(bind_list, (void*) nodevec_append(nodes, node));
-    node = (AstNode) {0, {0}, {0}, {float_index}, {0}, {0}, {1, "g"}};
-    vector_append(bind_list, (void*) nodevec_append(nodes, node));
-    node = (AstNode) {0, {0}, {0}, {float_index}, {0}, {0}, {1, "b"}};
-    vector_append(bind_list, (void*) nodevec_append(nodes, node));
-    node = (AstNode) {0, {0}, {0}, {float_index}, {0}, {0}, {1, "a"}};
-    vector_append(bind_list, (void*) nodevec_append(nodes, node));
+    uint32_t binds[4];
+    node = (AstNode) {0, {0}, {0}, {float_index}, {0}, {0}, 0};
+    binds[0] = predef_append(nodes, node, LINK_TYPE, (StringRef) {1, "r"});
+    node = (AstNode) {0, {0}, {0}, {float_index}, {0}, {0}, 0};
+    binds[1] = predef_append(nodes, node, LINK_TYPE, (StringRef) {1, "g"});
+    node = (AstNode) {0, {0}, {0}, {float_index}, {0}, {0}, 0};
+    binds[2] = predef_append(nodes, node, LINK_TYPE, (StringRef) {1, "b"});
+    node = (AstNode) {0, {0}, {0}, {float_index}, {0}, {0}, 0};
+    binds[3] = predef_append(nodes, node, LINK_TYPE, (StringRef) {1, "a"});
+    ChildList bind_list = childlist_create(binds, 4);
     
-    node = (AstNode) {0, {.type=STRUCT_TYPE}, {0}, {0}, {0}, {0}, {4, "rgba"}};
-    rgba_index = nodevec_append(nodes, node);
-    AstNode rgba_struct = (AstNode) {0, {.cmd=STRUCT_CMD}, {.list = bind_list}, {rgba_index}, {0}, {0}, {4, "rgba"}};
-    dict_add_ref(type_dict, (StringRef) {4, "rgba"}, (void*) nodevec_append(nodes, rgba_struct));
+    node = (AstNode) {0, {.type=STRUCT_TYPE}, {0}, {0}, {0}, {0}, 0};
+    rgba_index = predef_append(nodes, node, 0, (StringRef) {4, "rgba"});
+    AstNode rgba_struct = (AstNode) {0, {.cmd=STRUCT_CMD}, {.list = bind_list}, {rgba_index}, {0}, {0}, 0};
+    add_predef(predef_append(nodes, rgba_struct, LINK_TYPE | LINK_LIST, (StringRef) {4, "rgba"}));
 
     // RGBA Array Type
-    node = (AstNode) {0, {.type=ARRAY_TYPE}, {2}, {rgba_index}, {0}, {0}, {0, 0}};
-    rgba_matrix_index = nodevec_append(nodes, node);
+    node = (AstNode) {0, {.type=ARRAY_TYPE}, {2}, {rgba_index}, {0}, {0}, 0};
+    rgba_matrix_index = predef_append(nodes, node, LINK_TYPE, (StringRef) {0, NULL});
 
     // Args and Argnum
-    AstNode argnum = (AstNode) {0, {.cmd=LET_CMD}, {0}, {int_index}, {0}, {0}, {6, "argnum"}};
-    dict_add_ref(type_dict, (StringRef) {6, "argnum"}, (void*) nodevec_append(nodes, argnum));
-    AstNode args = (AstNode) {0, {.cmd=LET_CMD}, {0}, {intarray_index}, {0}, {0}, {4, "args"}};
-    dict_add_ref(type_dict, (StringRef) {4, "args"}, (void*) nodevec_append(nodes, args));
+    AstNode argnum = (AstNode) {0, {.cmd=LET_CMD}, {0}, {int_index}, {0}, {0}, 0};
+    add_predef(predef_append(nodes, argnum, LINK_TYPE, (StringRef) {6, "argnum"}));
+    AstNode args = (AstNode) {0, {.cmd=LET_CMD}, {0}, {intarray_index}, {0}, {0}, 0};
+    add_predef(predef_append(nodes, args, LINK_TYPE, (StringRef) {4, "args"}));
 
     // Function definitions
 
     // Float -> Float
-    AstNode bind = (AstNode) {0, {0}, {0}, {float_index}, {0}, {0}, {0, NULL}};
-    bind_list = vector_create_cap(1); if (!bind_list) exit(EXIT_FAILURE);
-    uint64_t bind_index = nodevec_append(nodes, bind);
-    vector_append(bind_list, (void*) bind_index);
-
-    AstNode fn = (AstNode) {0, {.cmd=FN_CMD}, {.list=bind_list}, {float_index}, {0}, {0}, {4, "sqrt"}};
-    dict_add_ref(type_dict, fn.string, (void*) nodevec_append(nodes, fn));
-    fn.string = (StringRef) {3, "exp"};
-    dict_add_ref(type_dict, fn.string, (void*) nodevec_append(nodes, fn));
-    fn.string = (StringRef) {3, "sin"};
-    dict_add_ref(type_dict, fn.string, (void*) nodevec_append(nodes, fn));
-    fn.string = (StringRef) {3, "cos"};
-    dict_add_ref(type_dict, fn.string, (void*) nodevec_append(nodes, fn));
-    fn.string = (StringRef) {3, "tan"};
-    dict_add_ref(type_dict, fn.string, (void*) nodevec_append(nodes, fn));
-    fn.string = (StringRef) {4, "asin"};
-    dict_add_ref(type_dict, fn.string, (void*) nodevec_append(nodes, fn));
-    fn.string = (StringRef) {4, "acos"};
-    dict_add_ref(type_dict, fn.string, (void*) nodevec_append(nodes, fn));
-    fn.string = (StringRef) {4, "atan"};
-    dict_add_ref(type_dict, fn.string, (void*) nodevec_append(nodes, fn));
-    fn.string = (StringRef) {3, "log"};
-    dict_add_ref(type_dict, fn.string, (void*) nodevec_append(nodes, fn));
+    AstNode bind = (AstNode) {0, {0}, {0}, {float_index}, {0}, {0}, 0};
+    binds[0] = predef_append(nodes, bind, LINK_TYPE, (StringRef) {0, NULL});
+    bind_list = childlist_create(binds, 1);
+
+    AstNode fn = (AstNode) {0, {.cmd=FN_CMD}, {.list=bind_list}, {float_index}, {0}, {0}, 0};
+    add_predef(predef_append(nodes, fn, LINK_TYPE | LINK_LIST, (StringRef) {4, "sqrt"}));
+    add_predef(predef_append(nodes, fn, LINK_TYPE | LINK_LIST, (StringRef) {3, "exp"}));
+    add_predef(predef_append(nodes, fn, LINK_TYPE | LINK_LIST, (StringRef) {3, "sin"}));
+    add_predef(predef_append(nodes, fn, LINK_TYPE | LINK_LIST, (StringRef) {3, "cos"}));
+    add_predef(predef_append(nodes, fn, LINK_TYPE | LINK_LIST, (StringRef) {3, "tan"}));
+    add_predef(predef_append(nodes, fn, LINK_TYPE | LINK_LIST, (StringRef) {4, "asin"}));
+    add_predef(predef_append(nodes, fn, LINK_TYPE | LINK_LIST, (StringRef) {4, "acos"}));
+    add_predef(predef_append(nodes, fn, LINK_TYPE | LINK_LIST, (StringRef) {4, "atan"}));
+    add_predef(predef_append(nodes, fn, LINK_TYPE | LINK_LIST, (StringRef) {3, "log"}));
 
     // Float -> Int
-    fn.string = (StringRef) {6, "to_int"};
     fn.field2.node = int_index;
-    dict_add_ref(type_dict, fn.string, (void*) nodevec_append(nodes, fn));
+    add_predef(predef_append(nodes, fn, LINK_TYPE | LINK_LIST, (StringRef) {6, "to_int"}));
 
     // 2-Float -> Float
-    bind_list = vector_create_cap(2); if (!bind_list) exit(EXIT_FAILURE);
-    fn.field1.list = bind_list;
+    binds[1] = binds[0];
+    fn.field1.list = childlist_create(binds, 2);
     fn.field2.node = float_index;
-    vector_append(bind_list, (void*) bind_index);
-    vector_append(bind_list, (void*) bind_index);
-    fn.string = (StringRef) {3, "pow"};
-    dict_add_ref(type_dict, fn.string, (void*) nodevec_append(nodes, fn));
-    fn.string = (StringRef) {5, "atan2"};
-    dict_add_ref(type_dict, fn.string, (void*) nodevec_append(nodes, fn));
+    add_predef(predef_append(nodes, fn, LINK_TYPE | LINK_LIST, (StringRef) {3, "pow"}));
+    add_predef(predef_append(nodes, fn, LINK_TYPE | LINK_LIST, (StringRef) {5, "atan2"}));
 
     // Int -> Float
-    bind_list = vector_create_cap(1); if (!bind_list) exit(EXIT_FAILURE);
     bind.field2.node = int_index;
-    vector_append(bind_list, (void*) nodevec_append(nodes, bind));
-    fn.field1.list = bind_list;
+    binds[0] = predef_append(nodes, bind, LINK_TYPE, (StringRef) {0, NULL});
+    fn.field1.list = childlist_create(binds, 1);
     fn.field2.node = float_index;
-    fn.string = (StringRef) {8, "to_float"};
-    dict_add_ref(type_dict, fn.string, (void*) nodevec_append(nodes, fn));
+    add_predef(predef_append(nodes, fn, LINK_TYPE | LINK_LIST, (StringRef) {8, "to_float"}));
 }
 
-int type_check(TokenVec *tokens, NodeVec *nodes, Vector *cmd_nodes) {
-    if (!tokens || !nodes || !cmd_nodes) return EXIT_FAILURE;
+// Generates the predefined environment once. Must be called before compiling on more than one thread.
+void init_predefs() {
+    if (predef_nodes) return;
+
+    predef_nodes = nodevec_create(); if (!predef_nodes) exit(EXIT_FAILURE);
+    generate_predefs(predef_nodes);
+
+    // Child lists move out of the pool, as a count followed by the items like the pool itself
+    size_t used = 0;
+    for (size_t i = 0; i < predef_nodes->size; ++i) {
+        if (!(predef_links[i] & LINK_LIST)) continue;
+
+        AstNode *node = &predef_nodes->array[i];
+        uint32_t count = childlist_size(node->field1.list);
+        if (used + count + 1 > PREDEF_ITEMS) exit(EXIT_FAILURE);
 
+        predef_items[used] = count;
+        for (uint32_t j = 0; j < count; ++j)
+            predef_items[used + 1 + j] = childlist_get(node->field1.list, j);
+        node->field1.list = used;
+        used += count + 1;
+    }
+
+    predef_types[0] = float_index;
+    predef_types[1] = int_index;
+    predef_types[2] = bool_index;
+    predef_types[3] = void_index;
+    predef_types[4] = rgba_index;
+    predef_types[5] = intarray_index;
+    predef_types[6] = rgba_matrix_index;
+}
+
+// Copies the predefined environment after the nodes already in the vector
+void load_predefs(NodeVec *nodes) {
+    if (!nodes) return;
+    init_predefs();
+
+    predef_base = nodes->size;
+    for (size_t i = 0; i < predef_nodes->size; ++i) {
+        AstNode node = predef_nodes->array[i];
+        if (predef_links[i] & LINK_TYPE)
+            node.field2.node += predef_base;
+
+        if (predef_links[i] & LINK_LIST) {
+            uint32_t *list = predef_items + node.field1.list;
+            uint32_t items[list[0] + 1];
+            for (uint32_t j = 0; j < list[0]; ++j)
+                items[j] = list[1 + j] + predef_base;
+            node.field1.list = childlist_create(items, list[0]);
+        }
+        node.symbol = intern_ref(predef_texts[i]);
+        nodevec_append(nodes, node);
+    }
+
+    float_index = predef_types[0] + predef_base;
+    int_index = predef_types[1] + predef_base;
+    bool_index = predef_types[2] + predef_base;
+    void_index = predef_types[3] + predef_base;
+    rgba_index = predef_types[4] + predef_base;
+    intarray_index = predef_types[5] + predef_base;
+    rgba_matrix_index = predef_types[6] + predef_base;
+}
+
+// Looks up a name in scope, noting that the command being checked depends on it
+static int find_name(uint32_t symbol, uint64_t *output) {
+    u32vec_append(&read_log, symbol);
+    return symtab_find(scopes, symbol, output);
+}
+
+// Brings a name into scope unless it is already there, noting the declaration
+static int declare_name(uint32_t symbol, uint64_t node_index, uint64_t *output) {
+    if (!symtab_declare(scopes, symbol, node_index, output)) return 0;
+    u32vec_append(&decl_log, node_index);
+    return 1;
+}
+
+static int compare_hashes(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+    return (x > y) - (x < y);
+}
+
+// Checks one top-level command and records the names it read and the declarations it left in scope
+static void check_command(uint32_t cmd_index, CheckRecord *record) {
+    read_log.size = 0;
+    decl_log.size = 0;
+    record->cmd = cmd_index;
+    record->failed = !type_check_cmd(cmd_index);
+    if (record->failed) type_exit_status = EXIT_FAILURE;
+
+    size_t reads = 0;
+    if (read_log.size) {
+        qsort(read_log.array, read_log.size, sizeof(uint32_t), compare_hashes);
+        for (size_t i = 0; i < read_log.size; ++i)
+            if (!reads || read_log.array[reads - 1] != read_log.array[i])
+                read_log.array[reads++] = read_log.array[i];
+    }
+
+    // Locals and loop variables have left scope again unless the command failed part way
+    size_t decls = 0;
+    uint64_t output;
+    for (size_t i = 0; i < decl_log.size; ++i) {
+        AstNode *node = nodevec_get(node_list, decl_log.array[i]);
+        if (symtab_find(scopes, node->symbol, &output) && output == decl_log.array[i])
+            decl_log.array[decls++] = decl_log.array[i];
+    }
+
+    record->read_count = reads;
+    record->decl_count = decls;
+    record->items = record_items.size;
+    for (size_t i = 0; i < reads; ++i)
+        u32vec_append(&record_items, read_log.array[i]);
+    for (size_t i = 0; i < decls; ++i)
+        u32vec_append(&record_items, decl_log.array[i]);
+    for (size_t i = 0; i < decls; ++i)
+        u32vec_append(&record_items, nodevec_get(node_list, decl_log.array[i])->symbol);
+}
+
+static void free_records() {
+    for (size_t i = 0; i < record_count; ++i)
+        if (check_records[i].cmd < slot_capacity)
+            record_slots[check_records[i].cmd] = 0;
+    free(check_records);
+    check_records = NULL;
+    record_count = 0;
+    record_items.size = 0;
+}
+
+// Points every command node at its record, growing the slots to cover the largest command node
+static void index_records() {
+    size_t needed = 0;
+    for (size_t i = 0; i < record_count; ++i)
+        if (check_records[i].cmd >= needed) needed = check_records[i].cmd + 1;
+
+    if (slot_capacity < needed) {
+        uint32_t *temp = realloc(record_slots, sizeof(uint32_t) * needed);
+        if (!temp) exit(EXIT_FAILURE);
+        memset(temp + slot_capacity, 0, sizeof(uint32_t) * (needed - slot_capacity));
+        record_slots = temp;
+        slot_capacity = needed;
+    }
+    for (size_t i = 0; i < record_count; ++i)
+        record_slots[check_records[i].cmd] = i + 1;
+}
+
+static int test_dirty(uint32_t symbol) {
+    return symbol / 8 < dirty_size && dirty_names[symbol / 8] & (1 << (symbol % 8));
+}
+
+// Marks the symbols a record declares. Re-checked commands can intern new names, so the bits grow to cover them.
+static void mark_dirty(CheckRecord *record) {
+    size_t needed = symbol_count() / 8 + 1;
+    if (dirty_size < needed) {
+        uint8_t *temp = realloc(dirty_names, needed);
+        if (!temp) exit(EXIT_FAILURE);
+        memset(temp + dirty_size, 0, needed - dirty_size);
+        dirty_names = temp;
+        dirty_size = needed;
+    }
+
+    uint32_t *symbols = record_items.array + record->items + record->read_count + record->decl_count;
+    for (size_t i = 0; i < record->decl_count; ++i)
+        if (symbols[i] != NUMBER_SYMBOL) dirty_names[symbols[i] / 8] |= 1 << (symbols[i] % 8);
+}
+
+static int is_dirty(CheckRecord *record) {
+    if (record->failed) return 1;
+
+    uint32_t *items = record_items.array + record->items;
+    for (size_t i = 0; i < record->read_count; ++i)
+        if (test_dirty(items[i])) return 1;
+    uint32_t *symbols = items + record->read_count + record->decl_count;
+    for (size_t i = 0; i < record->decl_count; ++i)
+        if (test_dirty(symbols[i])) return 1;
+    return 0;
+}
+
+static int begin_check(TokenVec *tokens, NodeVec *nodes) {
     token_list = tokens;
     node_list = nodes;
-    type_dict = dict_create_big(); if (!type_dict) return EXIT_FAILURE;
+    type_exit_status = EXIT_SUCCESS;
+    dict_free(declarations);
+    declarations = NULL;
+    symtab_free(scopes);
+    scopes = symtab_create(); if (!scopes) return 0;
+    return 1;
+}
+
+static void declare_predefs() {
+    uint32_t index;
+    for (size_t i = 0; i < predef_count; ++i) {
+        index = predef_indices[i] + predef_base;
+        symtab_bind(scopes, nodevec_get(node_list, index)->symbol, index);
+    }
+}
+
+int type_check(TokenVec *tokens, NodeVec *nodes, Vector *cmd_nodes) {
+    if (!tokens || !nodes || !cmd_nodes) return EXIT_FAILURE;
+    if (!begin_check(tokens, nodes)) return EXIT_FAILURE;
+
+    load_predefs(nodes);
+    declare_predefs();
+
+    free_records();
+    check_records = calloc(cmd_nodes->size + 1, sizeof(CheckRecord));
+    if (!check_records) exit(EXIT_FAILURE);
+    record_count = cmd_nodes->size;
+    for (size_t i = 0; i < cmd_nodes->size; ++i)
+        check_command((uint64_t) vector_get(cmd_nodes, i), &check_records[i]);
+
+    index_records();
+    return type_exit_status;
+}
+
+// Checks a program again after some of its commands were replaced by newly parsed nodes. Commands whose
+// nodes were kept reuse the types of the last check and only bring their declarations back into scope,
+// unless they failed or use or redeclare a name whose declaration changed, which is checked again.
+int type_check_update(TokenVec *tokens, NodeVec *nodes, Vector *cmd_nodes) {
+    if (!tokens || !nodes || !cmd_nodes) return EXIT_FAILURE;
+    if (!check_records || !scopes) return type_check(tokens, nodes, cmd_nodes);
+    if (!begin_check(tokens, nodes)) return EXIT_FAILURE;
+
+    declare_predefs();
+    if (dirty_names) memset(dirty_names, 0, dirty_size);
 
-    generate_predefs(nodes);
+    CheckRecord *records = calloc(cmd_nodes->size + 1, sizeof(CheckRecord));
+    uint8_t *kept = calloc(record_count + 1, 1);
+    if (!records || !kept) exit(EXIT_FAILURE);
 
+    uint32_t cmd_index, slot;
     for (size_t i = 0; i < cmd_nodes->size; ++i) {
-        if (!type_check_cmd((uint64_t) vector_get(cmd_nodes, i)))
-            type_exit_status = EXIT_FAILURE;
+        cmd_index = (uint64_t) vector_get(cmd_nodes, i);
+        slot = cmd_index < slot_capacity ? record_slots[cmd_index] : 0;
+        if (slot && !kept[slot - 1]) {
+            records[i] = check_records[slot - 1];
+            kept[slot - 1] = 1;
+        } else {
+            records[i] = (CheckRecord) {cmd_index, 1, 0, 0, 0};
+        }
     }
 
+    // Declarations of removed commands change meaning for anything that used them
+    for (size_t i = 0; i < record_count; ++i)
+        if (!kept[i]) mark_dirty(&check_records[i]);
+    free(kept);
+
+    // Kept items move to a fresh pool, so that the items of replaced and re-checked commands do not pile up
+    U32Vec old_items = record_items;
+    record_items = (U32Vec) {0};
+    for (size_t i = 0; i < cmd_nodes->size; ++i) {
+        size_t count = records[i].read_count + records[i].decl_count * 2;
+        uint32_t first = record_items.size;
+        for (size_t j = 0; j < count; ++j)
+            u32vec_append(&record_items, old_items.array[records[i].items + j]);
+        records[i].items = first;
+    }
+    u32vec_release(&old_items);
+    for (size_t i = 0; i < record_count; ++i)
+        if (check_records[i].cmd < slot_capacity) record_slots[check_records[i].cmd] = 0;
+    free(check_records);
+    check_records = records;
+    record_count = cmd_nodes->size;
+
+    CheckRecord *record;
+    AstNode *node;
+    for (size_t i = 0; i < record_count; ++i) {
+        record = &check_records[i];
+        if (!is_dirty(record)) {
+            for (size_t j = 0; j < record->decl_count; ++j) {
+                uint64_t decl_index = record_items.array[record->items + record->read_count + j];
+                node = nodevec_get(node_list, decl_index);
+                symtab_bind(scopes, node->symbol, decl_index);
+            }
+            continue;
+        }
+
+        mark_dirty(record);
+        check_command(record->cmd, record);
+        mark_dirty(record);
+    }
+
+    index_records();
     return type_exit_status;
 }
 
+void type_check_cleanup() {
+    symtab_free(scopes);
+    scopes = NULL;
+    symtab_free(member_names);
+    member_names = NULL;
+    dict_free(declarations);
+    declarations = NULL;
+    free(dirty_names);
+    dirty_names = NULL;
+    dirty_size = 0;
+    free_records();
+    free(record_slots);
+    record_slots = NULL;
+    slot_capacity = 0;
+    u32vec_release(&read_log);
+    u32vec_release(&decl_log);
+    u32vec_release(&record_items);
+}
+
+// The global declarations of the last type_check, for saving a checked program
+Dict *get_declarations() {
+    if (!declarations) declarations = symtab_export(scopes);
+    return declarations;
+}
+
+// Installs the declarations of a saved program in place of a type_check
+void set_declarations(Dict *saved) {
+    free_records();
+    symtab_free(scopes);
+    scopes = symtab_create(); if (!scopes) exit(EXIT_FAILURE);
+    dict_free(declarations);
+    declarations = saved;
+
+    size_t cursor = 0;
+    StringRef name;
+    void *value;
+    while (dict_next(saved, &cursor, &name, &value))
+        symtab_bind(scopes, intern_ref(name), (uint64_t) value);
+}
+
+// Finds the node declaring the given global symbol. Returns 1 on success.
+int lookup_declaration(uint32_t symbol, uint64_t *output) {
+    return symtab_find(scopes, symbol, output);
+}
+
 int type_check_cmd(uint32_t cmd_index) {
     AstNode *cmd = nodevec_get(node_list, cmd_index);
     if (!cmd) return 0;
@@ -170,8 +508,8 @@ int type_check_read_cmd(uint32_t cmd_index) {
 
     AstNode *lvalue = nodevec_get(node_list, lvalue_index);
 
-    if (lvalue->field1.list != NULL && lvalue->field1.list->size != 2) {
-        type_error(BAD_RANK, lvalue->token_index, 0);
+    if (lvalue->field1.list && childlist_size(lvalue->field1.list) != 2) {
+        type_error(BAD_RANK, lvalue_index, 0);
         return 0;
     }
 
@@ -211,13 +549,13 @@ int type_check_let_cmd(uint32_t cmd_index) {
     AstNode *lvalue = nodevec_get(node_list, lvalue_index);
 
     if (lvalue->type.lvalue == ARRAY_LVALUE) {
-        if (lvalue->field1.list->size == 0) {
-            type_error(EMPTY_ARRAY, lvalue->token_index, 0);
+        if (childlist_size(lvalue->field1.list) == 0) {
+            type_error(EMPTY_ARRAY, lvalue_index, 0);
             return 0;
         }
         AstNode *expr_type = nodevec_get(node_list, expr->field4.node);
         if (!expr_type) return 0;
-        if (lvalue->field1.list->size != expr_type->field1.int_value) {
+        if (childlist_size(lvalue->field1.list) != expr_type->field1.int_value) {
             type_error(BAD_DIMENSION, cmd->field1.node, cmd->field3.node);
             return 0;
         }
@@ -230,22 +568,23 @@ int type_check_let_cmd(uint32_t cmd_index) {
 int type_check_fn_cmd(uint32_t cmd_index) {
     AstNode *cmd = nodevec_get(node_list, cmd_index);
     if (!cmd) return 0;
-    Vector *bind_list = cmd->field1.list; if (!bind_list) return 0;
+    ChildList bind_list = cmd->field1.list; if (!bind_list) return 0;
     uint32_t type_index = cmd->field2.node;
-    Vector *stmt_list = cmd->field3.list; if (!stmt_list) return 0;
+    ChildList stmt_list = cmd->field3.list; if (!stmt_list) return 0;
 
     uint64_t output;
-    if (!dict_add_ref_if_empty(type_dict, cmd->string, (void*) (uint64_t) cmd_index, (void**) &output)) {
+    if (!declare_name(cmd->symbol, cmd_index, &output)) {
         type_error(SHADOWED_VARIABLE, cmd_index, output);
         return 0;
     }
 
-    // Add binds to scope
+    // Add binds to scope. The scope stays open if the function fails, as a failed command leaves its names.
+    size_t scope = symtab_mark(scopes);
     uint32_t bind_index;
     uint32_t lvalue_index, bind_type_index;
     AstNode *bind, *lvalue;
-    for (size_t i = 0; i < bind_list->size; ++i) {
-        bind_index = (uint64_t) vector_get(bind_list, i);
+    for (size_t i = 0; i < childlist_size(bind_list); ++i) {
+        bind_index = childlist_get(bind_list, i);
         bind = nodevec_get(node_list, bind_index);
         if (!bind) return 0;
         lvalue_index = bind->field1.node;
@@ -262,10 +601,11 @@ int type_check_fn_cmd(uint32_t cmd_index) {
     int valid_return = compare_types(void_index, type_index);
     AstNode *stmt;
     uint32_t stmt_index;
-    for (size_t i = 0; i < stmt_list->size; ++i) {
-        stmt_index = (uint64_t) vector_get(stmt_list, i);
+    for (size_t i = 0; i < childlist_size(stmt_list); ++i) {
+        stmt_index = childlist_get(stmt_list, i);
         if (!type_check_statement(stmt_index)) return 0;
         stmt = nodevec_get(node_list, stmt_index);
+        cmd = nodevec_get(node_list, cmd_index);
 
         if (stmt->type.stmt == RETURN_STMT) {
             if (!compare_types(type_index, stmt->field2.node)) {
@@ -282,20 +622,7 @@ int type_check_fn_cmd(uint32_t cmd_index) {
         return 0;
     }
 
-    // Free local variables
-    for (size_t i = 0; i < bind_list->size; ++i) {
-        bind_index = (uint64_t) vector_get(bind_list, i);
-        bind = nodevec_get(node_list, bind_index);
-        remove_lvalue(bind->field1.node);
-    }
-    for (size_t i = 0; i < stmt_list->size; ++i) {
-        stmt_index = (uint64_t) vector_get(stmt_list, i);
-        stmt = nodevec_get(node_list, stmt_index);
-        if (stmt->type.stmt == LET_STMT) {
-            remove_lvalue(stmt->field1.node);
-        }
-    }
-
+    symtab_leave(scopes, scope);
     return 1;
 }
 
@@ -303,17 +630,18 @@ int type_check_struct_cmd(uint32_t cmd_index) {
     AstNode *cmd = nodevec_get(node_list, cmd_index);
     if (!cmd) return 0;
 
-    Vector *member_list = cmd->field1.list; if (!member_list) return 0;
+    ChildList member_list = cmd->field1.list; if (!member_list) return 0;
 
-    Dict *struct_dict = dict_create_small();
-    if (!struct_dict) exit(EXIT_FAILURE);
+    // Members are declared in a table of their own, emptied again whichever way the check ends
+    if (!member_names) member_names = symtab_create();
+    if (!member_names) exit(EXIT_FAILURE);
 
     uint32_t member_index;
     AstNode *member;
     AstNode *type;
     uint64_t output;
-    for (size_t i = 0; i < member_list->size; ++i) {
-        member_index = (uint64_t) vector_get(member_list, i);
+    for (size_t i = 0; i < childlist_size(member_list); ++i) {
+        member_index = childlist_get(member_list, i);
         member = nodevec_get(node_list, member_index);
         if (!member) goto free;
 
@@ -326,31 +654,31 @@ int type_check_struct_cmd(uint32_t cmd_index) {
         }
 
         if (type->type.type == STRUCT_TYPE) {
-            if (!dict_try_ref(type_dict, type->string, (void**) &output)) {
+            if (!find_name(type->symbol, &output)) {
                 type_error(UNDECLARED_VARIABLE, member->field2.node, 0);
                 goto free;
             }
 
-            AstNode *sub_cmd = nodevec_get(node_list, output); if (!cmd) return 0;
+            AstNode *sub_cmd = nodevec_get(node_list, output); if (!sub_cmd) goto free;
             *type = *nodevec_get(node_list, sub_cmd->field2.node);
         }
 
-        if (!dict_add_ref_if_empty(struct_dict, member->string, (void*) (uint64_t) member_index, (void**) &output)) {
+        if (!symtab_declare(member_names, member->symbol, member_index, &output)) {
             type_error(SHADOWED_VARIABLE, member_index, output);
             goto free;
         }
     }
 
-    if (!dict_add_ref_if_empty(type_dict, cmd->string, (void*) (uint64_t) cmd_index, (void**) &output)) {
+    if (!declare_name(cmd->symbol, cmd_index, &output)) {
         type_error(SHADOWED_VARIABLE, cmd_index, output);
         goto free;
     }
 
-    dict_free(struct_dict);
+    symtab_leave(member_names, 0);
     return 1;
 
 free:
-    dict_free(struct_dict);
+    symtab_leave(member_names, 0);
     return 0;
 }
 
@@ -367,6 +695,7 @@ int type_check_statement(uint32_t stmt_index) {
             break;
         case RETURN_STMT:
             if (!type_check_expr(stmt->field1.node)) return 0;
+            stmt = nodevec_get(node_list, stmt_index);
             stmt->field2.node = nodevec_get(node_list, stmt->field1.node)->field4.node;
             break;
     }
@@ -379,23 +708,23 @@ int type_check_lvalue(uint32_t lvalue_index) {
     if (!lvalue) return 0;
 
     uint64_t output;
-    if (!dict_add_ref_if_empty(type_dict, lvalue->string, (void*) (uint64_t) lvalue_index, (void**) &output)) {
+    if (!declare_name(lvalue->symbol, lvalue_index, &output)) {
         type_error(SHADOWED_VARIABLE, lvalue_index, output);
         return 0;
     }
 
     if (lvalue->type.lvalue == ARRAY_LVALUE) {
-        Vector *list = lvalue->field1.list; 
+        ChildList list = lvalue->field1.list; 
         if (!list) return 0;
 
         AstNode *member;
         uint32_t member_index;
-        for (size_t i = 0; i < list->size; ++i) {
-            member_index = (uint64_t) vector_get(list, i);
+        for (size_t i = 0; i < childlist_size(list); ++i) {
+            member_index = childlist_get(list, i);
             member = nodevec_get(node_list, member_index);
             if (!member) return 0;
 
-            if (!dict_add_ref_if_empty(type_dict, member->string, (void*) (uint64_t) member_index, (void**) &output)) {
+            if (!declare_name(member->symbol, member_index, &output)) {
                 type_error(SHADOWED_VARIABLE, member_index, output);
                 return 0;
             }
@@ -447,7 +776,7 @@ int type_check_var_expr(uint32_t expr_index) {
     AstNode *expr = nodevec_get(node_list, expr_index);
     if (!expr) return 0;
     uint64_t output;
-    if (!dict_try_ref(type_dict, expr->string, (void**) &output)) {
+    if (!find_name(expr->symbol, &output)) {
         type_error(UNDECLARED_VARIABLE, expr_index, 0);
         return 0;
     }
@@ -469,22 +798,22 @@ int type_check_arraylit_expr(uint32_t expr_index) {
 
     uint32_t type_index = expr->field4.node;
 
-    Vector *expr_list = expr->field1.list;
+    ChildList expr_list = expr->field1.list;
     if (!expr_list) return 0;
-    if (!expr_list->size) {
+    if (!childlist_size(expr_list)) {
         type_error(EMPTY_ARRAY, expr_index, 0);
         return 0;
     }
 
-    uint32_t zero_index = (uint64_t) vector_get(expr_list, 0);
+    uint32_t zero_index = childlist_get(expr_list, 0);
     if (!type_check_expr(zero_index)) return 0;
 
     AstNode *array_type = nodevec_get(node_list, type_index);
     array_type->field2.node = nodevec_get(node_list, zero_index)->field4.node;
 
     uint32_t sub_index;
-    for (size_t i = 1; i < expr_list->size; ++i) {
-        sub_index = (uint64_t) vector_get(expr_list, i);
+    for (size_t i = 1; i < childlist_size(expr_list); ++i) {
+        sub_index = childlist_get(expr_list, i);
         if (!type_check_expr(sub_index)) return 0;
 
         if (!compare_expr_types(zero_index, sub_index)) {
@@ -501,29 +830,29 @@ int type_check_structlit_expr(uint32_t expr_index) {
     if (!expr) return 0;
 
     uint64_t output;
-    if (!dict_try_ref(type_dict, expr->string, (void**) &output)) {
+    if (!find_name(expr->symbol, &output)) {
         type_error(UNDECLARED_VARIABLE, expr_index, 0);
         return 0;
     }
     AstNode *cmd = nodevec_get(node_list, output); if (!cmd) return 0;
     if (!expect_type(STRUCT_TYPE, cmd->field2.node)) return 0;
 
-    Vector *list1 = cmd->field1.list;
-    Vector *list2 = expr->field1.list;
+    ChildList list1 = cmd->field1.list;
+    ChildList list2 = expr->field1.list;
     if (!list1 || !list2) return 0;
-    if (list1->size != list2->size) {
+    if (childlist_size(list1) != childlist_size(list2)) {
         type_error(MISMATCHED_MEMBERS, expr_index, output);
         return 0;
     }
 
     AstNode *sub_expr;
     uint32_t sub_expr_index;
-    for (size_t i = 0; i < list1->size; ++i) {
-        sub_expr_index = (uint64_t) vector_get(list2, i);
-        sub_expr = nodevec_get(node_list, sub_expr_index);
+    for (size_t i = 0; i < childlist_size(list1); ++i) {
+        sub_expr_index = childlist_get(list2, i);
         if (!type_check_expr(sub_expr_index)) return 0;
+        sub_expr = nodevec_get(node_list, sub_expr_index);
 
-        AstNode *member = nodevec_get(node_list, (uint64_t) vector_get(list1, i));
+        AstNode *member = nodevec_get(node_list, childlist_get(list1, i));
         if (!member) return 0;
         if (!compare_types(member->field2.node, sub_expr->field4.node)) {
             type_error(MISMATCHED_MEMBERS, member->field2.node, sub_expr->field4.node);
@@ -539,10 +868,11 @@ int type_check_dot_expr(uint32_t expr_index) {
     AstNode *expr = nodevec_get(node_list, expr_index);
     if (!expr) return 0;
 
-    StringRef expr_string = expr->string;
+    uint32_t symbol = expr->symbol;
     uint32_t sub_expr_index = expr->field1.node;
     if (!type_check_expr(sub_expr_index)) return 0;
 
+    expr = nodevec_get(node_list, expr_index);
     AstNode *sub_expr = nodevec_get(node_list, sub_expr_index);
     if (!sub_expr) return 0;
 
@@ -555,29 +885,28 @@ int type_check_dot_expr(uint32_t expr_index) {
     if (!subtype) return 0;
 
     uint64_t output;
-    if (!dict_try_ref(type_dict, subtype->string, (void**) &output)) {
-        type_error(UNDECLARED_VARIABLE, subtype->token_index, 0);
+    if (!find_name(subtype->symbol, &output)) {
+        type_error(UNDECLARED_VARIABLE, sub_expr->field4.node, 0);
         return 0;
     }
 
     AstNode *cmd = nodevec_get(node_list, output);
     if (!cmd) return 0;
-    Vector *member_list = cmd->field1.list;
+    ChildList member_list = cmd->field1.list;
     if (!member_list) return 0;
 
     AstNode *member;
-    for (size_t i = 0; i < member_list->size; ++i) {
-        member = nodevec_get(node_list, (uint64_t) vector_get(member_list, i));
+    for (size_t i = 0; i < childlist_size(member_list); ++i) {
+        member = nodevec_get(node_list, childlist_get(member_list, i));
         if (!member) return 0;
 
-        if (member->string.length != expr_string.length) continue;
-        if (strncmp(member->string.string, expr_string.string, expr_string.length)) continue;
+        if (member->symbol != symbol) continue;
 
         expr->field4.node = member->field2.node;
         return 1;
     }
     
-    type_error(BAD_MEMBER, expr_index, cmd->token_index);
+    type_error(BAD_MEMBER, expr_index, cmd->field2.node);
     return 0;
 }
 
@@ -586,9 +915,9 @@ int type_check_arrayindex_expr(uint32_t expr_index) {
     if (!expr) return 0;
 
     uint32_t expr1_index = expr->field1.node;
-    Vector *expr_list = expr->field2.list;
+    ChildList expr_list = expr->field2.list;
     if (!expr_list) return 0;
-    if (!expr_list->size) {
+    if (!childlist_size(expr_list)) {
         type_error(NO_INDEX, expr_index, 0);
         return 0;
     }
@@ -597,18 +926,20 @@ int type_check_arrayindex_expr(uint32_t expr_index) {
     if (!expect_expr_type(ARRAY_TYPE, expr1_index))
         return 0;
 
+    expr = nodevec_get(node_list, expr_index);
+
     AstNode *sub_expr = nodevec_get(node_list, expr1_index);
     uint32_t sub_expr_type_index = sub_expr->field4.node;
     AstNode *sub_type = nodevec_get(node_list, sub_expr_type_index);
 
-    if (expr_list->size != sub_type->field1.int_value) {
+    if (childlist_size(expr_list) != sub_type->field1.int_value) {
         type_error(BAD_DIMENSION, expr_index, expr->field1.node);
         return 0;
     }
 
     uint32_t index;
-    for (size_t i = 0; i < expr_list->size; ++i) {
-        index = (uint64_t) vector_get(expr_list, i);
+    for (size_t i = 0; i < childlist_size(expr_list); ++i) {
+        index = childlist_get(expr_list, i);
         if (!type_check_expr(index))
             return 0;
         if (!expect_expr_type(INT_TYPE, index)) {
@@ -627,7 +958,7 @@ int type_check_call_expr(uint32_t expr_index) {
     if (!expr) return 0;
 
     uint64_t output;
-    if (!dict_try_ref(type_dict, expr->string, (void**) &output)) {
+    if (!find_name(expr->symbol, &output)) {
         type_error(UNDECLARED_VARIABLE, expr_index, 0);
         return 0;
     }
@@ -639,9 +970,9 @@ int type_check_call_expr(uint32_t expr_index) {
         return 0;
     }
 
-    Vector *bind_list = cmd->field1.list; if (!bind_list) return 0;
-    Vector *expr_list = expr->field1.list; if (!expr_list) return 0;
-    if (bind_list->size != expr_list->size) {
+    ChildList bind_list = cmd->field1.list; if (!bind_list) return 0;
+    ChildList expr_list = expr->field1.list; if (!expr_list) return 0;
+    if (childlist_size(bind_list) != childlist_size(expr_list)) {
         type_error(MISMATCHED_MEMBERS, expr_index, output);
         return 0;
     }
@@ -649,11 +980,11 @@ int type_check_call_expr(uint32_t expr_index) {
     uint32_t sub_index;
     AstNode *bind, *type;
     uint32_t bind_index;
-    for (size_t i = 0; i < expr_list->size; ++i) {
-        sub_index = (uint64_t) vector_get(expr_list, i);
+    for (size_t i = 0; i < childlist_size(expr_list); ++i) {
+        sub_index = childlist_get(expr_list, i);
         if (!type_check_expr(sub_index)) return 0;
 
-        bind_index = (uint64_t) vector_get(bind_list, i);
+        bind_index = childlist_get(bind_list, i);
         bind = nodevec_get(node_list, bind_index);
         if (!bind) return 0;
         type = nodevec_get(node_list, bind->field2.node);
@@ -673,12 +1004,13 @@ int type_check_unop_expr(uint32_t expr_index) {
     AstNode *expr = nodevec_get(node_list, expr_index);
     if (!expr) return 0;
 
-    StringRef expr_string = expr->string;
+    StringRef expr_string = symbol_name(expr->symbol);
     uint32_t sub_expr_index = expr->field1.node;
 
     if (!type_check_expr(expr->field1.node))
         return 0;
 
+    expr = nodevec_get(node_list, expr_index);
     AstNode *sub_expr = nodevec_get(node_list, sub_expr_index);
 
     AstNode *type = nodevec_get(node_list, sub_expr->field4.node);
@@ -715,6 +1047,7 @@ int type_check_binop_expr(uint32_t expr_index) {
 
     if (!type_check_expr(expr1_index) || !type_check_expr(expr2_index)) return 0;
 
+    expr = nodevec_get(node_list, expr_index);
     if (!compare_expr_types(expr1_index, expr2_index)) {
         type_error(MISMATCHED_BINOP, expr2_index, expr1_index);
         return 0;
@@ -724,7 +1057,7 @@ int type_check_binop_expr(uint32_t expr_index) {
     if (!expr1) return 0;
 
     AstNode *type1 = nodevec_get(node_list, expr1->field4.node);
-    switch (expr->string.string[0]) {
+    switch (symbol_name(expr->symbol).string[0]) {
         case '=':
         case '!':
             if (type1->type.type != INT_TYPE && type1->type.type != FLOAT_TYPE && type1->type.type != BOOL_TYPE) {
@@ -776,26 +1109,23 @@ int type_check_loop_expr(uint32_t expr_index) {
     AstNode *expr = nodevec_get(node_list, expr_index);
     if (!expr) return 0;
 
-    Vector *var_list = expr->field1.list;
-    Vector *expr_list = expr->field2.list;
+    ChildList var_list = expr->field1.list;
+    ChildList expr_list = expr->field2.list;
     uint32_t sub_expr_index = expr->field3.node;
     uint32_t type_index = expr->field4.node;
     ExpressionType exprtype = expr->type.expr;
 
-    if (var_list->size == 0 || expr_list->size == 0) {
+    if (childlist_size(var_list) == 0 || childlist_size(expr_list) == 0) {
         type_error(EMPTY_ARRAY, expr_index, 0);
         return 0;
     }
 
-    Token *token;
     uint32_t sub_index;
-    uint32_t token_index;
-    AstNode temp_cmd;
-    StringRef string;
+    uint32_t var_index;
+    AstNode *var;
     uint64_t output;
-    uint64_t member_index;
-    for (size_t i = 0; i < expr_list->size; ++i) {
-        sub_index = (uint64_t) vector_get(expr_list, i);
+    for (size_t i = 0; i < childlist_size(expr_list); ++i) {
+        sub_index = childlist_get(expr_list, i);
         if (!type_check_expr(sub_index)) return 0;
 
         if (!expect_expr_type(INT_TYPE, sub_index)) {
@@ -803,24 +1133,24 @@ int type_check_loop_expr(uint32_t expr_index) {
             return 0;
         }
     }
-    for (size_t i = 0; i < var_list->size; ++i) {
-        token_index = (uint64_t) vector_get(var_list, i);
-        if (!token_index) return 0;
-        token = tokenvec_get(token_list, token_index);
-        if (!token) return 0;
-        string = token->strref;
 
-        temp_cmd = (AstNode) {token_index, {.cmd=LET_CMD}, {0}, {int_index}, {0}, {0}, string};
-
-        member_index = nodevec_append(node_list, temp_cmd);
-        if (!dict_add_ref_if_empty(type_dict, string, (void*) member_index, (void**) &output)) {
-            type_error(SHADOWED_VARIABLE, member_index, output);
+    // Loop variables are nodes of the loop itself, like the dimensions of an array lvalue, so checking the loop
+    // again binds the same nodes
+    size_t scope = symtab_mark(scopes);
+    for (size_t i = 0; i < childlist_size(var_list); ++i) {
+        var_index = childlist_get(var_list, i);
+        var = nodevec_get(node_list, var_index);
+        if (!var) return 0;
+
+        var->field2.node = int_index;
+        if (!declare_name(var->symbol, var_index, &output)) {
+            type_error(SHADOWED_VARIABLE, var_index, output);
             return 0;
         }
     }
 
     if (!type_check_expr(sub_expr_index)) return 0;
-    if (nodevec_get(node_list, type_index)->type.type == ARRAY_TYPE)
+    if (exprtype == ARRAYLOOP_EXPR)
         nodevec_get(node_list, type_index)->field2.node = nodevec_get(node_list, sub_expr_index)->field4.node;
     else
         nodevec_get(node_list, expr_index)->field4.node = nodevec_get(node_list, sub_expr_index)->field4.node;
@@ -834,12 +1164,7 @@ int type_check_loop_expr(uint32_t expr_index) {
         }
     }
 
-    for (size_t i = 0; i < var_list->size; ++i) {
-        token_index = (uint64_t) vector_get(var_list, i);
-        string = tokenvec_get(token_list, token_index)->strref;
-        dict_remove_ref(type_dict, string);
-    }
-
+    symtab_leave(scopes, scope);
     return 1;
 }
 
@@ -876,12 +1201,10 @@ int expect_type(TypeType expected_type, uint32_t type_index) {
     if (!type) return 0;
     
     if (type->type.type != expected_type) {
-        AstNode *new_token = malloc(sizeof(AstNode)); if (!new_token) exit(EXIT_FAILURE);
-        *new_token = (AstNode) {0, {.type=expected_type}, {0}, {0}, {0}, {0}, {strlen(type_names[expected_type]), type_names[expected_type]} };
+        StringRef name = { strlen(type_names[expected_type]), type_names[expected_type] };
+        AstNode expected = (AstNode) {0, {.type=expected_type}, {0}, {0}, {0}, {0}, intern_ref(name)};
 
-        add_type_error(UNEXPECTED_TYPE, type, new_token);
-        
-        free(new_token);
+        add_type_error(UNEXPECTED_TYPE, type, &expected);
         return 0;
     }
 
@@ -894,18 +1217,3 @@ void type_error(TypeErrorType type, uint32_t error_index, uint32_t ref_index) {
         
     type_exit_status = EXIT_FAILURE;
 }
-
-void remove_lvalue(uint32_t lvalue_index) {
-    AstNode *lvalue = nodevec_get(node_list, lvalue_index);
-    if (!lvalue) return;
-
-    dict_remove_ref(type_dict, lvalue->string);
-    if (lvalue->type.lvalue == ARRAY_LVALUE) {
-        Vector *list = lvalue->field1.list;
-        AstNode *member;
-        for (size_t i = 0; i < list->size; ++i) {
-            member = nodevec_get(node_list, (uint64_t) vector_get(list, i));
-            dict_remove_ref(type_dict, member->string);
-        }
-    }
-}
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "document.h"
+
+// Every edit of a session must report what compiling its result from scratch reports
+typedef struct { size_t offset; size_t removed; char *text; } Edit;
+typedef struct { char *source; size_t edit_count; Edit edits[4]; } Session;
+
+static Session sessions[] = {
+    {"struct P {\n a : int\n}\nlet p = P{1}\nshow p.a\n", 3, {{11, 3, ""}, {7, 2, ""}, {19, 4, ""}}},
+    {"show 1\n", 3, {{7, 0, "struct P {\n"}, {4, 2, ""}, {5, 2, "x"}}},
+    {"show 1\n", 3, {{0, 0, "struct P {\n a : int\n}\nlet p = P{1}\n"}, {11, 0, "b : int\n"}, {22, 3, ""}}},
+    {"let a = [1, 2]\nstruct Q {\n b : float\n c : int\n}\nshow Q{1.0, 2}\n", 3, {{26, 3, "\n"}, {4, 5, ""}, {30, 6, ""}}},
+    {"let a = [1, 2]\nstruct Q {\n b : float\n c : int\n}\nshow Q{1.0, 2}\n", 3, {{0, 6, "["}, {21, 2, ""}, {53, 3, "\\\n"}}},
+    {"let x = 1\nshow x + 2\nshow 3\n", 4, {{8, 1, "10"}, {0, 0, "show 4\n"}, {17, 0, "\n"}, {28, 1, "2.5"}}},
+    {"fn f(x : int) : int {\n return x\n}\nshow f(2)\n", 3, {{22, 0, " let y = 1\n"}, {50, 4, "f(y)"}, {0, 3, "let"}}},
+};
+
+// Opens 'source' as the thread's document, or makes 'edit' to it, and returns what it printed
+static char *capture(Document *doc, char *source, Edit *edit) {
+    char *text;
+    size_t size;
+    FILE *stream = open_memstream(&text, &size);
+    if (!stream) exit(EXIT_FAILURE);
+    set_output(stream);
+    int status = edit ? document_edit(doc, edit->offset, edit->removed, edit->text, strlen(edit->text))
+                      : document_open(doc, "test.jpl", source, strlen(source));
+    fprintf(stream, "%s\n", status == EXIT_SUCCESS ? "Compilation succeeded" : "Compilation failed");
+    set_output(NULL);
+    fclose(stream);
+    return text;
+}
+
+// Checks edit 'last' of a session against a fresh compile of the source it leaves
+static int check_edit(Session *session, size_t last) {
+    Document doc;
+    size_t size = strlen(session->source);
+    for (size_t i = 0; i <= last; ++i) size += strlen(session->edits[i].text);
+    char *source = malloc(size + 1);
+    if (!source) exit(EXIT_FAILURE);
+    strcpy(source, session->source);
+
+    free(capture(&doc, source, NULL));
+    for (size_t i = 0; i < last; ++i) free(capture(&doc, NULL, &session->edits[i]));
+    char *edited = capture(&doc, NULL, &session->edits[last]);
+    document_close(&doc);
+
+    for (size_t i = 0; i <= last; ++i) {
+        Edit *edit = &session->edits[i];
+        size_t length = strlen(source);
+        memmove(source + edit->offset + strlen(edit->text), source + edit->offset + edit->removed,
+                length - edit->offset - edit->removed + 1);
+        memcpy(source + edit->offset, edit->text, strlen(edit->text));
+    }
+    char *fresh = capture(&doc, source, NULL);
+    document_close(&doc);
+
+    int same = !strcmp(edited, fresh);
+    if (!same)
+        printf("Session %zu, edit %zu:\n--- edited\n%s--- compiled\n%s\n", session - sessions, last, edited, fresh);
+    free(edited);
+    free(fresh);
+    free(source);
+    return same;
+}
+
+int main() {
+    size_t failed = 0, count = 0;
+    for (size_t i = 0; i < sizeof(sessions) / sizeof(Session); ++i)
+        for (size_t j = 0; j < sessions[i].edit_count; ++j, ++count)
+            failed += !check_edit(&sessions[i], j);
+
+    printf("document: %zu of %zu edits match a fresh compile\n", count - failed, count);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "document.h"
+
+// Each message must be printed 'count' times for the source
+typedef struct { char *source; char *message; size_t count; } Expected;
+
+static Expected expected[] = {
+    {"let b = [\nshow c\n", "Expected type 'RSQUARE', found: 'show'", 1},
+    {"let b = [\nshow c\n", "Expected type 'NEWLINE', found: 'c'", 1},
+    {"show (((\n", "Unclosed parenthetical.", 3},
+};
+
+static size_t count_matches(char *text, char *message) {
+    size_t count = 0;
+    for (char *match = text; (match = strstr(match, message)); match += strlen(message))
+        ++count;
+    return count;
+}
+
+int main() {
+    size_t failed = 0, total = sizeof(expected) / sizeof(Expected);
+    for (size_t i = 0; i < total; ++i) {
+        char *text;
+        size_t size;
+        FILE *stream = open_memstream(&text, &size);
+        if (!stream) exit(EXIT_FAILURE);
+        set_output(stream);
+        Document doc;
+        document_open(&doc, "test.jpl", expected[i].source, strlen(expected[i].source));
+        document_close(&doc);
+        set_output(NULL);
+        fclose(stream);
+
+        size_t count = count_matches(text, expected[i].message);
+        if (count != expected[i].count) {
+            printf("Expected %zu of \"%s\", found %zu in:\n%s\n", expected[i].count, expected[i].message, count, text);
+            ++failed;
+        }
+        free(text);
+    }
+
+    printf("errors: %zu of %zu messages printed as expected\n", total - failed, total);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}